@@ -0,0 +1,9 @@
+find_library(ZLIB_LIB NAMES "libz.so" PATHS "/usr/lib")
+
+find_library(ZSTD_LIB NAMES "libzstd.so" PATHS "/usr/lib")
+find_path(ZSTD_INCLUDE NAMES "zstd.h")
+if(ZSTD_LIB AND ZSTD_INCLUDE)
+  add_definitions(-DHAVE_ZSTD)
+else()
+  set(ZSTD_LIB "")
+endif()
@@ -27,6 +27,7 @@
 
 #include <stdexcept>
 #include <list>
+#include <thread>
 
 #include "args.h"
 #include "file_reader.h"
@@ -41,8 +42,16 @@ namespace ledger_rest {
       {"level",  'l', "log level",      0,  "Log level [0-9]. Higher numbers mean more logging." },
       {"file",  'f', "ledger file",      0,  "Leger file" },
       {"ledger_rest_prefix",  'e', "ledger rest prefix",      0,  "Prefix for ledger REST http queries. Default is /ledger_rest" },
+      {"reload_delay",  'd', "milliseconds",      0,  "Time to wait after the last journal change before reloading. Default is 500." },
+      {"snapshot",  's', "snapshot file",      0,  "File to keep a snapshot of the parsed journal in for fast startup." },
+      {"cache_size",  'z', "megabytes",      0,  "Memory used to cache responses. Default is 64." },
+      {"compression_level",  'g', "level",      0,  "Compression level [0-9], 0 turns compression off. Default is 6." },
+      {"compression_min_size",  'b', "bytes",      0,  "Smallest response body that is compressed. Default is 1024." },
+      {"batch_window",  'w', "microseconds",      0,  "Time to collect register requests for answering together. Default is 0, off." },
       {"port",  'p', "port number",      0,  "Port for server to run on." },
       {"address",  'a', "address to run on",      0,  "Address for server to bind to." },
+      {"connections",  'm', "connection limit",      0,  "Maximum number of concurrent connections. Default is 4096." },
+      {"threads",  'n', "worker threads",      0,  "Number of worker threads. Default is number of cores. Requests that need ledger still run one at a time." },
       {"key",  'k', "private key file",      0,  "File containing private key for HTTPS." },
       {"cert",  'c', "certificate file",      0,  "Certificate used by HTTPS." },
       {"client_cert",  't', "client certificate file", 0, "Certificate used to validate client certs." },
@@ -58,8 +67,16 @@ namespace ledger_rest {
     arguments.log_level = 0;
     arguments.ledger_file_path = std::string("");
     arguments.ledger_rest_prefix = std::string("ledger_rest");
+    arguments.reload_delay = 500;
+    arguments.snapshot_path = std::string("");
+    arguments.cache_size = 64;
+    arguments.compression_level = 6;
+    arguments.compression_min_size = 1024;
+    arguments.batch_window = 0;
     arguments.port = 80;
     arguments.address = "0.0.0.0";
+    arguments.connection_limit = 4096;
+    arguments.worker_threads = 0;
     arguments.key = std::string("");
     arguments.cert = std::string("");
     arguments.client_cert = std::string("");
@@ -105,6 +122,24 @@ namespace ledger_rest {
         }
         break;
 
+      case 'm':
+        {
+          int connection_limit = std::stoi(std::string(arg));
+          if (connection_limit <= 0)
+            throw std::runtime_error("Invalid connection limit " + std::string(arg));
+          arguments->connection_limit = connection_limit;
+        }
+        break;
+
+      case 'n':
+        {
+          int worker_threads = std::stoi(std::string(arg));
+          if (worker_threads <= 0)
+            throw std::runtime_error("Invalid number of worker threads " + std::string(arg));
+          arguments->worker_threads = worker_threads;
+        }
+        break;
+
       case 'k':
         {
           std::string key = read_whole_file(std::string(arg));
@@ -146,6 +181,55 @@ namespace ledger_rest {
         arguments->ledger_rest_prefix = std::string(arg);
         break;
 
+      case 'd':
+        {
+          int reload_delay = std::stoi(std::string(arg));
+          if (reload_delay < 0)
+            throw std::runtime_error("Invalid reload delay " + std::string(arg));
+          arguments->reload_delay = reload_delay;
+        }
+        break;
+
+      case 's':
+        arguments->snapshot_path = std::string(arg);
+        break;
+
+      case 'z':
+        {
+          int cache_size = std::stoi(std::string(arg));
+          if (cache_size < 0)
+            throw std::runtime_error("Invalid cache size " + std::string(arg));
+          arguments->cache_size = cache_size;
+        }
+        break;
+
+      case 'g':
+        {
+          int compression_level = std::stoi(std::string(arg));
+          if (compression_level < 0 || compression_level > 9)
+            throw std::runtime_error("Invalid compression level " + std::string(arg));
+          arguments->compression_level = compression_level;
+        }
+        break;
+
+      case 'b':
+        {
+          int compression_min_size = std::stoi(std::string(arg));
+          if (compression_min_size < 0)
+            throw std::runtime_error("Invalid compression minimum size " + std::string(arg));
+          arguments->compression_min_size = compression_min_size;
+        }
+        break;
+
+      case 'w':
+        {
+          int batch_window = std::stoi(std::string(arg));
+          if (batch_window < 0)
+            throw std::runtime_error("Invalid batch window " + std::string(arg));
+          arguments->batch_window = batch_window;
+        }
+        break;
+
       default:
         return ARGP_ERR_UNKNOWN;
     }
@@ -168,6 +252,19 @@ namespace ledger_rest {
     return arguments.address;
   }
 
+  int args::get_connection_limit() {
+    return arguments.connection_limit;
+  }
+
+  int args::get_worker_threads() {
+    if (arguments.worker_threads > 0)
+      return arguments.worker_threads;
+
+    // hardware_concurrency may return 0 if it cannot be determined.
+    unsigned int cores = std::thread::hardware_concurrency();
+    return cores > 0 ? cores : 1;
+  }
+
   int args::get_log_level() {
     return arguments.log_level;
   }
@@ -180,6 +277,30 @@ namespace ledger_rest {
     return arguments.ledger_rest_prefix;
   }
 
+  int args::get_reload_delay() {
+    return arguments.reload_delay;
+  }
+
+  std::string args::get_snapshot_path() {
+    return arguments.snapshot_path;
+  }
+
+  int args::get_cache_size() {
+    return arguments.cache_size;
+  }
+
+  int args::get_compression_level() {
+    return arguments.compression_level;
+  }
+
+  int args::get_compression_min_size() {
+    return arguments.compression_min_size;
+  }
+
+  int args::get_batch_window() {
+    return arguments.batch_window;
+  }
+
   std::string args::get_key() {
     return arguments.key;
   }
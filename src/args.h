@@ -42,9 +42,17 @@ namespace ledger_rest {
 
       virtual int get_port();
       virtual std::string get_address();
+      virtual int get_connection_limit();
+      virtual int get_worker_threads();
       virtual int get_log_level();
       virtual std::string get_ledger_file_path();
       virtual std::string get_ledger_rest_prefix();
+      virtual int get_reload_delay();
+      virtual std::string get_snapshot_path();
+      virtual int get_cache_size();
+      virtual int get_compression_level();
+      virtual int get_compression_min_size();
+      virtual int get_batch_window();
       virtual std::string get_key();
       virtual std::string get_cert();
       virtual std::string get_client_cert();
@@ -59,8 +67,16 @@ namespace ledger_rest {
         int log_level;
         int port;
         std::string address;
+        int connection_limit;
+        int worker_threads;
         std::string ledger_file_path;
         std::string ledger_rest_prefix;
+        int reload_delay;
+        std::string snapshot_path;
+        int cache_size;
+        int compression_level;
+        int compression_min_size;
+        int batch_window;
         std::string key;
         std::string cert;
         std::string client_cert;
@@ -0,0 +1,138 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include <unistd.h>
+
+#include "body_spool.h"
+
+namespace ledger_rest {
+  namespace {
+    void write_fully(int fd, const char* data, std::size_t size) {
+      while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written == -1 && errno == EINTR) {
+          continue;
+        } else if (written == -1) {
+          throw std::runtime_error(std::string("Unable to write spool file: ")
+              + std::strerror(errno));
+        }
+        data += written;
+        size -= written;
+      }
+    }
+  }
+
+  body_spool::body_spool(std::size_t memory_limit)
+    : memory_limit(memory_limit), fd(-1), length(0) {
+  }
+
+  body_spool::~body_spool() {
+    if (fd != -1) {
+      close(fd);
+    }
+  }
+
+  void body_spool::write(const char* data, std::size_t size) {
+    if (fd == -1 && length + size > memory_limit) {
+      spill();
+    }
+
+    if (fd == -1) {
+      body.append(data, size);
+    } else {
+      write_fully(fd, data, size);
+    }
+    length += size;
+  }
+
+  // The file is unlinked right away so that it is removed however the
+  // process ends.
+  void body_spool::spill() {
+    const char* directory = std::getenv("TMPDIR");
+    std::string path(directory && *directory ? directory : "/tmp");
+    path += "/ledger-rest-XXXXXX";
+    std::vector<char> path_buffer(path.cbegin(), path.cend());
+    path_buffer.push_back('\0');
+
+    fd = mkstemp(path_buffer.data());
+    if (fd == -1) {
+      throw std::runtime_error(std::string("Unable to create spool file: ")
+          + std::strerror(errno));
+    }
+    unlink(path_buffer.data());
+
+    write_fully(fd, body.data(), body.size());
+    std::string().swap(body);
+  }
+
+  std::size_t body_spool::size() const {
+    return length;
+  }
+
+  std::size_t body_spool::get_memory_size() const {
+    return body.size();
+  }
+
+  bool body_spool::is_spilled() const {
+    return fd != -1;
+  }
+
+  std::string body_spool::release() {
+    if (is_spilled()) {
+      throw std::runtime_error("Spilled body can not be released");
+    }
+    length = 0;
+    return std::move(body);
+  }
+
+  void body_spool::write_to(http::body_writer& writer) const {
+    if (!is_spilled()) {
+      writer.write(body);
+      return;
+    }
+
+    std::vector<char> buffer(64 * 1024);
+    std::size_t offset = 0;
+    while (offset < length) {
+      ssize_t read = pread(fd, buffer.data(), std::min(buffer.size(), length - offset), offset);
+      if (read == -1 && errno == EINTR) {
+        continue;
+      } else if (read <= 0) {
+        throw std::runtime_error(std::string("Unable to read spool file: ")
+            + (read == 0 ? "unexpected end" : std::strerror(errno)));
+      }
+      writer.write(buffer.data(), read);
+      offset += read;
+    }
+  }
+}
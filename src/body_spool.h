@@ -0,0 +1,70 @@
+/* * Copyright (c) 2015-2020 Chad Voegele
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *  * The name of Chad Voegele may not be used to endorse or promote products
+ * derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "http.h"
+
+namespace ledger_rest {
+  // Holds a body in memory until it grows past memory_limit and in an
+  // unlinked temporary file after that. A body can then be produced in full,
+  // e.g. while a lock is held, and sent afterwards without being bounded by
+  // memory. Once written it may be sent to several writers at the same time.
+  class body_spool : public http::body_writer {
+    public:
+      body_spool(std::size_t memory_limit);
+      body_spool(const body_spool&) = delete;
+      body_spool& operator=(const body_spool&) = delete;
+      body_spool (body_spool&&) = delete;
+      body_spool& operator=(const body_spool&&) = delete;
+      virtual ~body_spool();
+
+      virtual void write(const char* data, std::size_t size);
+      using http::body_writer::write;
+
+      std::size_t size() const;
+      // Bytes of the body held in memory, never more than memory_limit.
+      std::size_t get_memory_size() const;
+      // True once the body has been moved to the temporary file.
+      bool is_spilled() const;
+      // Moves the body out. Only valid while it is in memory.
+      std::string release();
+      // Writes the whole body to writer. Reads are positioned so that
+      // several writers can be sent the body at once.
+      void write_to(http::body_writer& writer) const;
+
+    private:
+      void spill();
+
+      const std::size_t memory_limit;
+      std::string body;
+      int fd;
+      std::size_t length;
+  };
+}
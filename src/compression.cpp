@@ -0,0 +1,255 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include <cstdlib>
+#include <stdexcept>
+#include <vector>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "compression.h"
+
+namespace ledger_rest {
+  namespace {
+    const std::size_t output_size = 64 * 1024;
+
+    std::string trim(const std::string& s) {
+      std::size_t first = s.find_first_not_of(" \t");
+      if (first == std::string::npos) {
+        return std::string("");
+      }
+      std::size_t last = s.find_last_not_of(" \t");
+      return s.substr(first, last - first + 1);
+    }
+
+    // Higher is better when q-values are equal.
+    int get_preference(content_encoding encoding) {
+      switch (encoding) {
+        case content_encoding::ZSTD:
+          return 3;
+        case content_encoding::GZIP:
+          return 2;
+        case content_encoding::DEFLATE:
+          return 1;
+        default:
+          return 0;
+      }
+    }
+  }
+
+  content_encoding negotiate_encoding(const std::string& accept_encoding) {
+    std::vector<content_encoding> supported = { content_encoding::GZIP,
+      content_encoding::DEFLATE };
+#ifdef HAVE_ZSTD
+    supported.push_back(content_encoding::ZSTD);
+#endif
+
+    content_encoding best = content_encoding::IDENTITY;
+    double best_q = 0;
+    double wildcard_q = -1;
+    std::vector<std::pair<std::string, double>> codings;
+
+    std::size_t begin = 0;
+    while (begin <= accept_encoding.size()) {
+      std::size_t end = accept_encoding.find(',', begin);
+      if (end == std::string::npos) {
+        end = accept_encoding.size();
+      }
+      std::string item(accept_encoding.substr(begin, end - begin));
+      begin = end + 1;
+
+      std::size_t semicolon = item.find(';');
+      std::string name(trim(item.substr(0, semicolon)));
+      double q = 1;
+      if (semicolon != std::string::npos) {
+        std::string param(trim(item.substr(semicolon + 1)));
+        if (param.compare(0, 2, "q=") == 0) {
+          q = std::strtod(param.c_str() + 2, NULL);
+        }
+      }
+
+      if (name == "*") {
+        wildcard_q = q;
+      } else if (name.size() > 0) {
+        codings.push_back(std::make_pair(name, q));
+      }
+    }
+
+    for (content_encoding encoding : supported) {
+      double q = wildcard_q;
+      for (const auto& coding : codings) {
+        if (coding.first == get_encoding_name(encoding)
+            || (encoding == content_encoding::GZIP && coding.first == "x-gzip")) {
+          q = coding.second;
+        }
+      }
+
+      if (q > best_q || (q == best_q && q > 0
+            && get_preference(encoding) > get_preference(best))) {
+        best = encoding;
+        best_q = q;
+      }
+    }
+    return best;
+  }
+
+  std::string get_encoding_name(content_encoding encoding) {
+    switch (encoding) {
+      case content_encoding::GZIP:
+        return std::string("gzip");
+      case content_encoding::DEFLATE:
+        return std::string("deflate");
+      case content_encoding::ZSTD:
+        return std::string("zstd");
+      default:
+        return std::string("");
+    }
+  }
+
+  std::string compress(const std::string& data, content_encoding encoding, int level) {
+    http::string_body_writer output;
+    compressing_body_writer writer(output, encoding, level);
+    writer.write(data);
+    writer.finish();
+    return output.body;
+  }
+
+  struct compressing_body_writer::stream {
+    content_encoding encoding;
+    z_stream zlib;
+#ifdef HAVE_ZSTD
+    ZSTD_CCtx* zstd;
+#endif
+    std::vector<char> output;
+  };
+
+  // HTTP's deflate is the zlib format, not raw deflate.
+  compressing_body_writer::compressing_body_writer(http::body_writer& writer,
+      content_encoding encoding, int level)
+    : writer(writer), compressor(new stream()) {
+    compressor->encoding = encoding;
+    compressor->output.resize(output_size);
+
+    if (encoding == content_encoding::GZIP || encoding == content_encoding::DEFLATE) {
+      int window_bits = encoding == content_encoding::GZIP ? 15 + 16 : 15;
+      if (deflateInit2(&compressor->zlib, level, Z_DEFLATED, window_bits, 8,
+            Z_DEFAULT_STRATEGY) != Z_OK) {
+        delete compressor;
+        throw std::runtime_error("Could not initialize zlib.");
+      }
+
+#ifdef HAVE_ZSTD
+    } else if (encoding == content_encoding::ZSTD) {
+      compressor->zstd = ZSTD_createCCtx();
+      if (compressor->zstd == NULL) {
+        delete compressor;
+        throw std::runtime_error("Could not initialize zstd.");
+      }
+      ZSTD_CCtx_setParameter(compressor->zstd, ZSTD_c_compressionLevel, level);
+#endif
+
+    } else {
+      delete compressor;
+      throw std::runtime_error("Unsupported content encoding.");
+    }
+  }
+
+  compressing_body_writer::~compressing_body_writer() {
+#ifdef HAVE_ZSTD
+    if (compressor->encoding == content_encoding::ZSTD) {
+      ZSTD_freeCCtx(compressor->zstd);
+    } else {
+      deflateEnd(&compressor->zlib);
+    }
+#else
+    deflateEnd(&compressor->zlib);
+#endif
+    delete compressor;
+  }
+
+  void compressing_body_writer::write(const char* data, std::size_t size) {
+    std::vector<char>& output = compressor->output;
+#ifdef HAVE_ZSTD
+    if (compressor->encoding == content_encoding::ZSTD) {
+      ZSTD_inBuffer in = { data, size, 0 };
+      while (in.pos < in.size) {
+        ZSTD_outBuffer out = { output.data(), output.size(), 0 };
+        if (ZSTD_isError(ZSTD_compressStream2(compressor->zstd, &out, &in, ZSTD_e_continue)))
+          throw std::runtime_error("zstd compression failed.");
+        writer.write(output.data(), out.pos);
+      }
+      return;
+    }
+#endif
+
+    z_stream& zlib = compressor->zlib;
+    zlib.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    zlib.avail_in = size;
+    while (zlib.avail_in > 0) {
+      zlib.next_out = reinterpret_cast<Bytef*>(output.data());
+      zlib.avail_out = output.size();
+      if (deflate(&zlib, Z_NO_FLUSH) == Z_STREAM_ERROR)
+        throw std::runtime_error("zlib compression failed.");
+      std::size_t produced = output.size() - zlib.avail_out;
+      if (produced > 0) {
+        writer.write(output.data(), produced);
+      }
+    }
+  }
+
+  void compressing_body_writer::finish() {
+    std::vector<char>& output = compressor->output;
+#ifdef HAVE_ZSTD
+    if (compressor->encoding == content_encoding::ZSTD) {
+      ZSTD_inBuffer in = { NULL, 0, 0 };
+      std::size_t remaining;
+      do {
+        ZSTD_outBuffer out = { output.data(), output.size(), 0 };
+        remaining = ZSTD_compressStream2(compressor->zstd, &out, &in, ZSTD_e_end);
+        if (ZSTD_isError(remaining))
+          throw std::runtime_error("zstd compression failed.");
+        writer.write(output.data(), out.pos);
+      } while (remaining > 0);
+      return;
+    }
+#endif
+
+    z_stream& zlib = compressor->zlib;
+    zlib.next_in = NULL;
+    zlib.avail_in = 0;
+    int status;
+    do {
+      zlib.next_out = reinterpret_cast<Bytef*>(output.data());
+      zlib.avail_out = output.size();
+      status = deflate(&zlib, Z_FINISH);
+      if (status == Z_STREAM_ERROR)
+        throw std::runtime_error("zlib compression failed.");
+      writer.write(output.data(), output.size() - zlib.avail_out);
+    } while (status != Z_STREAM_END);
+  }
+}
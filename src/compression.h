@@ -0,0 +1,65 @@
+/* * Copyright (c) 2015-2020 Chad Voegele
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *  * The name of Chad Voegele may not be used to endorse or promote products
+ * derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "http.h"
+
+namespace ledger_rest {
+  enum class content_encoding { IDENTITY, GZIP, DEFLATE, ZSTD };
+
+  // The encoding the client prefers among those supported, by q-value and
+  // then by how well each compresses. IDENTITY if none is acceptable.
+  content_encoding negotiate_encoding(const std::string& accept_encoding);
+  // The Content-Encoding name, empty for IDENTITY.
+  std::string get_encoding_name(content_encoding encoding);
+  std::string compress(const std::string& data, content_encoding encoding, int level);
+
+  // Compresses what is written and writes the result to another writer as
+  // it fills. finish must be called after the last write.
+  class compressing_body_writer : public http::body_writer {
+    public:
+      compressing_body_writer(http::body_writer& writer, content_encoding encoding, int level);
+      compressing_body_writer(const compressing_body_writer&) = delete;
+      compressing_body_writer& operator=(const compressing_body_writer&) = delete;
+      compressing_body_writer (compressing_body_writer&&) = delete;
+      compressing_body_writer& operator=(const compressing_body_writer&&) = delete;
+      virtual ~compressing_body_writer();
+
+      virtual void write(const char* data, std::size_t size);
+      using http::body_writer::write;
+      void finish();
+
+    private:
+      struct stream;
+
+      http::body_writer& writer;
+      stream* compressor;
+  };
+}
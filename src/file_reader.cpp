@@ -26,17 +26,44 @@
 //
 
 #include <string>
-#include <fstream>
-#include <streambuf>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "file_reader.h"
 
 namespace ledger_rest {
+  // Read rather than mapped, so that a file truncated while it is read
+  // gives a short result rather than SIGBUS. A file that cannot be read
+  // reads as empty.
   std::string read_whole_file(std::string path) {
-    // Thanks to Tyler McHenry on SO
-    std::ifstream t(path);
-    std::string str((std::istreambuf_iterator<char>(t)),
-        std::istreambuf_iterator<char>());
-    return str;
+    std::string contents;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+      return contents;
+    }
+
+    // One more byte than the file has so that its end is found without
+    // growing the string.
+    struct stat info;
+    contents.resize(fstat(fd, &info) == 0 && info.st_size > 0 ? info.st_size + 1 : 4096);
+    std::size_t size = 0;
+    while (true) {
+      if (size == contents.size()) {
+        contents.resize(contents.size() * 2);
+      }
+      ssize_t count = read(fd, &contents[size], contents.size() - size);
+      if (count == -1 && errno == EINTR) {
+        continue;
+      } else if (count <= 0) {
+        break;
+      }
+      size += count;
+    }
+    close(fd);
+
+    contents.resize(size);
+    return contents;
   }
 }
@@ -25,7 +25,9 @@
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //
 
+#include <cstring>
 #include <sstream>
+#include <strings.h>
 
 #include "http.h"
 
@@ -50,4 +52,58 @@ namespace http {
     std::string s(ss.str());
     return s;
   }
+
+  std::string request::get_header(const std::string& name) const {
+    for (auto iter = headers.cbegin(); iter != headers.cend(); iter++) {
+      if (strcasecmp(iter->first.c_str(), name.c_str()) == 0) {
+        return iter->second;
+      }
+    }
+    return std::string("");
+  }
+
+  std::string format_http_date(std::time_t time) {
+    struct tm tm;
+    gmtime_r(&time, &tm);
+    char buffer[64];
+    std::size_t size = strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return std::string(buffer, size);
+  }
+
+  bool parse_http_date(const std::string& date, std::time_t& time) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char* end = strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (end == NULL || *end != '\0') {
+      return false;
+    }
+    time = timegm(&tm);
+    return true;
+  }
+
+  bool etag_matches(const std::string& if_none_match, const std::string& etag) {
+    auto strip_weak = [](const std::string& tag) {
+      return tag.compare(0, 2, "W/") == 0 ? tag.substr(2) : tag;
+    };
+    std::string strong(strip_weak(etag));
+
+    std::size_t begin = 0;
+    while (begin < if_none_match.size()) {
+      std::size_t end = if_none_match.find(',', begin);
+      if (end == std::string::npos) {
+        end = if_none_match.size();
+      }
+
+      std::size_t first = if_none_match.find_first_not_of(" \t", begin);
+      std::size_t last = if_none_match.find_last_not_of(" \t", end - 1);
+      if (first != std::string::npos && first < end && last >= first) {
+        std::string tag(if_none_match.substr(first, last - first + 1));
+        if (tag == "*" || strip_weak(tag) == strong) {
+          return true;
+        }
+      }
+      begin = end + 1;
+    }
+    return false;
+  }
 }
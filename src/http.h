@@ -26,8 +26,13 @@
 
 #pragma once
 
+#include <cstddef>
+#include <ctime>
+#include <functional>
 #include <map>
+#include <memory>
 #include <string>
+#include <utility>
 
 namespace http {
   enum status_code {
@@ -40,6 +45,7 @@ namespace http {
     NOT_FOUND = 404,
     METHOD_NOT_ALLOWED = 405,
     INTERNAL_SERVER_ERROR = 500,
+    SERVICE_UNAVAILABLE = 503,
   };
 
   class request final {
@@ -62,21 +68,69 @@ namespace http {
       ~request() = default;
 
       std::string to_string();
+      // Header names are case insensitive. Empty if the header is missing.
+      std::string get_header(const std::string& name) const;
   };
 
+  class body_writer {
+    public:
+      virtual ~body_writer() { }
+      // May block until the client has read earlier data. Throws if the
+      // body is no longer wanted, e.g. the client went away.
+      virtual void write(const char* data, std::size_t size) = 0;
+      void write(const std::string& data) {
+        write(data.data(), data.size());
+      }
+  };
+
+  class string_body_writer : public body_writer {
+    public:
+      virtual void write(const char* data, std::size_t size) {
+        body.append(data, size);
+      }
+      using body_writer::write;
+
+      std::string body;
+  };
+
+  // Writes a response body that is sent as it is produced rather than
+  // held in memory. Run on a worker thread.
+  typedef std::function<void(body_writer&)> body_producer;
+
+  // The body is immutable and shared so that a response can be copied, or
+  // served from a cache, without copying the body.
   class response final {
     public:
-      const int status_code;
-      const std::string body;
-      const std::map<std::string, std::string> headers;
+      int status_code;
+      std::shared_ptr<const std::string> body;
+      std::map<std::string, std::string> headers;
+      // Set instead of body for streamed responses.
+      body_producer producer;
 
       response(int status_code,
           std::string body,
           std::map<std::string, std::string> headers)
-          : status_code(status_code), body(body), headers(headers) { }
-      response(const response& other) : status_code(other.status_code),
-        body(other.body), headers(other.headers) { }
-      response& operator=(const response& other) = delete;
+          : status_code(status_code), body(std::make_shared<const std::string>(std::move(body))),
+          headers(std::move(headers)) { }
+      response(int status_code,
+          std::shared_ptr<const std::string> body,
+          std::map<std::string, std::string> headers)
+          : status_code(status_code), body(std::move(body)), headers(std::move(headers)) { }
+      response(int status_code,
+          body_producer producer,
+          std::map<std::string, std::string> headers)
+          : status_code(status_code), body(std::make_shared<const std::string>()),
+          headers(std::move(headers)), producer(std::move(producer)) { }
+      response(const response& other) = default;
+      response(response&& other) = default;
+      response& operator=(const response& other) = default;
+      response& operator=(response&& other) = default;
       ~response() = default;
   };
+
+  // RFC 7231 IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT".
+  std::string format_http_date(std::time_t time);
+  bool parse_http_date(const std::string& date, std::time_t& time);
+  // If-None-Match uses the weak comparison so W/ prefixes are ignored.
+  bool etag_matches(const std::string& if_none_match, const std::string& etag);
 }
@@ -0,0 +1,403 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <glob.h>
+#include <sys/stat.h>
+
+#include "journal_file.h"
+
+namespace ledger_rest {
+  namespace {
+    bool starts_with(const char* line, const char* end, const char* prefix) {
+      std::size_t length = strlen(prefix);
+      return static_cast<std::size_t>(end - line) >= length
+        && memcmp(line, prefix, length) == 0;
+    }
+
+    bool is_blank(const char* line, const char* end) {
+      for (const char* c = line; c < end; c++) {
+        if (*c != ' ' && *c != '\t' && *c != '\r')
+          return false;
+      }
+      return true;
+    }
+
+    // Matches a date with a four digit year, e.g. 2015/05/01 or 2015-5-1, so
+    // the date does not depend on a year directive earlier in the file.
+    bool starts_with_full_date(const char* line, const char* end) {
+      const char* c = line;
+      for (int i = 0; i < 4; i++, c++) {
+        if (c == end || !isdigit(static_cast<unsigned char>(*c)))
+          return false;
+      }
+
+      for (int part = 0; part < 2; part++) {
+        if (c == end || (*c != '/' && *c != '-' && *c != '.'))
+          return false;
+        c++;
+
+        const char* digits = c;
+        while (c < end && isdigit(static_cast<unsigned char>(*c)))
+          c++;
+        if (c == digits || c - digits > 2)
+          return false;
+      }
+
+      return c == end || !isdigit(static_cast<unsigned char>(*c));
+    }
+
+    bool is_comment(char c) {
+      return c == ';' || c == '#' || c == '*' || c == '%' || c == '|';
+    }
+
+    // Returns the length of the include directive at line, 0 if there is none.
+    std::size_t get_include_length(const char* line, const char* end) {
+      const char* spellings[] = { "include ", "!include ", "@include " };
+      for (const char* spelling : spellings) {
+        if (starts_with(line, end, spelling))
+          return strlen(spelling);
+      }
+      return 0;
+    }
+
+    // Declarations only add names to the journal so parsing them again is
+    // harmless.
+    bool is_declaration(const char* line, const char* end) {
+      const char* declarations[] = { "account ", "commodity ", "payee ", "tag " };
+      for (const char* declaration : declarations) {
+        if (starts_with(line, end, declaration))
+          return true;
+      }
+      return false;
+    }
+
+    bool has_only_transactions(const char* data, std::size_t size, bool allow_includes) {
+      bool in_entry = false;
+
+      const char* line = data;
+      const char* contents_end = data + size;
+      while (line < contents_end) {
+        const char* end = static_cast<const char*>(memchr(line, '\n', contents_end - line));
+        if (end == NULL)
+          end = contents_end;
+
+        if (is_blank(line, end)) {
+          in_entry = false;
+
+        } else if (*line == ' ' || *line == '\t') {
+          // Postings at the start would belong to whatever came before.
+          if (!in_entry)
+            return false;
+
+        } else if (is_comment(*line)) {
+          in_entry = false;
+
+        } else if (starts_with_full_date(line, end) || is_declaration(line, end)) {
+          in_entry = true;
+
+        } else if (allow_includes && get_include_length(line, end) > 0) {
+          in_entry = false;
+
+        } else {
+          return false;
+        }
+
+        line = end + 1;
+      }
+      return true;
+    }
+
+    const unsigned long long prime64_1 = 11400714785074694791ULL;
+    const unsigned long long prime64_2 = 14029467366897019727ULL;
+    const unsigned long long prime64_3 = 1609587929392839161ULL;
+    const unsigned long long prime64_4 = 9650029242287828579ULL;
+    const unsigned long long prime64_5 = 2870177450012600261ULL;
+
+    unsigned long long rotl64(unsigned long long x, int r) {
+      return (x << r) | (x >> (64 - r));
+    }
+
+    // Assumes a little endian host. Hashes are only compared on one host.
+    unsigned long long read64(const char* p) {
+      unsigned long long v;
+      memcpy(&v, p, sizeof(v));
+      return v;
+    }
+
+    unsigned long long read32(const char* p) {
+      uint32_t v;
+      memcpy(&v, p, sizeof(v));
+      return v;
+    }
+
+    unsigned long long xxh64_round(unsigned long long acc, unsigned long long input) {
+      acc += input * prime64_2;
+      acc = rotl64(acc, 31);
+      return acc * prime64_1;
+    }
+
+    unsigned long long xxh64_merge(unsigned long long acc, unsigned long long val) {
+      acc ^= xxh64_round(0, val);
+      return acc * prime64_1 + prime64_4;
+    }
+  }
+
+  // XXH64 with a seed of 0.
+  unsigned long long hash_bytes(const char* data, std::size_t size) {
+    const char* p = data;
+    const char* end = data + size;
+    unsigned long long hash;
+
+    if (size >= 32) {
+      unsigned long long v1 = prime64_1 + prime64_2;
+      unsigned long long v2 = prime64_2;
+      unsigned long long v3 = 0;
+      unsigned long long v4 = 0 - prime64_1;
+      const char* limit = end - 32;
+      do {
+        v1 = xxh64_round(v1, read64(p));
+        v2 = xxh64_round(v2, read64(p + 8));
+        v3 = xxh64_round(v3, read64(p + 16));
+        v4 = xxh64_round(v4, read64(p + 24));
+        p += 32;
+      } while (p <= limit);
+
+      hash = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+      hash = xxh64_merge(hash, v1);
+      hash = xxh64_merge(hash, v2);
+      hash = xxh64_merge(hash, v3);
+      hash = xxh64_merge(hash, v4);
+
+    } else {
+      hash = prime64_5;
+    }
+
+    hash += size;
+
+    for (; p + 8 <= end; p += 8) {
+      hash ^= xxh64_round(0, read64(p));
+      hash = rotl64(hash, 27) * prime64_1 + prime64_4;
+    }
+    if (p + 4 <= end) {
+      hash ^= read32(p) * prime64_1;
+      hash = rotl64(hash, 23) * prime64_2 + prime64_3;
+      p += 4;
+    }
+    for (; p < end; p++) {
+      hash ^= static_cast<unsigned char>(*p) * prime64_5;
+      hash = rotl64(hash, 11) * prime64_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= prime64_2;
+    hash ^= hash >> 29;
+    hash *= prime64_3;
+    hash ^= hash >> 32;
+    return hash;
+  }
+
+  journal_file_state get_journal_file_state(const std::string& path,
+      const char* data, std::size_t size) {
+    journal_file_state state;
+    state.path = path;
+    state.size = size;
+    state.hash = hash_bytes(data, size);
+    state.is_appendable = !has_stateful_directives(data, size);
+    state.is_plain = is_plain_journal(data, size);
+    return state;
+  }
+
+  journal_file_state get_journal_file_state(const std::string& path,
+      const std::string& contents) {
+    return get_journal_file_state(path, contents.data(), contents.size());
+  }
+
+  // Identifies the contents of a whole journal: every file's path and hash
+  // in load order.
+  unsigned long long hash_journal_files(const std::list<journal_file_state>& files) {
+    std::string key;
+    for (const journal_file_state& file : files) {
+      key.append(file.path);
+      key.push_back('\0');
+      key.append(reinterpret_cast<const char*>(&file.hash), sizeof(file.hash));
+    }
+    return hash_bytes(key.data(), key.size());
+  }
+
+  // The newest modification time of the files, 0 if none can be read.
+  std::time_t get_last_modified(const std::list<journal_file_state>& files) {
+    std::time_t last_modified = 0;
+    for (const journal_file_state& file : files) {
+      struct stat info;
+      if (stat(file.path.c_str(), &info) == 0 && info.st_mtime > last_modified) {
+        last_modified = info.st_mtime;
+      }
+    }
+    return last_modified;
+  }
+
+  // Directives whose effect carries over to later transactions in the same
+  // file, including transactions in files it includes.
+  bool has_stateful_directives(const char* data, std::size_t size) {
+    const char* directives[] = { "apply ", "bucket ", "A ", "year ", "Y",
+      "end ", "define ", "=" };
+
+    const char* line = data;
+    const char* contents_end = data + size;
+    while (line < contents_end) {
+      const char* end = static_cast<const char*>(memchr(line, '\n', contents_end - line));
+      if (end == NULL)
+        end = contents_end;
+
+      for (const char* directive : directives) {
+        if (starts_with(line, end, directive))
+          return true;
+      }
+      if (line < end && *line == '!' && starts_with(line + 1, end, "apply "))
+        return true;
+      if (line < end && *line == '@' && starts_with(line + 1, end, "apply "))
+        return true;
+
+      line = end + 1;
+    }
+    return false;
+  }
+
+  bool has_stateful_directives(const std::string& contents) {
+    return has_stateful_directives(contents.data(), contents.size());
+  }
+
+  // A tail may only hold dated transactions, their postings, declarations and
+  // comments. Anything else could depend on or change parser state and needs
+  // a full reload.
+  bool is_appendable_tail(const std::string& tail) {
+    return has_only_transactions(tail.data(), tail.size(), false);
+  }
+
+  // A plain file can be parsed again on its own in place of its previous
+  // parse.
+  bool is_plain_journal(const char* data, std::size_t size) {
+    return has_only_transactions(data, size, true);
+  }
+
+  bool is_plain_journal(const std::string& contents) {
+    return is_plain_journal(contents.data(), contents.size());
+  }
+
+  // Returns the offset where newly appended data starts or std::string::npos
+  // if contents is not state's file with data appended at a line boundary.
+  std::size_t get_appended_offset(const journal_file_state& state,
+      const char* data, std::size_t size) {
+    if (size <= state.size)
+      return std::string::npos;
+    if (state.size > 0 && data[state.size - 1] != '\n')
+      return std::string::npos;
+    if (hash_bytes(data, state.size) != state.hash)
+      return std::string::npos;
+    return state.size;
+  }
+
+  std::size_t get_appended_offset(const journal_file_state& state,
+      const std::string& contents) {
+    return get_appended_offset(state, contents.data(), contents.size());
+  }
+
+  // Accepts the include, !include and @include spellings.
+  std::list<std::string> get_include_directives(const char* data, std::size_t size) {
+    std::list<std::string> includes;
+
+    const char* line = data;
+    const char* contents_end = data + size;
+    while (line < contents_end) {
+      const char* end = static_cast<const char*>(memchr(line, '\n', contents_end - line));
+      if (end == NULL)
+        end = contents_end;
+
+      std::size_t length = get_include_length(line, end);
+      if (length > 0) {
+        const char* begin = line + length;
+        const char* last = end;
+        while (begin < last && isspace(static_cast<unsigned char>(*begin)))
+          begin++;
+        while (last > begin && isspace(static_cast<unsigned char>(*(last - 1))))
+          last--;
+        if (begin < last)
+          includes.push_back(std::string(begin, last));
+      }
+
+      line = end + 1;
+    }
+    return includes;
+  }
+
+  std::list<std::string> get_include_directives(const std::string& contents) {
+    return get_include_directives(contents.data(), contents.size());
+  }
+
+  // Relative includes are relative to the including file, as in ledger.
+  // Globs are expanded in sorted order.
+  std::list<std::string> resolve_include(const std::string& including_path,
+      const std::string& include) {
+    std::string path;
+    auto last_slash = including_path.find_last_of('/');
+
+    // Assume POSIX for absolute path check
+    if (include.at(0) != '/' && last_slash != std::string::npos) {
+      path = including_path.substr(0, 1+last_slash) + include;
+    } else {
+      path = include;
+    }
+
+    if (path.find_first_of("*?[") == std::string::npos) {
+      return std::list<std::string>{ path };
+    }
+
+    std::list<std::string> paths;
+    glob_t matches;
+    if (glob(path.c_str(), 0, NULL, &matches) == 0) {
+      for (std::size_t i = 0; i < matches.gl_pathc; i++) {
+        paths.push_back(matches.gl_pathv[i]);
+      }
+    }
+    globfree(&matches);
+    return paths;
+  }
+
+  // Different spellings of the same file, e.g. a/../a/b.txt, share an
+  // identity.
+  std::string get_file_identity(const std::string& path) {
+    char resolved[PATH_MAX];
+    if (realpath(path.c_str(), resolved) == NULL) {
+      return path;
+    }
+    return std::string(resolved);
+  }
+}
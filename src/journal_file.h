@@ -0,0 +1,70 @@
+/* * Copyright (c) 2015-2020 Chad Voegele
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *  * The name of Chad Voegele may not be used to endorse or promote products
+ * derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <ctime>
+#include <list>
+#include <string>
+
+namespace ledger_rest {
+  // What was parsed from one journal file at its last load.
+  struct journal_file_state {
+    std::string path;
+    // The including file, empty for the main file.
+    std::string parent;
+    std::size_t size = 0;
+    unsigned long long hash = 0;
+    // No directives that affect transactions later in the file.
+    bool is_appendable = false;
+    // Only transactions, declarations, comments and includes.
+    bool is_plain = false;
+  };
+
+  unsigned long long hash_bytes(const char* data, std::size_t size);
+  journal_file_state get_journal_file_state(const std::string& path,
+      const char* data, std::size_t size);
+  journal_file_state get_journal_file_state(const std::string& path,
+      const std::string& contents);
+  unsigned long long hash_journal_files(const std::list<journal_file_state>& files);
+  std::time_t get_last_modified(const std::list<journal_file_state>& files);
+  bool has_stateful_directives(const char* data, std::size_t size);
+  bool has_stateful_directives(const std::string& contents);
+  bool is_appendable_tail(const std::string& tail);
+  bool is_plain_journal(const char* data, std::size_t size);
+  bool is_plain_journal(const std::string& contents);
+  std::size_t get_appended_offset(const journal_file_state& state,
+      const char* data, std::size_t size);
+  std::size_t get_appended_offset(const journal_file_state& state,
+      const std::string& contents);
+
+  std::list<std::string> get_include_directives(const char* data, std::size_t size);
+  std::list<std::string> get_include_directives(const std::string& contents);
+  std::list<std::string> resolve_include(const std::string& including_path,
+      const std::string& include);
+  std::string get_file_identity(const std::string& path);
+}
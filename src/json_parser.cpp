@@ -24,207 +24,309 @@
 // (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //
-
 #include "json_parser.h"
 
-#include <sstream>
+#include <cctype>
+#include <cstdlib>
 #include <cstring>
 
 namespace ledger_rest {
-  std::string trim_whitespace(std::string s) {
-    std::stringstream ss;
-
-    bool in_quote = false;
-    for (auto iter = s.cbegin(); iter != s.cend(); iter++) {
-      if (in_quote || (*iter != ' ' && *iter != '\n' && *iter != '\t')) {
-        ss << *iter;
+  namespace {
+    // A position in a JSON document. Parsing moves it forward; nothing is
+    // copied except the strings that are returned.
+    struct json_cursor {
+      const char* p;
+      const char* end;
+
+      void skip_whitespace() {
+        while (p < end && (*p == ' ' || *p == '\n' || *p == '\t' || *p == '\r')) {
+          p++;
+        }
       }
 
-      if (*iter == '"') {
-        in_quote = !in_quote;
+      // Skips whitespace and then c if it is next.
+      bool consume(char c) {
+        skip_whitespace();
+        if (p < end && *p == c) {
+          p++;
+          return true;
+        }
+        return false;
       }
-    }
-
-    std::string trimmed = ss.str();
-    return trimmed;
-  }
 
-  std::optional<std::string> parse_json_string(std::string& working_json) {
-    if (working_json.length() == 0) {
-      return {};
+      bool peek(char c) {
+        skip_whitespace();
+        return p < end && *p == c;
+      }
+    };
+
+    void append_utf8(std::string& s, unsigned long code_point) {
+      if (code_point < 0x80) {
+        s.push_back(static_cast<char>(code_point));
+      } else if (code_point < 0x800) {
+        s.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+        s.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+      } else if (code_point < 0x10000) {
+        s.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+        s.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+        s.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+      } else {
+        s.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+        s.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+        s.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+        s.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+      }
     }
 
-    if (working_json.at(0) != '"') {
-      return {};
+    bool parse_hex4(json_cursor& cursor, unsigned long& value) {
+      if (cursor.end - cursor.p < 4) {
+        return false;
+      }
+      value = 0;
+      for (int i = 0; i < 4; i++) {
+        char c = *cursor.p++;
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+          value |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+          value |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+          value |= c - 'A' + 10;
+        } else {
+          return false;
+        }
+      }
+      return true;
     }
-    working_json.erase(0, 1);  // "
 
-    std::string::size_type end_quote_position = working_json.find('"');
-    if (end_quote_position == std::string::npos) {
-      return {};
-    }
+    bool parse_string(json_cursor& cursor, std::string& s) {
+      if (!cursor.consume('"')) {
+        return false;
+      }
 
-    std::string arg;
-    arg = working_json.substr(0, end_quote_position);
-    working_json.erase(0, end_quote_position);  // the string
-    working_json.erase(0, 1);  // "
+      s.clear();
+      while (cursor.p < cursor.end) {
+        // Copy runs without escapes in one go.
+        const char* run = cursor.p;
+        while (cursor.p < cursor.end && *cursor.p != '"' && *cursor.p != '\\') {
+          cursor.p++;
+        }
+        s.append(run, cursor.p - run);
+        if (cursor.p == cursor.end) {
+          return false;
+        }
 
-    return arg;
-  }
+        if (*cursor.p++ == '"') {
+          return true;
+        }
 
-  std::optional<std::list<std::string>> parse_json_array_of_strings(
-      std::string& working_json) {
-    if (working_json.length() == 0) {
-      return {};
+        if (cursor.p == cursor.end) {
+          return false;
+        }
+        switch (*cursor.p++) {
+          case '"': s.push_back('"'); break;
+          case '\\': s.push_back('\\'); break;
+          case '/': s.push_back('/'); break;
+          case 'b': s.push_back('\b'); break;
+          case 'f': s.push_back('\f'); break;
+          case 'n': s.push_back('\n'); break;
+          case 'r': s.push_back('\r'); break;
+          case 't': s.push_back('\t'); break;
+          case 'u':
+            {
+              unsigned long code_point;
+              if (!parse_hex4(cursor, code_point)) {
+                return false;
+              }
+              // A surrogate pair encodes one code point above U+FFFF. A
+              // surrogate on its own has no UTF-8 encoding.
+              if (code_point >= 0xDC00 && code_point < 0xE000) {
+                return false;
+              } else if (code_point >= 0xD800 && code_point < 0xDC00) {
+                if (cursor.end - cursor.p < 6 || cursor.p[0] != '\\' || cursor.p[1] != 'u') {
+                  return false;
+                }
+                cursor.p += 2;
+                unsigned long low;
+                if (!parse_hex4(cursor, low) || low < 0xDC00 || low >= 0xE000) {
+                  return false;
+                }
+                code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+              }
+              append_utf8(s, code_point);
+            }
+            break;
+          default:
+            return false;
+        }
+      }
+      return false;
     }
 
-    // []...
-    // ["test"]...
-    // ["test","test2"]...
-    // ["test","test2","test3"]...
-
-    if (working_json.at(0) != '[') {
-      return {};
+    // Numbers and literals are kept as the text they were written as.
+    bool parse_scalar(json_cursor& cursor, std::string& s) {
+      cursor.skip_whitespace();
+      const char* begin = cursor.p;
+      while (cursor.p < cursor.end && (isalnum(static_cast<unsigned char>(*cursor.p))
+            || *cursor.p == '-' || *cursor.p == '+' || *cursor.p == '.')) {
+        cursor.p++;
+      }
+      s.assign(begin, cursor.p - begin);
+      return cursor.p > begin;
     }
 
-    working_json.erase(0, 1); // [
-
-    std::list<std::string> list;
-    auto s = parse_json_string(working_json);
-    while (s) {
-      list.push_back(s.value());
+    bool skip_value(json_cursor& cursor, int depth);
 
-      if (working_json.at(0) == ',') {
-        working_json.erase(0, 1);
+    // Calls parse_element for each element between open and close.
+    template<typename F>
+    bool parse_sequence(json_cursor& cursor, char open, char close, F parse_element) {
+      if (!cursor.consume(open)) {
+        return false;
       }
-      s = parse_json_string(working_json);
+      if (cursor.consume(close)) {
+        return true;
+      }
+      do {
+        if (!parse_element()) {
+          return false;
+        }
+      } while (cursor.consume(','));
+      return cursor.consume(close);
     }
 
-    if (working_json.length() == 0) {
-      return {};
-    }
+    bool skip_value(json_cursor& cursor, int depth) {
+      // Deep nesting is not a register request; don't recurse without bound.
+      if (depth > 64) {
+        return false;
+      }
 
-    if (working_json.at(0) != ']') {
-      return {};
+      std::string ignored;
+      if (cursor.peek('"')) {
+        return parse_string(cursor, ignored);
+      } else if (cursor.peek('[')) {
+        return parse_sequence(cursor, '[', ']', [&]() { return skip_value(cursor, depth + 1); });
+      } else if (cursor.peek('{')) {
+        return parse_sequence(cursor, '{', '}', [&]() {
+          return parse_string(cursor, ignored) && cursor.consume(':')
+            && skip_value(cursor, depth + 1);
+        });
+      } else {
+        return parse_scalar(cursor, ignored);
+      }
     }
 
-    working_json.erase(0, 1); // ]
-
-    return list;
-  }
-
-  std::optional<std::pair<std::string,std::list<std::string>>> parse_json_key_object(
-      std::string& working_json) {
-    if (working_json.length() == 0) {
-      return {};
+    bool parse_array_of_strings(json_cursor& cursor, std::list<std::string>& list) {
+      return parse_sequence(cursor, '[', ']', [&]() {
+        list.push_back(std::string());
+        return cursor.peek('"') ? parse_string(cursor, list.back())
+          : parse_scalar(cursor, list.back());
+      });
     }
 
-    auto key = parse_json_string(working_json);
-
-    if (working_json.length() > 0 && working_json.at(0) != ':') {
-      return {};
+    // Keys whose values are not arrays are ignored.
+    bool parse_object_of_arrays_of_strings(json_cursor& cursor,
+        std::unordered_map<std::string, std::list<std::string>>& object) {
+      std::string key;
+      return parse_sequence(cursor, '{', '}', [&]() {
+        if (!parse_string(cursor, key) || !cursor.consume(':')) {
+          return false;
+        }
+        if (!cursor.peek('[')) {
+          return skip_value(cursor, 1);
+        }
+        std::list<std::string> values;
+        if (!parse_array_of_strings(cursor, values)) {
+          return false;
+        }
+        object[key] = std::move(values);
+        return true;
+      });
     }
-    working_json.erase(0, 1);  // :
-
-    auto args = parse_json_array_of_strings(working_json);
 
-    if (key && args) {
-      return std::make_pair(key.value(), args.value());
-    } else {
-      return {};
+    bool parse_array_of_objects(json_cursor& cursor,
+        std::list<std::unordered_map<std::string, std::list<std::string>>>& array) {
+      return parse_sequence(cursor, '[', ']', [&]() {
+        array.push_back(std::unordered_map<std::string, std::list<std::string>>());
+        return parse_object_of_arrays_of_strings(cursor, array.back());
+      });
     }
-  }
-
-  std::optional<std::unordered_map<std::string, std::list<std::string>>>
-    parse_json_object_of_arrays_of_strings(std::string& working_json) {
-      if (working_json.length() == 0) {
-        return {};
-      }
 
-      if (working_json.at(0) != '{') {
+    // Runs parse over working_json and removes what it consumed.
+    template<typename T, typename F>
+    std::optional<T> parse_prefix(std::string& working_json, F parse) {
+      json_cursor cursor = { working_json.data(), working_json.data() + working_json.size() };
+      T value;
+      if (!parse(cursor, value)) {
         return {};
       }
-      working_json.erase(0, 1); // {
-
-      std::unordered_map<std::string, std::list<std::string>> req;
-
-      auto keyObject = parse_json_key_object(working_json);
-
-      while (keyObject) {
-        auto key = std::get<0>(keyObject.value());
-        auto args = std::get<1>(keyObject.value());
-        req[key] = args;
-
-        if (working_json.at(0) == ',') {
-          working_json.erase(0, 1);
-        }
+      working_json.erase(0, cursor.p - working_json.data());
+      return value;
+    }
+  }
 
-        keyObject = parse_json_key_object(working_json);
-      }
+  std::string trim_whitespace(std::string s) {
+    std::string trimmed;
+    trimmed.reserve(s.size());
 
-      if (working_json.length() == 0) {
-        return {};
+    bool in_quote = false;
+    for (auto iter = s.cbegin(); iter != s.cend(); iter++) {
+      if (in_quote || (*iter != ' ' && *iter != '\n' && *iter != '\t')) {
+        trimmed.push_back(*iter);
       }
 
-      if (working_json.at(0) != '}') {
-        return {};
+      if (*iter == '"') {
+        in_quote = !in_quote;
       }
-
-      working_json.erase(0, 1); // }
-
-      return req;
-  }
-
-  std::optional<std::list<std::unordered_map<std::string,std::list<std::string>>>>
-    parse_json_array_of_object_of_arrays_of_strings(std::string& working_json) {
-    if (working_json.length() == 0) {
-      return {};
     }
 
-    if (working_json.at(0) != '[') {
-      return {};
-    }
-
-    working_json.erase(0, 1);  // [
-
-    std::list<std::unordered_map<std::string,std::list<std::string>>> array;
-
-    auto obj = parse_json_object_of_arrays_of_strings(working_json);
-
-    while (obj) {
-      array.push_back(obj.value());
-
-      if (working_json.at(0) == ',') {
-        working_json.erase(0, 1);
-      }
+    return trimmed;
+  }
 
-      obj = parse_json_object_of_arrays_of_strings(working_json);
-    }
+  std::optional<std::string> parse_json_string(std::string& working_json) {
+    return parse_prefix<std::string>(working_json, parse_string);
+  }
 
-    if (working_json.length() == 0) {
-      return {};
-    }
+  std::optional<std::list<std::string>> parse_json_array_of_strings(
+      std::string& working_json) {
+    return parse_prefix<std::list<std::string>>(working_json, parse_array_of_strings);
+  }
 
-    if (working_json.at(0) != ']') {
-      return {};
-    }
+  std::optional<std::pair<std::string,std::list<std::string>>> parse_json_key_object(
+      std::string& working_json) {
+    return parse_prefix<std::pair<std::string, std::list<std::string>>>(working_json,
+        [](json_cursor& cursor, std::pair<std::string, std::list<std::string>>& key_object) {
+          return parse_string(cursor, key_object.first) && cursor.consume(':')
+            && parse_array_of_strings(cursor, key_object.second);
+        });
+  }
 
-    working_json.erase(0, 1); // ]
+  std::optional<std::unordered_map<std::string, std::list<std::string>>>
+    parse_json_object_of_arrays_of_strings(std::string& working_json) {
+    return parse_prefix<std::unordered_map<std::string, std::list<std::string>>>(
+        working_json, parse_object_of_arrays_of_strings);
+  }
 
-    return array;
+  std::optional<std::list<std::unordered_map<std::string,std::list<std::string>>>>
+    parse_json_array_of_object_of_arrays_of_strings(std::string& working_json) {
+    return parse_prefix<std::list<std::unordered_map<std::string, std::list<std::string>>>>(
+        working_json, parse_array_of_objects);
   }
 
+  // One pass over the body. Anything but an array of objects, possibly
+  // followed by whitespace, is rejected with an empty result.
   std::list<std::unordered_map<std::string, std::list<std::string>>>
-    parse_register_request_json(std::string json) {
-    std::string working_json = trim_whitespace(json);
-
-    auto data = parse_json_array_of_object_of_arrays_of_strings(working_json);
+    parse_register_request_json(const std::string& json) {
+    std::list<std::unordered_map<std::string, std::list<std::string>>> array;
+    json_cursor cursor = { json.data(), json.data() + json.size() };
+    if (!parse_array_of_objects(cursor, array)) {
+      array.clear();
+      return array;
+    }
 
-    if (data) {
-      return data.value();
-    } else {
-      std::list<std::unordered_map<std::string, std::list<std::string>>> empty;
-      return empty;
+    cursor.skip_whitespace();
+    if (cursor.p != cursor.end) {
+      array.clear();
     }
+    return array;
   }
 }
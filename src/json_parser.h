@@ -47,5 +47,5 @@ namespace ledger_rest {
   std::optional<std::list<std::unordered_map<std::string,std::list<std::string>>>>
     parse_json_array_of_object_of_arrays_of_strings(std::string&);
   std::list<std::unordered_map<std::string, std::list<std::string>>>
-    parse_register_request_json(std::string json);
+    parse_register_request_json(const std::string& json);
 }
@@ -0,0 +1,205 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "json_writer.h"
+
+namespace ledger_rest {
+  namespace {
+    const char hex_digits[] = "0123456789abcdef";
+
+    // Amounts whose cents are further than this from a half cent are
+    // formatted without printf. The exact rounding of values near a half
+    // cent is left to printf.
+    const double max_fast_fixed2 = 1e13;
+    const double fixed2_tolerance = 1e-4;
+
+    // True if any of the 8 bytes in w is a quote, backslash or below 0x20.
+    inline bool has_escape(std::uint64_t w) {
+      const std::uint64_t ones = 0x0101010101010101ULL;
+      const std::uint64_t highs = 0x8080808080808080ULL;
+      std::uint64_t quote = w ^ (ones * '"');
+      std::uint64_t backslash = w ^ (ones * '\\');
+      return (((quote - ones) & ~quote)
+          | ((backslash - ones) & ~backslash)
+          | ((w - ones * 0x20) & ~w)) & highs;
+    }
+
+    inline bool needs_escape(char c) {
+      return c == '"' || c == '\\' || static_cast<unsigned char>(c) < 0x20;
+    }
+
+    // Writes the digits of value backwards ending at end and returns the
+    // first digit.
+    inline char* format_unsigned(unsigned long long value, char* end) {
+      do {
+        *--end = static_cast<char>('0' + value % 10);
+        value /= 10;
+      } while (value != 0);
+      return end;
+    }
+  }
+
+  json_writer::json_writer() {
+  }
+
+  json_writer::json_writer(std::size_t capacity) {
+    buffer.reserve(capacity);
+  }
+
+  void json_writer::write_raw(char c) {
+    buffer.push_back(c);
+  }
+
+  void json_writer::write_raw(const char* data, std::size_t size) {
+    buffer.append(data, size);
+  }
+
+  void json_writer::write_raw(const std::string& s) {
+    buffer.append(s);
+  }
+
+  void json_writer::write_string(const std::string& s) {
+    buffer.push_back('"');
+    write_escaped(s.data(), s.size());
+    buffer.push_back('"');
+  }
+
+  // Most names need no escaping, so runs are found 8 bytes at a time and
+  // appended whole.
+  void json_writer::write_escaped(const char* data, std::size_t size) {
+    const char* end = data + size;
+    const char* run = data;
+    const char* p = data;
+    while (p < end) {
+      while (end - p >= 8) {
+        std::uint64_t w;
+        std::memcpy(&w, p, sizeof(w));
+        if (has_escape(w)) {
+          break;
+        }
+        p += 8;
+      }
+      while (p < end && !needs_escape(*p)) {
+        p++;
+      }
+      if (p == end) {
+        break;
+      }
+
+      buffer.append(run, p - run);
+      char c = *p++;
+      run = p;
+      buffer.push_back('\\');
+      switch (c) {
+        case '"': buffer.push_back('"'); break;
+        case '\\': buffer.push_back('\\'); break;
+        case '\b': buffer.push_back('b'); break;
+        case '\f': buffer.push_back('f'); break;
+        case '\n': buffer.push_back('n'); break;
+        case '\r': buffer.push_back('r'); break;
+        case '\t': buffer.push_back('t'); break;
+        default:
+          buffer.append("u00", 3);
+          buffer.push_back(hex_digits[(c >> 4) & 0xF]);
+          buffer.push_back(hex_digits[c & 0xF]);
+      }
+    }
+    buffer.append(run, end - run);
+  }
+
+  void json_writer::write_fixed2(double value) {
+    double cents = value * 100;
+    double rounded = std::round(cents);
+    if (std::fabs(value) < max_fast_fixed2
+        && std::fabs(cents - rounded) < fixed2_tolerance) {
+      char digits[24];
+      char* end = digits + sizeof(digits);
+      unsigned long long whole = static_cast<unsigned long long>(std::fabs(rounded));
+      char* p = end;
+      *--p = static_cast<char>('0' + whole % 10);
+      *--p = static_cast<char>('0' + whole / 10 % 10);
+      *--p = '.';
+      p = format_unsigned(whole / 100, p);
+      // printf keeps the sign of negative zero.
+      if (std::signbit(value)) {
+        *--p = '-';
+      }
+      buffer.append(p, end - p);
+      return;
+    }
+
+    char formatted[512];
+    int length = std::snprintf(formatted, sizeof(formatted), "%.2f", value);
+    if (length > 0) {
+      buffer.append(formatted, static_cast<std::size_t>(length) < sizeof(formatted)
+          ? length : sizeof(formatted) - 1);
+    }
+  }
+
+  void json_writer::write_unsigned(unsigned long long value) {
+    char digits[20];
+    char* end = digits + sizeof(digits);
+    char* p = format_unsigned(value, end);
+    buffer.append(p, end - p);
+  }
+
+  void json_writer::write_date(int year, int month, int day) {
+    char date[12] = {
+      '"',
+      static_cast<char>('0' + year / 1000 % 10), static_cast<char>('0' + year / 100 % 10),
+      static_cast<char>('0' + year / 10 % 10), static_cast<char>('0' + year % 10),
+      '-',
+      static_cast<char>('0' + month / 10), static_cast<char>('0' + month % 10),
+      '-',
+      static_cast<char>('0' + day / 10), static_cast<char>('0' + day % 10),
+      '"'
+    };
+    buffer.append(date, sizeof(date));
+  }
+
+  const std::string& json_writer::get_buffer() const {
+    return buffer;
+  }
+
+  std::string json_writer::release() {
+    std::string released;
+    released.swap(buffer);
+    return released;
+  }
+
+  std::size_t json_writer::size() const {
+    return buffer.size();
+  }
+
+  void json_writer::clear() {
+    buffer.clear();
+  }
+}
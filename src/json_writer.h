@@ -0,0 +1,68 @@
+/* * Copyright (c) 2015-2020 Chad Voegele
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *  * The name of Chad Voegele may not be used to endorse or promote products
+ * derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace ledger_rest {
+  // Appends JSON to one growing buffer. Callers place the punctuation; the
+  // writer formats and escapes values.
+  class json_writer {
+    public:
+      json_writer();
+      json_writer(std::size_t capacity);
+      json_writer(const json_writer&) = delete;
+      json_writer& operator=(const json_writer&) = delete;
+      json_writer (json_writer&&) = delete;
+      json_writer& operator=(const json_writer&&) = delete;
+      virtual ~json_writer() { }
+
+      void write_raw(char c);
+      void write_raw(const char* data, std::size_t size);
+      void write_raw(const std::string& s);
+      // A quoted string with quotes, backslashes and control characters
+      // escaped.
+      void write_string(const std::string& s);
+      // The same text as printf("%.2f").
+      void write_fixed2(double value);
+      void write_unsigned(unsigned long long value);
+      // A quoted YYYY-MM-DD date.
+      void write_date(int year, int month, int day);
+
+      const std::string& get_buffer() const;
+      std::string release();
+      std::size_t size() const;
+      void clear();
+
+    private:
+      std::string buffer;
+
+      void write_escaped(const char* data, std::size_t size);
+  };
+}
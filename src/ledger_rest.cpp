@@ -25,20 +25,93 @@
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //
 
+#include <algorithm>
+#include <map>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include <sstream>
 #include <stdexcept>
 #include <fstream>
+#include <iterator>
+#include <iomanip>
+#include <cmath>
 
 #include "ledger_rest.h"
+#include "file_reader.h"
+#include "snapshot_file.h"
 #include "uri_parser.h"
 #include "json_parser.h"
 
 namespace ledger_rest {
   typedef ledger_rest::post_result post_result;
 
-  ledger_rest::ledger_rest(ledger_rest_args& args, logger& logger)
-    : ledger_file(args.get_ledger_file_path()), lr_logger(logger), is_file_loaded(false), http_prefix(args.get_ledger_rest_prefix()) {
+  namespace {
+    // Passes writes through and keeps a copy until it grows past limit.
+    class caching_body_writer : public http::body_writer {
+      public:
+        caching_body_writer(http::body_writer& writer, std::size_t limit)
+          : writer(writer), limit(limit), is_over_limit(false) { }
+
+        virtual void write(const char* data, std::size_t size) {
+          writer.write(data, size);
+          if (!is_over_limit && body.size() + size <= limit) {
+            body.append(data, size);
+          } else if (!is_over_limit) {
+            is_over_limit = true;
+            std::string().swap(body);
+          }
+        }
+        using http::body_writer::write;
+
+        bool is_complete() const {
+          return !is_over_limit;
+        }
+
+        std::string body;
+
+      private:
+        http::body_writer& writer;
+        const std::size_t limit;
+        bool is_over_limit;
+    };
+
+    // The amount in posting_table::amount_scale units, from ledger's exact
+    // rational. Returns false if that is not a whole number or does not fit.
+    bool get_scaled_amount(const ledger::amount_t& amount, int64_t& scaled) {
+      ledger::amount_t units(amount.number());
+      units *= ledger::amount_t(static_cast<long>(posting_table::amount_scale));
+      if (!units.fits_in_long()) {
+        return false;
+      }
+      long whole = units.to_long();
+      if (ledger::amount_t(whole) != units) {
+        return false;
+      }
+      scaled = whole;
+      return true;
+    }
+  }
+
+  ledger_rest::ledger_rest(ledger_rest_args& args, logger& logger, thread_pool* pool)
+    : ledger_file(args.get_ledger_file_path()), lr_logger(logger), is_file_loaded(false),
+      shared_ledger_mutex(std::make_shared<std::recursive_mutex>()),
+      ledger_mutex(*shared_ledger_mutex), generation(0), journal_revision(0),
+      http_prefix(args.get_ledger_rest_prefix()),
+      snapshot_path(args.get_snapshot_path()),
+      compression_level(args.get_compression_level()),
+      compression_min_size(args.get_compression_min_size()),
+      cache(static_cast<std::size_t>(args.get_cache_size()) << 20),
+      batcher(static_cast<unsigned int>(args.get_batch_window())), pool(pool),
+      register_chunk_rows(32 * 1024),
+      spool_memory_limit(std::max<std::size_t>(cache.get_capacity(), 1 << 20)),
+      is_snapshot_file_writing(false) {
+  }
+
+  // A snapshot file write on the pool uses this object.
+  ledger_rest::~ledger_rest() {
+    std::unique_lock<std::mutex> lock(snapshot_file_mutex);
+    snapshot_file_written.wait(lock, [this]() { return !is_snapshot_file_writing; });
   }
 
   template<typename T>
@@ -61,28 +134,65 @@ namespace ledger_rest {
 
   std::list<post_result> ledger_rest::run_register(
       std::list<std::string> args, std::list<std::string> query) {
+    std::shared_ptr<const journal_snapshot> current(get_loaded_snapshot());
+    if (!current || !current->session) {
+      return std::list<post_result>();
+    }
+    return run_register(*current, args, query);
+  }
+
+  std::list<post_result> ledger_rest::run_register(const journal_snapshot& snapshot,
+      std::list<std::string> args, std::list<std::string> query) {
     try {
-      return run_register_or_throw(args, query);
+      return run_register_or_throw(snapshot, args, query);
+
+    } catch (...) {
+      log_register_error(args, query);
+    }
+
+    std::list<post_result> empty;
+    return empty;
+  }
+
+  // Logs the exception being handled with the request that raised it.
+  void ledger_rest::log_register_error(const std::list<std::string>& args,
+      const std::list<std::string>& query) {
+    try {
+      throw;
 
     } catch (const std::exception& e) {
       lr_logger.log(5, e.what());
-      lr_logger.log(5, to_string(args));
-      lr_logger.log(5, to_string(query));
 
     } catch (...) {
       lr_logger.log(5, "Unknown error while respond to request:");
-      lr_logger.log(5, to_string(args));
-      lr_logger.log(5, to_string(query));
     }
-
-    std::list<post_result> empty;
-    return empty;
+    lr_logger.log(5, to_string(args));
+    lr_logger.log(5, to_string(query));
   }
 
-  std::list<post_result> ledger_rest::run_register_or_throw(
+  // Requests the native engine supports are answered from the posting table;
+  // everything else goes through ledger's report pipeline.
+  std::list<post_result> ledger_rest::run_register_or_throw(const journal_snapshot& snapshot,
       std::list<std::string> args, std::list<std::string> query) {
-    ledger::report_t report(*session_ptr);
-    ledger::scope_t::default_scope = &report;
+    std::list<post_result> native_results;
+    if (run_native_register(snapshot, args, query, native_results)) {
+      return native_results;
+    }
+
+    post_capturer* capturer = new post_capturer();
+    boost::shared_ptr<ledger::item_handler<ledger::post_t> > post_capturer_ptr(capturer);
+    run_register_or_throw(snapshot, args, query, post_capturer_ptr);
+
+    std::list<post_result> results(capturer->get_post_results());
+    return results;
+  }
+
+  void ledger_rest::run_register_or_throw(const journal_snapshot& snapshot,
+      std::list<std::string> args, std::list<std::string> query,
+      ledger::post_handler_ptr handler) {
+    std::lock_guard<std::recursive_mutex> lock(ledger_mutex);
+    ledger::report_t report(*snapshot.session);
+    default_scope_guard scope_guard(&report);
 
     args = ledger::process_arguments(args, report);
     report.normalize_options("register");
@@ -94,95 +204,725 @@ namespace ledger_rest {
     if (query_args.size() > 0)
       report.parse_query_args(query_args.value(), "#r");
 
-    post_capturer* capturer = new post_capturer();
-    boost::shared_ptr<ledger::item_handler<ledger::post_t> > post_capturer_ptr(capturer);
-    report.posts_report(post_capturer_ptr);
+    report.posts_report(handler);
+  }
 
-    std::list<post_result> results(capturer->get_post_results());
-    return results;
+  // Produces the same JSON as to_json(run_register(...)) without a
+  // post_result per post. Ledger renders the register into a spool while
+  // ledger_mutex is held and it is only sent once the lock is released, so a
+  // slow client does not hold up other requests or reloads.
+  // Identical requests wait for the first to be rendered, not sent, and each
+  // sends that to its own client.
+  void ledger_rest::write_register_json(const journal_snapshot& snapshot,
+      const std::string& key, const std::list<std::string>& args,
+      const std::list<std::string>& query, content_encoding encoding,
+      http::body_writer& writer) {
+    std::shared_ptr<const rendered_register> rendered(renders.run(snapshot.generation, key,
+        [&]() {
+          std::shared_ptr<rendered_register> render(std::make_shared<rendered_register>());
+          render->spool.reset(new body_spool(spool_memory_limit));
+          if (!render_register_json(snapshot, args, query, *render->spool)) {
+            render->body = std::make_shared<const std::string>("[]");
+            render->spool.reset();
+            render->is_failed = true;
+          } else if (!render->spool->is_spilled()) {
+            render->body = std::make_shared<const std::string>(render->spool->release());
+            render->spool.reset();
+            cache.put(snapshot.generation, key, render->body);
+          } else {
+            lr_logger.log(7, "Register of " + std::to_string(render->spool->size())
+                + " bytes was rendered to a temporary file.");
+          }
+          return std::shared_ptr<const rendered_register>(render);
+        }));
+
+    // A failed register is answered as empty but is not cached, compressed
+    // or not, so that it is tried again.
+    send_register_json(snapshot.generation, rendered->is_failed ? std::string() : key, encoding,
+        [&rendered](http::body_writer& body_writer) {
+          if (rendered->body) {
+            body_writer.write(*rendered->body);
+          } else {
+            rendered->spool->write_to(body_writer);
+          }
+        }, writer);
   }
 
-  std::string ledger_rest::to_json(post_result posts) {
-    std::stringstream ss;
-    ss << setiosflags(std::ios_base::fixed);
-    ss << std::setprecision(2);
-    ss << "{";
-    ss << "\"amount\" : ";
-    ss << posts.amount;
-    ss << ", ";
-    ss << "\"total\" : ";
-    ss << posts.total;
-    ss << ", ";
-    ss << "\"date\" : ";
-    ss << "\"" << boost::gregorian::to_iso_extended_string(posts.date) << "\"";
-    ss << ", ";
-    ss << "\"payee\" : ";
-    ss << "\"" << posts.payee << "\"";
-    ss << ", ";
-    ss << "\"account_name\" : ";
-    ss << "\"" << posts.account_name << "\"";
-    ss << "}";
-
-    std::string json = ss.str();
-    return json;
+  // Must not be called with ledger_mutex held by the caller; it is taken
+  // only while ledger runs the report. Returns false if ledger failed, which
+  // is logged, and then what was written is not a whole register.
+  bool ledger_rest::render_register_json(const journal_snapshot& snapshot,
+      const std::list<std::string>& args, const std::list<std::string>& query,
+      http::body_writer& writer) {
+    try {
+      writer.write("[");
+      post_writer* posts = new post_writer(writer, snapshot.names.get(), journal_revision);
+      ledger::post_handler_ptr posts_ptr(posts);
+      run_register_or_throw(snapshot, args, query, posts_ptr);
+      posts->flush();
+      writer.write("]");
+      return true;
+
+    } catch (...) {
+      log_register_error(args, query);
+    }
+    return false;
   }
 
-  template<typename T>
-  std::string ledger_rest::to_json(std::list<T> x, std::function<std::string(T)> to_json) {
-    std::stringstream ss;
+  // Compresses what producer writes if the client accepts it. The
+  // compressed body is cached while it is small enough to be cached.
+  void ledger_rest::send_register_json(unsigned long long generation, const std::string& key,
+      content_encoding encoding, const http::body_producer& producer,
+      http::body_writer& writer) {
+    if (encoding == content_encoding::IDENTITY) {
+      producer(writer);
+      return;
+    }
 
-    ss << "[";
-    typename std::list<T>::const_iterator iter;
-    for (iter = x.cbegin(); iter != x.end(); iter++) {
-      if (iter == x.cbegin()) {
-        ss << to_json(*iter);
-      } else {
-        ss << ", ";
-        ss << to_json(*iter);
+    caching_body_writer caching_writer(writer, cache.get_capacity());
+    compressing_body_writer compressor(caching_writer, encoding, compression_level);
+    producer(compressor);
+    compressor.finish();
+    if (caching_writer.is_complete() && key.size() > 0) {
+      cache.put(generation, get_encoded_key(key, encoding),
+          std::make_shared<const std::string>(std::move(caching_writer.body)));
+    }
+  }
+
+  // Results only change with the journal so they are cached per snapshot
+  // generation.
+  std::shared_ptr<const std::string> ledger_rest::get_ledger_register_json(
+      const journal_snapshot& snapshot, const std::string& key,
+      const std::list<std::string>& args, const std::list<std::string>& query) {
+    std::shared_ptr<const std::string> json(cache.get(snapshot.generation, key));
+    if (json) {
+      return json;
+    }
+
+    auto compute = [&]() {
+      std::string rendered;
+      bool is_rendered = run_register_json(snapshot, args, query, rendered);
+      std::shared_ptr<const std::string> computed(
+          std::make_shared<const std::string>(std::move(rendered)));
+      // A failed register is answered as empty but not cached so that it is
+      // tried again.
+      if (is_rendered) {
+        cache.put(snapshot.generation, key, computed);
+      }
+      return computed;
+    };
+    // The native engine's flight for the key is null for every caller when
+    // ledger must answer it.
+    json = flights.run(snapshot.generation, key, compute);
+    return json ? json : compute();
+  }
+
+  // Streams a batch of registers in request order. Identical requests are
+  // answered once. Native requests with the same date range are split into
+  // one slice per thread and each slice is answered together so that it
+  // shares matching names and reading the postings. Each request for ledger
+  // is its own task so that while one waits on ledger other threads go on to
+  // the native tasks after it. Each register is written once it and every
+  // one before it are done.
+  void ledger_rest::write_register_batch_json(const journal_snapshot& snapshot,
+      const std::vector<register_batch_item>& items, content_encoding encoding,
+      http::body_writer& writer) {
+    std::vector<std::shared_ptr<const std::string>> jsons(items.size());
+    // The first item with the same key as each item.
+    std::vector<std::size_t> firsts(items.size());
+    std::unordered_map<std::string, std::size_t> first_by_key;
+    std::vector<posting_query> parsed(items.size());
+    std::vector<bool> is_native(items.size(), false);
+    std::map<std::vector<int32_t>, std::vector<std::size_t>> native_by_range;
+    for (std::size_t i = 0; i < items.size(); i++) {
+      firsts[i] = first_by_key.insert(std::make_pair(items[i].key, i)).first->second;
+      if (firsts[i] != i) {
+        continue;
+      }
+
+      jsons[i] = cache.get(snapshot.generation, items[i].key);
+      if (jsons[i]) {
+        continue;
+      }
+      is_native[i] = is_native_register(snapshot, items[i].args, items[i].query, parsed[i]);
+      if (is_native[i]) {
+        const posting_query& q(parsed[i]);
+        native_by_range[{ q.has_begin, q.begin, q.has_end, q.end }].push_back(i);
       }
     }
-    ss << "]";
 
-    std::string json = ss.str();
-    return json;
+    // Ordered by their first item, so that once a task and every task
+    // before it are done every item before the next task's first is too.
+    std::vector<std::vector<std::size_t>> tasks;
+    std::size_t threads = pool ? pool->size() + 1 : 1;
+    for (std::size_t i = 0; i < items.size(); i++) {
+      if (firsts[i] == i && !jsons[i] && !is_native[i]) {
+        tasks.push_back({ i });
+      }
+    }
+    for (const auto& range : native_by_range) {
+      const std::vector<std::size_t>& range_items(range.second);
+      std::size_t slice = (range_items.size() + threads - 1) / threads;
+      for (std::size_t begin = 0; begin < range_items.size(); begin += slice) {
+        tasks.push_back(std::vector<std::size_t>(range_items.cbegin() + begin,
+              range_items.cbegin() + std::min(range_items.size(), begin + slice)));
+      }
+    }
+    std::sort(tasks.begin(), tasks.end(),
+        [](const std::vector<std::size_t>& a, const std::vector<std::size_t>& b) {
+          return a.front() < b.front();
+        });
+
+    auto run_task = [&](std::size_t t) {
+      const std::vector<std::size_t>& task(tasks[t]);
+      if (is_native[task.front()]) {
+        std::vector<std::string> keys;
+        std::vector<const posting_query*> queries;
+        for (std::size_t i : task) {
+          keys.push_back(items[i].key);
+          queries.push_back(&parsed[i]);
+        }
+        // Ledger answers them instead if the native engine fails.
+        try {
+          std::vector<std::shared_ptr<const std::string>> bodies(
+              answer_native_registers(snapshot, keys, queries));
+          for (std::size_t q = 0; q < task.size(); q++) {
+            jsons[task[q]] = bodies[q];
+          }
+
+        } catch (const std::exception& e) {
+          lr_logger.log(5, std::string("Error while answering native registers: ") + e.what());
+
+        } catch (...) {
+          lr_logger.log(5, "Unknown error while answering native registers.");
+        }
+      }
+
+      // An item that fails is sent as an empty register, which is not
+      // cached, rather than ending the whole batch.
+      for (std::size_t i : task) {
+        if (!jsons[i]) {
+          try {
+            jsons[i] = get_ledger_register_json(snapshot, items[i].key, items[i].args,
+                items[i].query);
+
+          } catch (...) {
+            log_register_error(items[i].args, items[i].query);
+            jsons[i] = std::make_shared<const std::string>("[]");
+          }
+        }
+      }
+    };
+
+    std::unique_ptr<compressing_body_writer> compressor;
+    http::body_writer* batch_writer = &writer;
+    if (encoding != content_encoding::IDENTITY) {
+      compressor.reset(new compressing_body_writer(writer, encoding, compression_level));
+      batch_writer = compressor.get();
+    }
+
+    std::size_t written = 0;
+    auto write_items = [&](std::size_t end) {
+      for (; written < end; written++) {
+        if (written > 0) {
+          batch_writer->write(", ");
+        }
+        batch_writer->write(*jsons[firsts[written]]);
+      }
+    };
+
+    batch_writer->write("[");
+    write_items(tasks.empty() ? items.size() : tasks.front().front());
+    auto write_task = [&](std::size_t t) {
+      write_items(t + 1 < tasks.size() ? tasks[t + 1].front() : items.size());
+    };
+    if (pool) {
+      pool->parallel_for(tasks.size(), run_task, write_task);
+    } else {
+      for (std::size_t t = 0; t < tasks.size(); t++) {
+        run_task(t);
+        write_task(t);
+      }
+    }
+    batch_writer->write("]");
+    if (compressor) {
+      compressor->finish();
+    }
   }
 
-  std::string ledger_rest::to_json(std::list<post_result> posts) {
-    std::string (*to_json_ptr)(post_result) = to_json;
-    std::function<std::string(post_result)> to_json_fn = to_json_ptr;
+  // Like to_json(run_register(...)) but without a post_result per post.
+  // Errors are thrown so that they are not cached as an empty register.
+  // json is [] if ledger failed.
+  bool ledger_rest::run_register_json(const journal_snapshot& snapshot,
+      const std::list<std::string>& args, const std::list<std::string>& query,
+      std::string& json) {
+    http::string_body_writer rendered;
+    if (!render_register_json(snapshot, args, query, rendered)) {
+      json = "[]";
+      return false;
+    }
+    json = std::move(rendered.body);
+    return true;
+  }
 
-    std::string json(to_json(posts, to_json_fn));
-    return json;
+  // The query classifier. True if args and query only use what the native
+  // engine supports: account and payee terms with and, or and not, a begin
+  // and end date, and --period, --collapse and --empty. Totals are running
+  // totals as ledger's register has.
+  bool ledger_rest::is_native_register(const journal_snapshot& snapshot,
+      const std::list<std::string>& args, const std::list<std::string>& query,
+      posting_query& parsed) {
+    return snapshot.postings && snapshot.names && parse_posting_query(args, query, parsed);
   }
 
-  std::string ledger_rest::to_json(std::list<std::string> accounts) {
-    std::function<std::string(std::string)> to_json_fn
-      = [](std::string s) { return std::string("\"") + s + std::string("\""); };
+  // Returns false if ledger must answer the request.
+  bool ledger_rest::run_native_register(const journal_snapshot& snapshot,
+      const std::list<std::string>& args, const std::list<std::string>& query,
+      std::list<post_result>& results) {
+    posting_query parsed;
+    std::vector<uint32_t> rows;
+    if (!is_native_register(snapshot, args, query, parsed)
+        || !find_postings(*snapshot.postings, parsed, rows, snapshot.indexes.get())) {
+      return false;
+    }
+
+    posting_table summary;
+    if (parsed.is_summarized() && !summarize_native_register(snapshot, parsed, rows, summary)) {
+      return false;
+    }
+
+    const posting_table& postings(parsed.is_summarized() ? summary : *snapshot.postings);
+    std::vector<std::list<post_result>> chunk_results(get_register_chunk_count(rows.size()));
+    run_register_chunks(postings, rows,
+        [&](std::size_t chunk, std::size_t begin, std::size_t end, int64_t total) {
+          std::list<post_result>& chunk_result(chunk_results[chunk]);
+          for (std::size_t i = begin; i < end; i++) {
+            uint32_t row = rows[i];
+            total += postings.amounts[row];
+            post_result r;
+            r.amount = static_cast<double>(postings.amounts[row]) / posting_table::amount_scale;
+            r.total = static_cast<double>(total) / posting_table::amount_scale;
+            r.date = from_day_number(postings.dates[row]);
+            r.account_name = postings.account_names[postings.account_ids[row]];
+            r.payee = postings.payee_names[postings.payee_ids[row]];
+            chunk_result.push_back(r);
+          }
+        });
+
+    results.clear();
+    for (std::list<post_result>& chunk_result : chunk_results) {
+      results.splice(results.end(), chunk_result);
+    }
+    return true;
+  }
+
+  std::size_t ledger_rest::get_register_chunk_count(std::size_t rows) const {
+    return std::max<std::size_t>(1, (rows + register_chunk_rows - 1) / register_chunk_rows);
+  }
+
+  // Calls body for each chunk of rows with the running total before the
+  // chunk's first row. Chunk totals are summed first and their exclusive
+  // prefix sum gives each chunk its starting total, so the chunks can then
+  // be run in any order.
+  void ledger_rest::run_register_chunks(const posting_table& postings,
+      const std::vector<uint32_t>& rows,
+      std::function<void(std::size_t chunk, std::size_t begin, std::size_t end,
+        int64_t total)> body) {
+    std::size_t chunk_count = get_register_chunk_count(rows.size());
+    if (chunk_count == 1 || !pool) {
+      body(0, 0, rows.size(), 0);
+      for (std::size_t chunk = 1; chunk < chunk_count; chunk++) {
+        body(chunk, rows.size(), rows.size(), 0);
+      }
+      return;
+    }
+
+    std::vector<int64_t> chunk_totals(chunk_count);
+    pool->parallel_for(chunk_count, [&](std::size_t chunk) {
+      std::size_t end = std::min(rows.size(), (chunk + 1) * register_chunk_rows);
+      int64_t total = 0;
+      for (std::size_t i = chunk * register_chunk_rows; i < end; i++) {
+        total += postings.amounts[rows[i]];
+      }
+      chunk_totals[chunk] = total;
+    });
+
+    int64_t total = 0;
+    for (int64_t& chunk_total : chunk_totals) {
+      int64_t next = total + chunk_total;
+      chunk_total = total;
+      total = next;
+    }
+
+    pool->parallel_for(chunk_count, [&](std::size_t chunk) {
+      std::size_t begin = chunk * register_chunk_rows;
+      body(chunk, begin, std::min(rows.size(), begin + register_chunk_rows), chunk_totals[chunk]);
+    });
+  }
+
+  // Like run_native_register but straight to JSON, which also works before
+  // the journal has been parsed. Returns null if ledger must answer the
+  // request.
+  std::shared_ptr<const std::string> ledger_rest::get_native_register_json(
+      const journal_snapshot& snapshot, const std::string& key,
+      const std::list<std::string>& args, const std::list<std::string>& query) {
+    posting_query parsed;
+    if (!is_native_register(snapshot, args, query, parsed)) {
+      return std::shared_ptr<const std::string>();
+    }
+
+    std::shared_ptr<const std::string> json(cache.get(snapshot.generation, key));
+    if (json) {
+      return json;
+    }
+
+    // Null for every caller if ledger must answer the request.
+    return flights.run(snapshot.generation, key, [&]() {
+      return batcher.run(snapshot.generation, key, parsed,
+          [this, &snapshot](const std::vector<std::string>& keys,
+            const std::vector<const posting_query*>& queries) {
+            return answer_native_registers(snapshot, keys, queries);
+          });
+    });
+  }
 
-    std::string json(to_json(accounts, to_json_fn));
+  // Answers queries with the same date range together and caches their
+  // bodies by keys. A body is null if ledger must answer that query.
+  std::vector<std::shared_ptr<const std::string>> ledger_rest::answer_native_registers(
+      const journal_snapshot& snapshot, const std::vector<std::string>& keys,
+      const std::vector<const posting_query*>& queries) {
+    std::vector<std::vector<uint32_t>> rows;
+    std::vector<bool> found;
+    find_postings(*snapshot.postings, queries, rows, found, snapshot.indexes.get());
+
+    std::vector<std::shared_ptr<const std::string>> bodies(queries.size());
+    for (std::size_t q = 0; q < queries.size(); q++) {
+      if (found[q]) {
+        bodies[q] = build_native_register_body(snapshot, *queries[q], rows[q]);
+      }
+      if (bodies[q]) {
+        cache.put(snapshot.generation, keys[q], bodies[q]);
+      }
+    }
+    return bodies;
+  }
+
+  // Replaces rows with the lines of summary that --period and --collapse
+  // make of them. Returns false if ledger must answer the query.
+  bool ledger_rest::summarize_native_register(const journal_snapshot& snapshot,
+      const posting_query& parsed, std::vector<uint32_t>& rows, posting_table& summary) {
+    if (!summarize_postings(*snapshot.postings, parsed, rows, summary)) {
+      return false;
+    }
+    rows.resize(summary.dates.size());
+    for (std::size_t i = 0; i < rows.size(); i++) {
+      rows[i] = static_cast<uint32_t>(i);
+    }
+    return true;
+  }
+
+  // The register body of the rows find_postings found. Null if ledger must
+  // answer the query.
+  std::shared_ptr<const std::string> ledger_rest::build_native_register_body(
+      const journal_snapshot& snapshot, const posting_query& parsed,
+      std::vector<uint32_t>& rows) {
+    if (!parsed.is_summarized()) {
+      return std::make_shared<const std::string>(
+          build_native_register_json(*snapshot.postings, *snapshot.names, rows));
+    }
+
+    posting_table summary;
+    if (!summarize_native_register(snapshot, parsed, rows, summary)) {
+      return std::shared_ptr<const std::string>();
+    }
+    // The summary's names are its own, in the order of its ids.
+    journal_names names;
+    for (const std::string& account : summary.account_names) {
+      names.accounts.intern(account);
+    }
+    for (const std::string& payee : summary.payee_names) {
+      names.payees.intern(payee);
+    }
+    return std::make_shared<const std::string>(
+        build_native_register_json(summary, names, rows));
+  }
+
+  std::string ledger_rest::build_native_register_json(const posting_table& postings,
+      const journal_names& names, const std::vector<uint32_t>& rows) {
+    std::vector<std::string> chunk_json(get_register_chunk_count(rows.size()));
+    run_register_chunks(postings, rows,
+        [&](std::size_t chunk, std::size_t begin, std::size_t end, int64_t total) {
+          json_writer writer((end - begin) * 128);
+          for (std::size_t i = begin; i < end; i++) {
+            uint32_t row = rows[i];
+            total += postings.amounts[row];
+            if (i > 0) {
+              writer.write_raw(", ", 2);
+            }
+            write_post_json(writer,
+                static_cast<double>(postings.amounts[row]) / posting_table::amount_scale,
+                static_cast<double>(total) / posting_table::amount_scale,
+                from_day_number(postings.dates[row]),
+                names.payees.get_json(postings.payee_ids[row]),
+                names.accounts.get_json(postings.account_ids[row]));
+          }
+          chunk_json[chunk] = writer.release();
+        });
+
+    std::size_t size = 2;
+    for (const std::string& s : chunk_json) {
+      size += s.size();
+    }
+    json_writer writer(size);
+    writer.write_raw('[');
+    for (const std::string& s : chunk_json) {
+      writer.write_raw(s);
+    }
+    writer.write_raw(']');
+    return writer.release();
+  }
+
+  std::shared_ptr<const std::string> ledger_rest::get_accounts_json(
+      const journal_snapshot& snapshot, const std::string& key) {
+    std::shared_ptr<const std::string> json(cache.get(snapshot.generation, key));
+    if (!json) {
+      json = std::make_shared<const std::string>(to_json(snapshot.accounts));
+      cache.put(snapshot.generation, key, json);
+    }
     return json;
   }
 
+  // Every string is prefixed by its length so that different argument lists
+  // cannot produce the same key.
+  std::string ledger_rest::get_cache_key(const std::string& endpoint,
+      const std::list<std::list<std::string>>& parts) {
+    std::string key(endpoint);
+    for (const std::list<std::string>& part : parts) {
+      key += ';' + std::to_string(part.size());
+      for (const std::string& s : part) {
+        key += ',' + std::to_string(s.size()) + ':' + s;
+      }
+    }
+    return key;
+  }
+
+  // A strong ETag for the response to the request with key on the journal
+  // the snapshot was made from, and when that journal last changed.
+  std::map<std::string, std::string> ledger_rest::get_validators(
+      const journal_snapshot& snapshot, const std::string& key) {
+    std::string tag(std::to_string(snapshot.content_hash) + ';' + key);
+    std::stringstream etag;
+    etag << '"' << std::hex << std::setw(16) << std::setfill('0')
+      << hash_bytes(tag.data(), tag.size()) << '"';
+
+    std::map<std::string, std::string> validators;
+    validators["ETag"] = etag.str();
+    if (snapshot.last_modified != 0) {
+      validators["Last-Modified"] = http::format_http_date(snapshot.last_modified);
+    }
+    return validators;
+  }
+
+  // The encoding of the body a request with key would get, whose ETag is
+  // the one to validate: identity rather than the negotiated encoding if the
+  // cached body is too small to be compressed.
+  content_encoding ledger_rest::get_response_encoding(const journal_snapshot& snapshot,
+      const std::string& key, content_encoding encoding) {
+    if (encoding != content_encoding::IDENTITY) {
+      std::shared_ptr<const std::string> body(cache.get(snapshot.generation, key));
+      if (body && body->size() < compression_min_size) {
+        return content_encoding::IDENTITY;
+      }
+    }
+    return encoding;
+  }
+
+  // If-Modified-Since is only used when there is no If-None-Match. Only the
+  // ETag of the encoding the response would have matches.
+  bool ledger_rest::is_not_modified(const http::request& request,
+      const std::map<std::string, std::string>& validators,
+      const journal_snapshot& snapshot, content_encoding encoding) {
+    std::string if_none_match(request.get_header("If-None-Match"));
+    if (if_none_match.size() > 0) {
+      const std::string& etag = validators.at("ETag");
+      return http::etag_matches(if_none_match, encoding == content_encoding::IDENTITY
+          ? etag : get_encoded_etag(etag, encoding));
+    }
+
+    std::string if_modified_since(request.get_header("If-Modified-Since"));
+    std::time_t since;
+    return if_modified_since.size() > 0 && snapshot.last_modified != 0
+      && http::parse_http_date(if_modified_since, since)
+      && snapshot.last_modified <= since;
+  }
+
+  http::response ledger_rest::build_not_modified(
+      std::map<std::string, std::string> validators, content_encoding encoding) {
+    if (encoding != content_encoding::IDENTITY) {
+      validators["ETag"] = get_encoded_etag(validators["ETag"], encoding);
+    }
+    http::response res(http::status_code::NOT_MODIFIED, std::string(""), validators);
+    res.headers["Vary"] = "Accept-Encoding";
+    return res;
+  }
+
+  // Compresses a buffered body if the client accepts it and it is large
+  // enough to be worth it. Compressed forms of cached bodies are cached too.
+  void ledger_rest::encode_response(http::response& response, content_encoding encoding,
+      unsigned long long generation, const std::string& key) {
+    response.headers["Vary"] = "Accept-Encoding";
+    if (encoding == content_encoding::IDENTITY || response.body->size() < compression_min_size) {
+      return;
+    }
+
+    std::string encoded_key(get_encoded_key(key, encoding));
+    std::shared_ptr<const std::string> encoded;
+    if (key.size() > 0) {
+      encoded = cache.get(generation, encoded_key);
+    }
+    if (!encoded) {
+      encoded = std::make_shared<const std::string>(
+          compress(*response.body, encoding, compression_level));
+      if (key.size() > 0) {
+        cache.put(generation, encoded_key, encoded);
+      }
+    }
+
+    response.body = encoded;
+    set_encoding_headers(response, encoding);
+  }
+
+  // Each encoding is a different representation so it needs its own strong
+  // ETag.
+  void ledger_rest::set_encoding_headers(http::response& response, content_encoding encoding) {
+    response.headers["Content-Encoding"] = get_encoding_name(encoding);
+    response.headers["Vary"] = "Accept-Encoding";
+    auto etag = response.headers.find("ETag");
+    if (etag != response.headers.end()) {
+      etag->second = get_encoded_etag(etag->second, encoding);
+    }
+  }
+
+  std::string ledger_rest::get_encoded_key(const std::string& key, content_encoding encoding) {
+    return key + ";encoding=" + get_encoding_name(encoding);
+  }
+
+  std::string ledger_rest::get_encoded_etag(const std::string& etag, content_encoding encoding) {
+    return etag.substr(0, etag.size() - 1) + '-' + get_encoding_name(encoding) + '"';
+  }
+
+  // Amounts are written with two decimals and dates as ISO 8601.
+  void ledger_rest::write_json(json_writer& writer, const post_result& post) {
+    write_post_json(writer, post.amount, post.total, post.date,
+        to_json_string(post.payee), to_json_string(post.account_name));
+  }
+
+  void ledger_rest::write_post_json(json_writer& writer, double amount, double total,
+      const boost::gregorian::date& date, const std::string& payee_json,
+      const std::string& account_json) {
+    writer.write_raw("{\"amount\" : ", 13);
+    writer.write_fixed2(amount);
+    writer.write_raw(", \"total\" : ", 12);
+    writer.write_fixed2(total);
+    writer.write_raw(", \"date\" : ", 11);
+    if (date.is_special()) {
+      writer.write_string(boost::gregorian::to_iso_extended_string(date));
+    } else {
+      boost::gregorian::date::ymd_type ymd(date.year_month_day());
+      writer.write_date(ymd.year, ymd.month, ymd.day);
+    }
+    writer.write_raw(", \"payee\" : ", 12);
+    writer.write_raw(payee_json);
+    writer.write_raw(", \"account_name\" : ", 19);
+    writer.write_raw(account_json);
+    writer.write_raw('}');
+  }
+
+  std::string ledger_rest::to_json_string(const std::string& s) {
+    json_writer writer(s.size() + 2);
+    writer.write_string(s);
+    return writer.release();
+  }
+
+  void ledger_rest::write_json(json_writer& writer, const std::list<post_result>& posts) {
+    writer.write_raw('[');
+    for (auto iter = posts.cbegin(); iter != posts.cend(); iter++) {
+      if (iter != posts.cbegin()) {
+        writer.write_raw(", ", 2);
+      }
+      write_json(writer, *iter);
+    }
+    writer.write_raw(']');
+  }
+
+  std::string ledger_rest::to_json(post_result posts) {
+    json_writer writer(256);
+    write_json(writer, posts);
+    return writer.release();
+  }
+
+  std::string ledger_rest::to_json(std::list<post_result> posts) {
+    json_writer writer(posts.size() * 128 + 2);
+    write_json(writer, posts);
+    return writer.release();
+  }
+
+  std::string ledger_rest::to_json(std::list<std::string> accounts) {
+    json_writer writer(accounts.size() * 32 + 2);
+    writer.write_raw('[');
+    for (auto iter = accounts.cbegin(); iter != accounts.cend(); iter++) {
+      if (iter != accounts.cbegin()) {
+        writer.write_raw(", ", 2);
+      }
+      writer.write_string(*iter);
+    }
+    writer.write_raw(']');
+    return writer.release();
+  }
+
   std::string ledger_rest::to_json(std::list<std::list<post_result>> results) {
-    std::list<std::string> intermediate_json;
+    json_writer writer;
+    writer.write_raw('[');
     for (auto iter = results.cbegin(); iter != results.cend(); iter++) {
-      intermediate_json.push_back(to_json(*iter));
+      if (iter != results.cbegin()) {
+        writer.write_raw(", ", 2);
+      }
+      write_json(writer, *iter);
     }
-    std::function<std::string(std::string)> to_json_fn
-      = [](std::string s) { return s; };
+    writer.write_raw(']');
+    return writer.release();
+  }
 
-    std::string json(to_json(intermediate_json, to_json_fn));
-    return json;
+  std::string ledger_rest::to_json(const response_cache::stats& stats) {
+    unsigned long long lookups = stats.hits + stats.misses;
+    std::stringstream ss;
+    ss << setiosflags(std::ios_base::fixed);
+    ss << std::setprecision(2);
+    ss << "{\"cache\" : {";
+    ss << "\"hits\" : " << stats.hits << ", ";
+    ss << "\"misses\" : " << stats.misses << ", ";
+    ss << "\"hit_rate\" : " << (lookups > 0 ? static_cast<double>(stats.hits) / lookups : 0.0) << ", ";
+    ss << "\"evictions\" : " << stats.evictions << ", ";
+    ss << "\"bytes\" : " << stats.bytes << ", ";
+    ss << "\"entries\" : " << stats.entries << ", ";
+    ss << "\"capacity\" : " << stats.capacity;
+    ss << "}}";
+    return ss.str();
   }
 
   std::list<std::string> ledger_rest::get_accounts() {
-    std::list<std::string> args;
-    return get_balance_accounts(args);
+    std::shared_ptr<const journal_snapshot> current(get_snapshot());
+    if (!current) {
+      return std::list<std::string>();
+    }
+    return current->accounts;
   }
 
-  std::list<std::string> ledger_rest::get_balance_accounts(std::list<std::string> args) {
-    ledger::report_t report(*session_ptr);
-    ledger::scope_t::default_scope = &report;
+  std::list<std::string> ledger_rest::get_balance_accounts(ledger::session_t& session,
+      std::list<std::string> args) {
+    std::lock_guard<std::recursive_mutex> lock(ledger_mutex);
+    ledger::report_t report(session);
+    default_scope_guard scope_guard(&report);
 
     ledger::process_arguments(args, report);
     report.normalize_options("balance");
@@ -202,17 +942,19 @@ namespace ledger_rest {
     http::response bad_response(http::status_code::BAD_REQUEST, std::string(""),
         std::map<std::string, std::string>());
 
-    // Don't reload eagerly because:
-    // 1) If journal edits are made rapidly, reloads will be excessive
-    // 2) Dropbox sync inotify events are hard to follow
-    // This does introduce some latency on first HTTP request.
+    // Normally the journal is loaded in the background; this only loads it
+    // if a request arrives first.
     if (!is_file_loaded) {
-      reset_journal();
+      std::lock_guard<std::mutex> lock(load_mutex);
+      if (!is_file_loaded) {
+        reload_journal();
+      }
     }
 
-    if (is_file_loaded) {
+    std::shared_ptr<const journal_snapshot> current(get_snapshot());
+    if (current) {
       try {
-        return respond_or_throw(request);
+        return respond_or_throw(request, *current);
 
       } catch (const std::exception& e) {
         lr_logger.log(5, e.what());
@@ -226,7 +968,8 @@ namespace ledger_rest {
     return bad_response;
   }
 
-  http::response ledger_rest::respond_or_throw(http::request request) {
+  http::response ledger_rest::respond_or_throw(http::request request,
+      const journal_snapshot& snapshot) {
     std::function<http::response(http::status_code)> build_fail = [](http::status_code code) {
       http::response res(code, std::string(""),
           std::map<std::string, std::string>());
@@ -235,7 +978,7 @@ namespace ledger_rest {
 
     std::function<http::response(std::string)> build_ok = [](std::string s) {
       http::response res(http::status_code::OK,
-          s, std::map<std::string, std::string>());
+          std::move(s), std::map<std::string, std::string>());
       return res;
     };
 
@@ -244,6 +987,10 @@ namespace ledger_rest {
       return build_fail(http::status_code::METHOD_NOT_ALLOWED);
     }
 
+    content_encoding encoding(compression_level > 0
+        ? negotiate_encoding(request.get_header("Accept-Encoding"))
+        : content_encoding::IDENTITY);
+
     std::list<std::string> uri_parts
       = ::ledger_rest::split_string(request.url, "/");
     std::unordered_map<std::string, std::list<std::string>> uri_args
@@ -251,12 +998,15 @@ namespace ledger_rest {
 
     std::list<std::string> register_request;
     std::list<std::string> accounts_request;
+    std::list<std::string> stats_request;
     if (http_prefix.size() > 0) {
       register_request = {"", http_prefix, "report", "register"};
       accounts_request = {"", http_prefix, "accounts"};
+      stats_request = {"", http_prefix, "stats"};
     } else {
       register_request = {"", "report", "register"};
       accounts_request = {"", "accounts"};
+      stats_request = {"", "stats"};
     }
 
     if (uri_parts == register_request) {
@@ -269,9 +1019,61 @@ namespace ledger_rest {
             args = {};
           }
           std::list<std::string> query = uri_args[std::string("query")];
-          std::list<post_result> reg(ledger_rest::run_register(args, query));
+          std::string key(get_cache_key("register",
+                { normalize_register_args(args), normalize_register_query(query) }));
+
+          // Answered from the current snapshot without waiting for ledger.
+          std::map<std::string, std::string> validators(get_validators(snapshot, key));
+          content_encoding validated(get_response_encoding(snapshot, key, encoding));
+          if (is_not_modified(request, validators, snapshot, validated)) {
+            return build_not_modified(validators, validated);
+          }
+
+          std::shared_ptr<const std::string> native_json(
+              get_native_register_json(snapshot, key, args, query));
+          if (native_json) {
+            http::response res(http::status_code::OK, native_json, validators);
+            encode_response(res, encoding, snapshot.generation, key);
+            return res;
+          }
 
-          http::response res = build_ok(to_json(reg));
+          // Reports need the parsed journal, which a snapshot read from the
+          // snapshot file does not have yet.
+          std::shared_ptr<const journal_snapshot> loaded(get_loaded_snapshot());
+          if (!loaded || !loaded->session) {
+            return build_fail(http::status_code::SERVICE_UNAVAILABLE);
+          }
+          validators = get_validators(*loaded, key);
+
+          if (encoding != content_encoding::IDENTITY) {
+            std::shared_ptr<const std::string> encoded(
+                cache.get(loaded->generation, get_encoded_key(key, encoding)));
+            if (encoded) {
+              http::response res(http::status_code::OK, encoded, validators);
+              set_encoding_headers(res, encoding);
+              return res;
+            }
+          }
+
+          std::shared_ptr<const std::string> json(cache.get(loaded->generation, key));
+          if (json) {
+            http::response res(http::status_code::OK, json, validators);
+            encode_response(res, encoding, loaded->generation, key);
+            return res;
+          }
+
+          // A full register can be far too large to build in memory first.
+          // Its size is not known up front so it is compressed whenever the
+          // client accepts it.
+          http::body_producer producer = [this, loaded, key, args, query, encoding](
+              http::body_writer& writer) {
+            write_register_json(*loaded, key, args, query, encoding, writer);
+          };
+          http::response res(http::status_code::OK, producer, validators);
+          res.headers["Vary"] = "Accept-Encoding";
+          if (encoding != content_encoding::IDENTITY) {
+            set_encoding_headers(res, encoding);
+          }
           return res;
 
         } else {
@@ -282,17 +1084,57 @@ namespace ledger_rest {
         std::list<std::unordered_map<std::string, std::list<std::string>>> parsed_json =
           ::ledger_rest::parse_register_request_json(request.upload_data);
 
-        std::list<std::list<post_result>> results;
-        for (auto iter = parsed_json.cbegin(); iter != parsed_json.end(); iter++) {
-          std::unordered_map<std::string, std::list<std::string>> req = *iter;
-          std::list<std::string> args = req[std::string("args")];
-          std::list<std::string> query = req[std::string("query")];
-          std::list<post_result> reg(ledger_rest::run_register(args, query));
-          results.push_back(reg);
+        std::shared_ptr<const journal_snapshot> loaded(get_loaded_snapshot());
+        if (!loaded || !loaded->session) {
+          return build_fail(http::status_code::SERVICE_UNAVAILABLE);
+        }
+        std::vector<register_batch_item> items;
+        for (auto iter = parsed_json.begin(); iter != parsed_json.end(); iter++) {
+          register_batch_item item;
+          item.args = (*iter)[std::string("args")];
+          item.query = (*iter)[std::string("query")];
+          item.key = get_cache_key("register",
+              { normalize_register_args(item.args), normalize_register_query(item.query) });
+          items.push_back(item);
+        }
+
+        // When every register is cached the batch's size is known, so it
+        // is sent whole and only compressed if it is large enough.
+        std::string body("[");
+        std::size_t cached = 0;
+        for (; cached < items.size(); cached++) {
+          std::shared_ptr<const std::string> json(cache.get(loaded->generation,
+                items[cached].key));
+          if (!json) {
+            break;
+          }
+          if (cached > 0) {
+            body.append(", ");
+          }
+          body.append(*json);
+        }
+        if (cached == items.size()) {
+          body.append("]");
+          http::response res(http::status_code::OK, std::move(body),
+              std::map<std::string, std::string>());
+          encode_response(res, encoding, loaded->generation, "");
+          return res;
         }
-        std::string responses_json = to_json(results);
 
-        http::response res = build_ok(responses_json);
+        // Otherwise it is streamed so that the first registers are sent
+        // while later ones are still being answered. Like a full register
+        // its size is not known up front so it is compressed whenever the
+        // client accepts it.
+        http::body_producer producer = [this, loaded, items, encoding](
+            http::body_writer& writer) {
+          write_register_batch_json(*loaded, items, encoding, writer);
+        };
+        http::response res(http::status_code::OK, producer,
+            std::map<std::string, std::string>());
+        res.headers["Vary"] = "Accept-Encoding";
+        if (encoding != content_encoding::IDENTITY) {
+          set_encoding_headers(res, encoding);
+        }
         return res;
 
       } else {
@@ -302,9 +1144,20 @@ namespace ledger_rest {
 
     } else if (request.method == std::string("GET") &&
         uri_parts == accounts_request) {
-      std::list<std::string> accounts(ledger_rest::get_accounts());
+      std::string key(get_cache_key("accounts", {}));
+      std::map<std::string, std::string> validators(get_validators(snapshot, key));
+      content_encoding validated(get_response_encoding(snapshot, key, encoding));
+      if (is_not_modified(request, validators, snapshot, validated)) {
+        return build_not_modified(validators, validated);
+      }
 
-      http::response res = build_ok(to_json(accounts));
+      http::response res(http::status_code::OK, get_accounts_json(snapshot, key), validators);
+      encode_response(res, encoding, snapshot.generation, key);
+      return res;
+
+    } else if (request.method == std::string("GET") &&
+        uri_parts == stats_request) {
+      http::response res = build_ok(to_json(cache.get_stats()));
       return res;
 
     } else
@@ -312,52 +1165,586 @@ namespace ledger_rest {
       return build_fail(http::status_code::NOT_FOUND);
   }
 
+  // Must be called with load_mutex held.
+  void ledger_rest::reload_journal() {
+    try {
+      if (update_journal_or_throw()) {
+        return;
+      }
+
+    } catch (const std::exception& e) {
+      lr_logger.log(5, std::string("Unable to update ledger file: ") + e.what());
+
+    } catch (...) {
+      lr_logger.log(5, "Unable to update ledger file");
+    }
+
+    reset_journal();
+  }
+
+  // Must be called with load_mutex held.
   void ledger_rest::reset_journal() {
     try {
       reset_journal_or_throw();
 
     } catch (...) {
+      // Keep serving the previous snapshot, if any, until the next change.
       lr_logger.log(5, "Unable to load ledger file");
-      is_file_loaded = false;
+      is_file_loaded = static_cast<bool>(get_snapshot());
     }
   }
 
+  // Must be called with load_mutex held. The new session is fully loaded
+  // before it is published so requests on the old snapshot are unaffected.
+  // ledger parses with the global state that reports use, so the parse
+  // holds ledger_mutex. Reading the files and indexing the result do not.
   void ledger_rest::reset_journal_or_throw() {
-    session_ptr = std::make_shared<ledger::session_t>();
-    ledger::set_session_context(session_ptr.get());
-    ledger::scope_t::default_scope = &empty_scope;
-    ledger::scope_t::empty_scope = &empty_scope;
-    session_ptr->read_journal(ledger_file);
-    is_file_loaded = true;
+    std::list<journal_file_state> files(get_journal_file_states());
+
+    std::shared_ptr<std::recursive_mutex> mutex(shared_ledger_mutex);
+    std::shared_ptr<ledger::session_t> session;
+    {
+      std::lock_guard<std::recursive_mutex> lock(ledger_mutex);
+      session.reset(new ledger::session_t(), [mutex](ledger::session_t* session) {
+            std::lock_guard<std::recursive_mutex> lock(*mutex);
+            delete session;
+          });
+      ledger::set_session_context(session.get());
+      ledger::scope_t::default_scope = &empty_scope;
+      ledger::scope_t::empty_scope = &empty_scope;
+      session->read_journal(ledger_file);
+    }
+
+    // If the main file changed while it was parsed, the recorded state may
+    // not match what ledger read so the next change cannot be an append.
+    std::string contents(read_whole_file(ledger_file));
+    if (hash_bytes(contents.data(), contents.size()) != files.front().hash) {
+      files.front().is_appendable = false;
+    }
+
+    loaded_files = files;
+    publish_snapshot(session);
     lr_logger.log(7, "Reloaded ledger file.");
   }
 
-  void ledger_rest::lazy_reload_journal() {
-    is_file_loaded = false;
+  // Must be called with load_mutex held. Parses only what changed since the
+  // last load into the current session. Returns false if that is not
+  // possible and a full reload is needed. The session is shared with the
+  // previous snapshot, so reports ledger runs for requests still holding
+  // that snapshot see the changes too; its posting table does not.
+  bool ledger_rest::update_journal_or_throw() {
+    std::shared_ptr<const journal_snapshot> current(get_snapshot());
+    if (!current || !current->session || loaded_files.empty()) {
+      return false;
+    }
+
+    std::vector<journal_file_state> old_files(loaded_files.cbegin(), loaded_files.cend());
+    std::vector<journal_file_state> new_files;
+    for (const journal_file_state& file : get_journal_file_states()) {
+      new_files.push_back(file);
+    }
+
+    // Includes were added or removed.
+    if (old_files.size() != new_files.size()) {
+      return false;
+    }
+    std::vector<bool> is_changed(new_files.size());
+    bool is_any_changed = false;
+    for (std::size_t i = 0; i < new_files.size(); i++) {
+      if (old_files[i].path != new_files[i].path
+          || old_files[i].parent != new_files[i].parent) {
+        return false;
+      }
+      is_changed[i] = old_files[i].size != new_files[i].size
+        || old_files[i].hash != new_files[i].hash;
+      is_any_changed = is_any_changed || is_changed[i];
+    }
+
+    // Sync clients and editors often rewrite files without changing them.
+    if (!is_any_changed) {
+      lr_logger.log(7, "Ledger files unchanged, skipping reload.");
+      is_file_loaded = true;
+      return true;
+
+    } else if (is_changed[0]) {
+      for (std::size_t i = 1; i < is_changed.size(); i++) {
+        if (is_changed[i]) {
+          return false;
+        }
+      }
+      return append_journal_or_throw(*current);
+
+    } else {
+      return reparse_journal_files_or_throw(*current, new_files, is_changed);
+    }
   }
 
-  std::list<std::string> ledger_rest::get_journal_include_files() {
-    std::string include_directive("!include ");
-    std::ifstream ledger_stream(ledger_file, std::ios::in);
+  // Must be called with load_mutex held. Parses transactions appended to
+  // the main file into the snapshot's session. Returns false if the change is
+  // not a pure append of transactions.
+  bool ledger_rest::append_journal_or_throw(const journal_snapshot& current) {
+    if (!loaded_files.front().is_appendable) {
+      return false;
+    }
 
-    std::list<std::string> include_files;
-    std::string line;
-    if (ledger_stream.is_open()) {
-      while (getline(ledger_stream, line)) {
-        if (line.find(include_directive) == 0) {
-          std::string include_file = line.substr(include_directive.length());
-          auto last_slash = ledger_file.find_last_of('/');
-
-          // Assume POSIX for absolute path check
-          if (include_file.at(0) != '/' && last_slash != std::string::npos) {
-            include_files.push_back(ledger_file.substr(0, 1+last_slash) + include_file);
-          } else {
-            include_files.push_back(include_file);
+    std::string contents(read_whole_file(ledger_file));
+    std::size_t offset = get_appended_offset(loaded_files.front(),
+        contents.data(), contents.size());
+    if (offset == std::string::npos) {
+      return false;
+    }
+
+    std::string tail(contents.data() + offset, contents.size() - offset);
+    if (!is_appendable_tail(tail)) {
+      return false;
+    }
+
+    std::size_t appended_count;
+    {
+      std::lock_guard<std::recursive_mutex> lock(ledger_mutex);
+      ledger::session_t& session = *current.session;
+      ledger::journal_t& journal = *session.journal;
+      std::size_t xact_count = journal.xacts.size();
+      try {
+        boost::filesystem::path path(ledger_file);
+        read_journal_or_throw(session,
+            boost::shared_ptr<std::istream>(new std::istringstream(tail)), path);
+
+      } catch (...) {
+        remove_xacts(journal, std::next(journal.xacts.begin(), xact_count), journal.xacts.end());
+        throw;
+      }
+      appended_count = journal.xacts.size() - xact_count;
+      journal_revision++;
+    }
+
+    loaded_files.front() = get_journal_file_state(ledger_file,
+        contents.data(), contents.size());
+
+    publish_snapshot(current.session);
+    lr_logger.log(7, "Appended " + std::to_string(appended_count)
+        + " transactions from ledger file.");
+    return true;
+  }
+
+  // Must be called with load_mutex held. Parses each changed include again
+  // and puts its transactions where the old ones were. Returns false if the
+  // journal has directives whose effect cannot be reproduced by parsing a
+  // file on its own.
+  bool ledger_rest::reparse_journal_files_or_throw(const journal_snapshot& current,
+      const std::vector<journal_file_state>& files, const std::vector<bool>& is_changed) {
+    std::vector<std::size_t> parents(files.size(), 0);
+    std::unordered_map<std::string, std::size_t> indexes;
+    for (std::size_t i = 0; i < files.size(); i++) {
+      indexes[files[i].path] = i;
+      if (i > 0) {
+        parents[i] = indexes[files[i].parent];
+      }
+    }
+
+    // Only the topmost changed file of each changed subtree is parsed; its
+    // includes are parsed along with it.
+    std::vector<journal_file_state> old_files(loaded_files.cbegin(), loaded_files.cend());
+    std::vector<std::size_t> changed_roots;
+    for (std::size_t i = 1; i < files.size(); i++) {
+      if (!is_changed[i]) {
+        continue;
+      }
+
+      bool has_changed_ancestor = false;
+      for (std::size_t a = parents[i]; a != 0; a = parents[a]) {
+        has_changed_ancestor = has_changed_ancestor || is_changed[a];
+      }
+      if (has_changed_ancestor) {
+        continue;
+      }
+
+      if (!old_files[i].is_plain || !files[i].is_plain) {
+        return false;
+      }
+      changed_roots.push_back(i);
+    }
+
+    // Automated transactions and directives like apply or year anywhere in
+    // the journal can change how a file is parsed.
+    for (const journal_file_state& file : files) {
+      if (!file.is_appendable) {
+        return false;
+      }
+    }
+
+    std::unique_lock<std::recursive_mutex> lock(ledger_mutex);
+    ledger::session_t& session = *current.session;
+    ledger::journal_t& journal = *session.journal;
+
+    // The transactions of a file and everything it includes are parsed in
+    // one run so they are contiguous in the journal.
+    std::unordered_map<std::string, std::string> identities;
+    // First and last transaction of each changed file's previous parse.
+    std::vector<std::pair<ledger::xacts_list::iterator, ledger::xacts_list::iterator>> ranges;
+    for (std::size_t root : changed_roots) {
+      std::unordered_set<std::string> subtree;
+      subtree.insert(get_file_identity(files[root].path));
+      for (std::size_t i = root + 1; i < files.size(); i++) {
+        bool is_descendant = false;
+        for (std::size_t a = parents[i]; a != 0 && !is_descendant; a = parents[a]) {
+          is_descendant = a == root;
+        }
+        if (is_descendant) {
+          subtree.insert(get_file_identity(files[i].path));
+        }
+      }
+
+      auto begin = journal.xacts.end();
+      auto last = journal.xacts.end();
+      bool is_range_done = false;
+      for (auto iter = journal.xacts.begin(); iter != journal.xacts.end(); iter++) {
+        bool is_in_subtree = false;
+        if ((*iter)->pos) {
+          std::string pathname((*iter)->pos->pathname.string());
+          auto identity = identities.find(pathname);
+          if (identity == identities.end()) {
+            identity = identities.emplace(pathname, get_file_identity(pathname)).first;
           }
+          is_in_subtree = subtree.count(identity->second) > 0;
         }
+
+        if (is_in_subtree && is_range_done) {
+          return false;
+        } else if (is_in_subtree) {
+          if (begin == journal.xacts.end()) {
+            begin = iter;
+          }
+          last = iter;
+        } else if (begin != journal.xacts.end()) {
+          is_range_done = true;
+        }
+      }
+
+      // Without old transactions there is nothing to mark where new ones go.
+      if (begin == journal.xacts.end()) {
+        return false;
       }
+      ranges.push_back(std::make_pair(begin, last));
     }
 
+    std::size_t xact_count = journal.xacts.size();
+    std::vector<std::size_t> parsed_counts;
+    try {
+      for (std::size_t root : changed_roots) {
+        std::size_t before = journal.xacts.size();
+        boost::filesystem::path path(files[root].path);
+        read_journal_or_throw(session,
+            boost::shared_ptr<std::istream>(new std::ifstream(files[root].path)), path);
+        parsed_counts.push_back(journal.xacts.size() - before);
+      }
+
+    } catch (...) {
+      remove_xacts(journal, std::next(journal.xacts.begin(), xact_count), journal.xacts.end());
+      throw;
+    }
+
+    auto parsed = std::next(journal.xacts.begin(), xact_count);
+    for (std::size_t i = 0; i < ranges.size(); i++) {
+      auto parsed_end = std::next(parsed, parsed_counts[i]);
+      journal.xacts.splice(ranges[i].first, journal.xacts, parsed, parsed_end);
+      remove_xacts(journal, ranges[i].first, std::next(ranges[i].second));
+      parsed = parsed_end;
+    }
+    journal_revision++;
+    lock.unlock();
+
+    std::vector<std::size_t>::const_iterator count = parsed_counts.cbegin();
+    for (std::size_t root : changed_roots) {
+      lr_logger.log(7, "Parsed " + std::to_string(*count++) + " transactions from "
+          + files[root].path + ".");
+    }
+
+    loaded_files = std::list<journal_file_state>(files.cbegin(), files.cend());
+    publish_snapshot(current.session);
+    return true;
+  }
+
+  // Must be called with ledger_mutex held.
+  void ledger_rest::read_journal_or_throw(ledger::session_t& session,
+      boost::shared_ptr<std::istream> stream, const boost::filesystem::path& path) {
+    default_scope_guard scope_guard(&empty_scope);
+    ledger::journal_t& journal = *session.journal;
+
+    session.parsing_context.push(stream, path.parent_path());
+    ledger::parse_context_t& context = session.parsing_context.get_current();
+    context.pathname = path;
+    context.journal = &journal;
+    context.master = journal.master;
+
+    try {
+      journal.read(session.parsing_context);
+
+    } catch (...) {
+      session.parsing_context.pop();
+      throw;
+    }
+    session.parsing_context.pop();
+  }
+
+  void ledger_rest::remove_xacts(ledger::journal_t& journal,
+      ledger::xacts_list::iterator begin, ledger::xacts_list::iterator end) {
+    std::list<ledger::xact_t*> removed;
+    removed.splice(removed.end(), journal.xacts, begin, end);
+    for (ledger::xact_t* xact : removed) {
+      xact->journal = NULL;
+      delete xact;
+    }
+  }
+
+  // Must be called with load_mutex held. Only what reads the session
+  // holds ledger_mutex.
+  void ledger_rest::publish_snapshot(std::shared_ptr<ledger::session_t> session) {
+    std::shared_ptr<journal_snapshot> loaded = std::make_shared<journal_snapshot>();
+    loaded->session = session;
+    loaded->content_hash = hash_journal_files(loaded_files);
+    loaded->last_modified = get_last_modified(loaded_files);
+    std::unordered_map<const ledger::account_t*, uint32_t> account_ids;
+    std::unordered_map<const ledger::xact_t*, uint32_t> payee_ids;
+    unsigned long long revision;
+    {
+      std::lock_guard<std::recursive_mutex> lock(ledger_mutex);
+      loaded->accounts = get_balance_accounts(*session, std::list<std::string>());
+      loaded->postings = std::make_shared<const posting_table>(
+          get_posting_table(*session->journal, account_ids, payee_ids));
+      revision = journal_revision;
+    }
+    std::shared_ptr<journal_names> names(get_journal_names(*loaded->postings));
+    names->account_ids.swap(account_ids);
+    names->payee_ids.swap(payee_ids);
+    names->journal_revision = revision;
+    loaded->names = names;
+    loaded->indexes = std::make_shared<const posting_indexes>(
+        get_posting_indexes(*loaded->postings));
+
+    {
+      std::lock_guard<std::recursive_mutex> lock(ledger_mutex);
+      loaded->generation = ++generation;
+      std::atomic_store(&snapshot, std::shared_ptr<const journal_snapshot>(loaded));
+    }
+    is_file_loaded = true;
+
+    if (snapshot_path.size() > 0 && pool) {
+      queue_snapshot_file(loaded);
+    } else if (snapshot_path.size() > 0) {
+      write_snapshot_file(*loaded);
+    }
+  }
+
+  // Writes the snapshot file on the pool. One write runs at a time and only
+  // the newest snapshot waiting is written. The session is not kept for it.
+  void ledger_rest::queue_snapshot_file(std::shared_ptr<const journal_snapshot> loaded) {
+    std::shared_ptr<journal_snapshot> file(std::make_shared<journal_snapshot>(*loaded));
+    file->session.reset();
+
+    std::lock_guard<std::mutex> lock(snapshot_file_mutex);
+    pending_snapshot_file = file;
+    if (!is_snapshot_file_writing) {
+      is_snapshot_file_writing = true;
+      pool->submit([this]() { write_pending_snapshot_files(); });
+    }
+  }
+
+  void ledger_rest::write_pending_snapshot_files() {
+    std::unique_lock<std::mutex> lock(snapshot_file_mutex);
+    while (pending_snapshot_file) {
+      std::shared_ptr<const journal_snapshot> file;
+      file.swap(pending_snapshot_file);
+      lock.unlock();
+      write_snapshot_file(*file);
+      lock.lock();
+    }
+    is_snapshot_file_writing = false;
+    snapshot_file_written.notify_all();
+  }
+
+  // The snapshot file is only an optimization for the next start so failing
+  // to write it is not an error.
+  void ledger_rest::write_snapshot_file(const journal_snapshot& loaded) {
+    try {
+      ::ledger_rest::write_snapshot_file(snapshot_path, loaded.content_hash,
+          loaded.accounts, *loaded.postings);
+
+    } catch (const std::exception& e) {
+      lr_logger.log(5, std::string("Unable to write snapshot file: ") + e.what());
+    }
+  }
+
+  // Publishes the snapshot in the snapshot file if it was made from the
+  // journal as it is now. Reports still need the journal to be parsed but
+  // everything the snapshot file holds can be served right away. Returns
+  // false if there is no usable snapshot file.
+  bool ledger_rest::load_snapshot_file() {
+    if (snapshot_path.size() == 0) {
+      return false;
+    }
+
+    try {
+      std::list<journal_file_state> files(get_journal_file_states());
+      unsigned long long key = hash_journal_files(files);
+      std::shared_ptr<journal_snapshot> loaded = std::make_shared<journal_snapshot>();
+      loaded->content_hash = key;
+      loaded->last_modified = get_last_modified(files);
+      std::shared_ptr<posting_table> postings = std::make_shared<posting_table>();
+      if (!read_snapshot_file(snapshot_path, key, loaded->accounts, *postings)) {
+        return false;
+      }
+      loaded->postings = postings;
+      loaded->names = get_journal_names(*postings);
+      loaded->indexes = std::make_shared<const posting_indexes>(
+          get_posting_indexes(*postings));
+
+      std::lock_guard<std::recursive_mutex> lock(ledger_mutex);
+      loaded->generation = ++generation;
+      std::atomic_store(&snapshot, std::shared_ptr<const journal_snapshot>(loaded));
+      is_file_loaded = true;
+      lr_logger.log(7, "Loaded snapshot file.");
+      return true;
+
+    } catch (const std::exception& e) {
+      lr_logger.log(5, std::string("Unable to load snapshot file: ") + e.what());
+      return false;
+    }
+  }
+
+  // Must be called with ledger_mutex held.
+  // Full account names are only built the first time an account is seen.
+  posting_table ledger_rest::get_posting_table(ledger::journal_t& journal,
+      std::unordered_map<const ledger::account_t*, uint32_t>& account_ids,
+      std::unordered_map<const ledger::xact_t*, uint32_t>& payee_ids) {
+    posting_table table;
+    std::unordered_map<std::string, uint32_t> account_name_ids;
+    std::unordered_map<std::string, uint32_t> payee_name_ids;
+    std::unordered_map<std::string, uint32_t> commodity_ids;
+    auto get_id = [](std::unordered_map<std::string, uint32_t>& ids,
+        std::vector<std::string>& names, const std::string& name) {
+      auto id = ids.emplace(name, static_cast<uint32_t>(names.size()));
+      if (id.second) {
+        names.push_back(name);
+      }
+      return id.first->second;
+    };
+
+    uint32_t xact_id = 0;
+    for (ledger::xact_t* xact : journal.xacts) {
+      uint32_t xact_payee_id = get_id(payee_name_ids, table.payee_names, xact->payee);
+      bool is_xact_payee = true;
+      for (ledger::post_t* post : xact->posts) {
+        uint8_t flags = 0;
+        if (post->has_flags(POST_VIRTUAL)) {
+          flags |= posting_table::VIRTUAL;
+        }
+        if (post->_date) {
+          flags |= posting_table::POST_DATE;
+        }
+
+        std::string commodity;
+        int64_t amount = 0;
+        if (!post->amount.is_null()) {
+          if (!get_scaled_amount(post->amount, amount)) {
+            flags |= posting_table::INEXACT;
+          }
+          if (post->amount.has_commodity()) {
+            commodity = post->amount.commodity().symbol();
+          }
+        }
+
+        table.dates.push_back(to_day_number(post->date()));
+        table.amounts.push_back(amount);
+        auto account_id = account_ids.find(post->account);
+        if (account_id == account_ids.end()) {
+          account_id = account_ids.emplace(post->account, get_id(account_name_ids,
+                table.account_names, post->account->fullname())).first;
+        }
+        table.account_ids.push_back(account_id->second);
+        uint32_t payee_id = get_id(payee_name_ids, table.payee_names, post->payee());
+        is_xact_payee = is_xact_payee && payee_id == xact_payee_id;
+        table.payee_ids.push_back(payee_id);
+        table.xact_ids.push_back(xact_id);
+        table.commodity_ids.push_back(get_id(commodity_ids, table.commodity_names, commodity));
+        table.post_flags.push_back(flags);
+      }
+      if (is_xact_payee) {
+        payee_ids.emplace(xact, xact_payee_id);
+      }
+      xact_id++;
+    }
+    return table;
+  }
+
+  // Interned in table order so that the ids are the posting table's.
+  std::shared_ptr<ledger_rest::journal_names> ledger_rest::get_journal_names(
+      const posting_table& postings) {
+    std::shared_ptr<journal_names> names = std::make_shared<journal_names>();
+    for (const std::string& account : postings.account_names) {
+      names->accounts.intern(account);
+    }
+    for (const std::string& payee : postings.payee_names) {
+      names->payees.intern(payee);
+    }
+    return names;
+  }
+
+  // The main file first and then its includes in the order ledger reads
+  // them. Files that are already included are skipped so cycles end.
+  std::list<journal_file_state> ledger_rest::get_journal_file_states() {
+    std::list<journal_file_state> files;
+    std::unordered_set<std::string> visited;
+    std::function<void(const std::string&, const std::string&)> visit
+      = [&](const std::string& path, const std::string& parent) {
+        if (!visited.insert(get_file_identity(path)).second) {
+          return;
+        }
+
+        std::string contents(read_whole_file(path));
+        journal_file_state state(get_journal_file_state(path, contents.data(), contents.size()));
+        state.parent = parent;
+        files.push_back(state);
+
+        for (const std::string& include
+            : get_include_directives(contents.data(), contents.size())) {
+          for (const std::string& include_path : resolve_include(path, include)) {
+            visit(include_path, path);
+          }
+        }
+      };
+    visit(ledger_file, std::string(""));
+    return files;
+  }
+
+  // The current snapshot with a parsed journal. A snapshot read from the
+  // snapshot file is replaced by parsing the journal here if the background
+  // load has not done so yet.
+  std::shared_ptr<const ledger_rest::journal_snapshot> ledger_rest::get_loaded_snapshot() {
+    std::shared_ptr<const journal_snapshot> current(get_snapshot());
+    if (current && current->session) {
+      return current;
+    }
+
+    std::lock_guard<std::mutex> lock(load_mutex);
+    current = get_snapshot();
+    if (!current || !current->session) {
+      reset_journal();
+      current = get_snapshot();
+    }
+    return current;
+  }
+
+  void ledger_rest::lazy_reload_journal() {
+    is_file_loaded = false;
+  }
+
+  std::list<std::string> ledger_rest::get_journal_include_files() {
+    std::list<std::string> include_files;
+    std::list<journal_file_state> files(get_journal_file_states());
+    for (auto iter = std::next(files.cbegin()); iter != files.cend(); iter++) {
+      include_files.push_back(iter->path);
+    }
     return include_files;
   }
 
@@ -395,6 +1782,10 @@ namespace ledger_rest {
   }
 
   void ledger_rest::post_capturer::operator()(ledger::post_t& post) {
+    result_capture.push_back(get_post_result(post));
+  }
+
+  post_result ledger_rest::post_capturer::get_post_result(ledger::post_t& post) {
     post_result r;
     r.amount = get_amount(post).to_amount().to_double();
     r.total = get_total(post).value().to_amount().to_double();
@@ -402,7 +1793,56 @@ namespace ledger_rest {
     ledger::account_t& account(*post.reported_account());
     r.account_name = account.fullname();
     r.payee = post.payee();
-    result_capture.push_back(r);
+    return r;
+  }
+
+  // Posts are gathered into one buffer so the writer below sees a few large
+  // writes rather than one per post.
+  void ledger_rest::post_writer::operator()(ledger::post_t& post) {
+    if (!is_first) {
+      buffer.write_raw(", ", 2);
+    }
+    is_first = false;
+    double amount = get_amount(post).to_amount().to_double();
+    double total = get_total(post).value().to_amount().to_double();
+
+    // Transactions made up by the report, e.g. by --collapse, have no id.
+    // Nor do any once the session has been changed in place, which may have
+    // put a new transaction where a removed one was.
+    bool is_current = names && names->journal_revision == journal_revision;
+    std::string payee_json;
+    const std::string* payee_ptr = &payee_json;
+    auto payee_id = is_current ? names->payee_ids.find(post.xact)
+      : std::unordered_map<const ledger::xact_t*, uint32_t>::const_iterator();
+    if (is_current && payee_id != names->payee_ids.end()) {
+      payee_ptr = &names->payees.get_json(payee_id->second);
+    } else {
+      payee_json = to_json_string(post.payee());
+    }
+
+    // Accounts made up by the report, e.g. by --collapse, are not interned.
+    ledger::account_t* account = post.reported_account();
+    std::string account_json;
+    const std::string* account_ptr = &account_json;
+    auto account_id = names ? names->account_ids.find(account)
+      : std::unordered_map<const ledger::account_t*, uint32_t>::const_iterator();
+    if (names && account_id != names->account_ids.end()) {
+      account_ptr = &names->accounts.get_json(account_id->second);
+    } else {
+      account_json = to_json_string(account->fullname());
+    }
+
+    write_post_json(buffer, amount, total, post.xact->date(), *payee_ptr, *account_ptr);
+    if (buffer.size() >= flush_size) {
+      flush();
+    }
+  }
+
+  void ledger_rest::post_writer::flush() {
+    if (buffer.size() > 0) {
+      writer.write(buffer.get_buffer());
+      buffer.clear();
+    }
   }
 
   std::list<post_result> ledger_rest::post_capturer::get_post_results() {
@@ -27,23 +27,42 @@
 #pragma once
 
 #include <string>
+#include <functional>
 #include <list>
+#include <unordered_map>
+#include <vector>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include "boost/date_time/gregorian/gregorian.hpp"
 
 #include "ledger_rest_args.h"
 #include "logger.h"
 #include "http.h"
+#include "journal_file.h"
+#include "posting_table.h"
+#include "posting_query.h"
+#include "response_cache.h"
+#include "request_coalescer.h"
+#include "register_batcher.h"
+#include "compression.h"
+#include "body_spool.h"
+#include "json_writer.h"
+#include "string_dictionary.h"
+#include "thread_pool.h"
 #include "ledger_includes.h"
 
 namespace ledger_rest {
   class ledger_rest {
     public:
-      ledger_rest(ledger_rest_args& args, logger& logger);
+      // Native registers are split across pool, when given, and run on the
+      // calling thread otherwise.
+      ledger_rest(ledger_rest_args& args, logger& logger, thread_pool* pool = NULL);
       ledger_rest(const ledger_rest&) = delete;
       ledger_rest& operator=(const ledger_rest&) = delete;
       ledger_rest (ledger_rest&&) = delete;
       ledger_rest& operator=(const ledger_rest&&) = delete;
-      virtual ~ledger_rest() { }
+      virtual ~ledger_rest();
 
       struct post_result {
         double amount = 0;
@@ -53,6 +72,41 @@ namespace ledger_rest {
         std::string payee;
       };
 
+      // Account and payee names of a snapshot with the ids the posting
+      // table uses.
+      struct journal_names {
+        string_dictionary accounts;
+        string_dictionary payees;
+        // Lets reports run by ledger find account ids without building full
+        // names. Empty for a snapshot read from the snapshot file.
+        std::unordered_map<const ledger::account_t*, uint32_t> account_ids;
+        // The payee id of each transaction whose postings all have its
+        // payee, so reports need not build and look up the payee of each.
+        // Also empty for a snapshot read from the snapshot file.
+        std::unordered_map<const ledger::xact_t*, uint32_t> payee_ids;
+        // The journal_revision the maps were taken at.
+        unsigned long long journal_revision = 0;
+      };
+
+      // A view of one load of the journal. Requests hold a reference to the
+      // snapshot they started with so a reload can publish a new one without
+      // waiting for them. The session is released, under the ledger lock,
+      // once the last reference is dropped. Transactions appended to the main
+      // file, and changed includes, are parsed into the existing session, so
+      // ledger reports on an older snapshot see them. A snapshot read from
+      // the snapshot file has no session until the journal has been parsed.
+      struct journal_snapshot {
+        std::shared_ptr<ledger::session_t> session;
+        unsigned long long generation;
+        // Identifies the journal contents across restarts, unlike generation.
+        unsigned long long content_hash = 0;
+        std::time_t last_modified = 0;
+        std::list<std::string> accounts;
+        std::shared_ptr<const posting_table> postings;
+        std::shared_ptr<const journal_names> names;
+        std::shared_ptr<const posting_indexes> indexes;
+      };
+
       std::list<post_result> run_register(std::list<std::string> args,
           std::list<std::string> query);
       static std::string to_json(post_result posts);
@@ -62,6 +116,7 @@ namespace ledger_rest {
       static std::string to_json(std::list<std::string> accounts);
 
       static std::string to_json(std::list<std::list<post_result>> results);
+      static std::string to_json(const response_cache::stats& stats);
 
       virtual http::response respond(http::request request);
 
@@ -69,23 +124,187 @@ namespace ledger_rest {
 
       std::list<std::string> get_journal_include_files();
       void lazy_reload_journal();
+      bool load_snapshot_file();
 
     protected:
       logger& lr_logger;
-      std::shared_ptr<ledger::session_t> session_ptr;
       ledger::empty_scope_t empty_scope;
-      bool is_file_loaded;
+      std::atomic<bool> is_file_loaded;
+      // ledger keeps global state (the commodity pool, default_scope) and
+      // writes report data into journal objects so it may only be run from
+      // one thread at a time. Parsing a journal uses the same global state.
+      // Recursive because a snapshot may be released while the lock is
+      // already held. Shared with the deleters of sessions, which may be
+      // released after this object is gone.
+      std::shared_ptr<std::recursive_mutex> shared_ledger_mutex;
+      std::recursive_mutex& ledger_mutex;
+      unsigned long long generation;
+      // Counts changes made to a session in place. Guarded by ledger_mutex.
+      unsigned long long journal_revision;
+      // Lets one thread at a time load the journal.
+      std::mutex load_mutex;
+      // The main file first, then its includes. Guarded by load_mutex.
+      std::list<journal_file_state> loaded_files;
       std::string http_prefix;
+      const std::string snapshot_path;
+      // 0 turns compression off.
+      const int compression_level;
+      const std::size_t compression_min_size;
+      response_cache cache;
+      // Keyed like cache, so that identical requests that miss it together,
+      // as every dashboard does after a reload, are answered once.
+      request_coalescer flights;
+      // A ledger register as ledger rendered it, before it is sent.
+      struct rendered_register {
+        // Set if it fit in memory.
+        std::shared_ptr<const std::string> body;
+        std::unique_ptr<body_spool> spool;
+        // Ledger failed and body is an empty register.
+        bool is_failed = false;
+      };
+      // Like flights but for ledger registers that are sent as they are
+      // read, which may be too large to keep in memory.
+      basic_request_coalescer<rendered_register> renders;
+      // Lets different native registers that arrive together share a pass.
+      register_batcher batcher;
+      thread_pool* pool;
+      // Registers with no more rows are not split.
+      std::size_t register_chunk_rows;
+      // Larger ledger registers are rendered to a temporary file. It is at
+      // least the cache size as a register that fits is cached anyway.
+      std::size_t spool_memory_limit;
+      // The newest snapshot waiting to be written to the snapshot file and
+      // whether a write is queued or running, both guarded by
+      // snapshot_file_mutex.
+      std::mutex snapshot_file_mutex;
+      std::condition_variable snapshot_file_written;
+      std::shared_ptr<const journal_snapshot> pending_snapshot_file;
+      bool is_snapshot_file_writing;
 
       template<typename T>
       static std::string to_string(const std::list<T>&);
-      template<typename T>
-      static std::string to_json(std::list<T>, std::function<std::string(T)>);
-      virtual http::response respond_or_throw(http::request request);
-      std::list<post_result> run_register_or_throw(std::list<std::string>, std::list<std::string>);
+      static void write_json(json_writer& writer, const post_result& post);
+      static void write_json(json_writer& writer, const std::list<post_result>& posts);
+      // The payee and account are JSON strings, already quoted and escaped.
+      static void write_post_json(json_writer& writer, double amount, double total,
+          const boost::gregorian::date& date, const std::string& payee_json,
+          const std::string& account_json);
+      static std::string to_json_string(const std::string& s);
+      virtual http::response respond_or_throw(http::request request,
+          const journal_snapshot& snapshot);
+      std::list<post_result> run_register(const journal_snapshot& snapshot,
+          std::list<std::string> args, std::list<std::string> query);
+      std::list<post_result> run_register_or_throw(const journal_snapshot& snapshot,
+          std::list<std::string>, std::list<std::string>);
+      void run_register_or_throw(const journal_snapshot& snapshot,
+          std::list<std::string> args, std::list<std::string> query,
+          ledger::post_handler_ptr handler);
+      void write_register_json(const journal_snapshot& snapshot, const std::string& key,
+          const std::list<std::string>& args, const std::list<std::string>& query,
+          content_encoding encoding, http::body_writer& writer);
+      bool render_register_json(const journal_snapshot& snapshot,
+          const std::list<std::string>& args, const std::list<std::string>& query,
+          http::body_writer& writer);
+      void log_register_error(const std::list<std::string>& args,
+          const std::list<std::string>& query);
+      void send_register_json(unsigned long long generation, const std::string& key,
+          content_encoding encoding, const http::body_producer& producer,
+          http::body_writer& writer);
+      std::shared_ptr<const std::string> get_ledger_register_json(
+          const journal_snapshot& snapshot, const std::string& key,
+          const std::list<std::string>& args, const std::list<std::string>& query);
+      struct register_batch_item {
+        std::list<std::string> args;
+        std::list<std::string> query;
+        std::string key;
+      };
+      void write_register_batch_json(const journal_snapshot& snapshot,
+          const std::vector<register_batch_item>& items, content_encoding encoding,
+          http::body_writer& writer);
+      static bool is_native_register(const journal_snapshot& snapshot,
+          const std::list<std::string>& args, const std::list<std::string>& query,
+          posting_query& parsed);
+      bool run_native_register(const journal_snapshot& snapshot,
+          const std::list<std::string>& args, const std::list<std::string>& query,
+          std::list<post_result>& results);
+      std::size_t get_register_chunk_count(std::size_t rows) const;
+      void run_register_chunks(const posting_table& postings, const std::vector<uint32_t>& rows,
+          std::function<void(std::size_t chunk, std::size_t begin, std::size_t end,
+            int64_t total)> body);
+      bool run_register_json(const journal_snapshot& snapshot,
+          const std::list<std::string>& args, const std::list<std::string>& query,
+          std::string& json);
+      std::shared_ptr<const std::string> get_native_register_json(
+          const journal_snapshot& snapshot, const std::string& key,
+          const std::list<std::string>& args, const std::list<std::string>& query);
+      static bool summarize_native_register(const journal_snapshot& snapshot,
+          const posting_query& parsed, std::vector<uint32_t>& rows, posting_table& summary);
+      std::shared_ptr<const std::string> build_native_register_body(
+          const journal_snapshot& snapshot, const posting_query& parsed,
+          std::vector<uint32_t>& rows);
+      std::string build_native_register_json(const posting_table& postings,
+          const journal_names& names, const std::vector<uint32_t>& rows);
+      std::vector<std::shared_ptr<const std::string>> answer_native_registers(
+          const journal_snapshot& snapshot, const std::vector<std::string>& keys,
+          const std::vector<const posting_query*>& queries);
+      std::shared_ptr<const std::string> get_accounts_json(const journal_snapshot& snapshot,
+          const std::string& key);
+      static std::map<std::string, std::string> get_validators(const journal_snapshot& snapshot,
+          const std::string& key);
+      content_encoding get_response_encoding(const journal_snapshot& snapshot,
+          const std::string& key, content_encoding encoding);
+      static bool is_not_modified(const http::request& request,
+          const std::map<std::string, std::string>& validators,
+          const journal_snapshot& snapshot, content_encoding encoding);
+      static http::response build_not_modified(std::map<std::string, std::string> validators,
+          content_encoding encoding);
+      void encode_response(http::response& response, content_encoding encoding,
+          unsigned long long generation, const std::string& key);
+      static void set_encoding_headers(http::response& response, content_encoding encoding);
+      static std::string get_encoded_key(const std::string& key, content_encoding encoding);
+      static std::string get_encoded_etag(const std::string& etag, content_encoding encoding);
+      static std::string get_cache_key(const std::string& endpoint,
+          const std::list<std::list<std::string>>& parts);
+      void reload_journal();
       void reset_journal();
       virtual void reset_journal_or_throw();
-      std::list<std::string> get_balance_accounts(std::list<std::string> args);
+      virtual bool update_journal_or_throw();
+      bool append_journal_or_throw(const journal_snapshot& current);
+      bool reparse_journal_files_or_throw(const journal_snapshot& current,
+          const std::vector<journal_file_state>& files, const std::vector<bool>& is_changed);
+      void read_journal_or_throw(ledger::session_t& session,
+          boost::shared_ptr<std::istream> stream, const boost::filesystem::path& path);
+      static void remove_xacts(ledger::journal_t& journal,
+          ledger::xacts_list::iterator begin, ledger::xacts_list::iterator end);
+      std::list<journal_file_state> get_journal_file_states();
+      void publish_snapshot(std::shared_ptr<ledger::session_t> session);
+      void write_snapshot_file(const journal_snapshot& snapshot);
+      void queue_snapshot_file(std::shared_ptr<const journal_snapshot> loaded);
+      void write_pending_snapshot_files();
+      static posting_table get_posting_table(ledger::journal_t& journal,
+          std::unordered_map<const ledger::account_t*, uint32_t>& account_ids,
+          std::unordered_map<const ledger::xact_t*, uint32_t>& payee_ids);
+      static std::shared_ptr<journal_names> get_journal_names(const posting_table& postings);
+      std::list<std::string> get_balance_accounts(ledger::session_t& session,
+          std::list<std::string> args);
+      std::shared_ptr<const journal_snapshot> get_snapshot();
+      std::shared_ptr<const journal_snapshot> get_loaded_snapshot();
+
+      class default_scope_guard {
+        public:
+          default_scope_guard(ledger::scope_t* scope)
+            : previous(ledger::scope_t::default_scope) {
+            ledger::scope_t::default_scope = scope;
+          }
+          default_scope_guard(const default_scope_guard&) = delete;
+          default_scope_guard& operator=(const default_scope_guard&) = delete;
+          ~default_scope_guard() {
+            ledger::scope_t::default_scope = previous;
+          }
+
+        private:
+          ledger::scope_t* previous;
+      };
 
       class post_capturer : public ledger::item_handler<ledger::post_t> {
         public:
@@ -98,10 +317,36 @@ namespace ledger_rest {
           virtual void clear();
           std::list<post_result> get_post_results();
 
+        protected:
+          post_result get_post_result(ledger::post_t& post);
+
         private:
           std::list<post_result> result_capture;
       };
 
+      // Writes each post as JSON as soon as ledger reports it. Names found
+      // in names are copied already escaped.
+      class post_writer : public post_capturer {
+        public:
+          // journal_revision is read as ledger reports each post, under
+          // ledger_mutex.
+          post_writer(http::body_writer& writer, const journal_names* names,
+              const unsigned long long& journal_revision)
+            : post_capturer(), writer(writer), names(names),
+            journal_revision(journal_revision), buffer(flush_size + 1024), is_first(true) { }
+          virtual ~post_writer() { }
+          virtual void flush();
+          virtual void operator()(ledger::post_t& post);
+
+        private:
+          static const std::size_t flush_size = 16 * 1024;
+          http::body_writer& writer;
+          const journal_names* names;
+          const unsigned long long& journal_revision;
+          json_writer buffer;
+          bool is_first;
+      };
+
       class account_capturer : public ledger::item_handler<ledger::account_t> {
         public:
           account_capturer() : ledger::item_handler<ledger::account_t>() { }
@@ -114,5 +359,9 @@ namespace ledger_rest {
         private:
           std::list<std::string> result_capture;
       };
+
+    private:
+      // Only accessed through std::atomic_load and std::atomic_store.
+      std::shared_ptr<const journal_snapshot> snapshot;
   };
 }
@@ -33,5 +33,11 @@ namespace ledger_rest {
     public:
       virtual std::string get_ledger_file_path() = 0;
       virtual std::string get_ledger_rest_prefix() = 0;
+      virtual int get_reload_delay() = 0;
+      virtual std::string get_snapshot_path() = 0;
+      virtual int get_cache_size() = 0;
+      virtual int get_compression_level() = 0;
+      virtual int get_compression_min_size() = 0;
+      virtual int get_batch_window() = 0;
   };
 }
@@ -25,9 +25,12 @@
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //
 
+#include <algorithm>
+#include <climits>
 #include <stdexcept>
+#include <sys/epoll.h>
 #include <sys/inotify.h>
-#include <sys/select.h>
+#include <unistd.h>
 #include <utility>
 
 #include "ledger_rest_runnable.h"
@@ -35,9 +38,33 @@
 namespace ledger_rest {
   ledger_rest_runnable::ledger_rest_runnable(
       ::ledger_rest::ledger_rest_args& args,
-      ::ledger_rest::logger& logger
-      ) : ::ledger_rest::ledger_rest(args, logger), update_fd(-1) {
+      ::ledger_rest::logger& logger,
+      thread_pool* pool
+      ) : ::ledger_rest::ledger_rest(args, logger, pool), is_reload_requested(false),
+      is_stopping(false), reload_delay(args.get_reload_delay()), loop(NULL), reload_timer(0),
+      update_fd(-1) {
+      update_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+      if (update_fd == -1) {
+        lr_logger.log(5, "Could not create ledger file update fd.");
+      }
       ::ledger_rest::ledger_rest::lazy_reload_journal();
+      load_snapshot_file();
+
+      reload_thread = std::thread(&ledger_rest_runnable::reload, this);
+  }
+
+  ledger_rest_runnable::~ledger_rest_runnable() {
+    {
+      std::lock_guard<std::mutex> lock(reload_mutex);
+      is_stopping = true;
+    }
+    reload_cv.notify_one();
+    reload_thread.join();
+
+    if (update_fd != -1) {
+      unwatch_journal_files();
+      close(update_fd);
+    }
   }
 
   http::response ledger_rest_runnable::respond(http::request request) {
@@ -45,46 +72,104 @@ namespace ledger_rest {
   }
 
   void ledger_rest_runnable::reset_journal_or_throw() {
-    ::ledger_rest::ledger_rest::reset_journal_or_throw();
-    set_update_fd();
+    try {
+      ::ledger_rest::ledger_rest::reset_journal_or_throw();
+
+    } catch (...) {
+      // Keep watching so that fixing the journal triggers another reload.
+      watch_journal_files();
+      throw;
+    }
+    watch_journal_files();
   }
 
-  void ledger_rest_runnable::run_from_select(const fd_set* read_fd_set,
-      const fd_set* write_fd_set, const fd_set* except_fd_set) {
-    if (FD_ISSET(update_fd, read_fd_set)) {
-      // Do not trigger inotify on lazy reload.
-      unset_update_fd();
-      ::ledger_rest::ledger_rest::lazy_reload_journal();
+  bool ledger_rest_runnable::update_journal_or_throw() {
+    bool is_updated = ::ledger_rest::ledger_rest::update_journal_or_throw();
+    if (is_updated) {
+      watch_journal_files();
     }
+    return is_updated;
   }
 
-  int ledger_rest_runnable::set_fdsets(fd_set* read_fd_set,
-      fd_set* write_fd_set, fd_set* except_fd_set) {
+  void ledger_rest_runnable::register_fds(event_loop& loop) {
+    this->loop = &loop;
     if (update_fd != -1) {
-      FD_SET(update_fd, read_fd_set);
+      loop.add_fd(update_fd, EPOLLIN | EPOLLET, this);
     }
-    return update_fd;
   }
 
-  unsigned long long ledger_rest_runnable::get_select_timeout() {
-    return 1000LL * 60LL * 60LL;
+  void ledger_rest_runnable::run_from_poll(int fd, uint32_t events) {
+    if (fd == update_fd && drain_update_fd()) {
+      // Reload once no change has been seen for reload_delay so that a burst
+      // of writes, e.g. from a sync client, causes one reload.
+      if (reload_timer != 0) {
+        loop->cancel_timer(reload_timer);
+      }
+      reload_timer = loop->add_timer(reload_delay, [this]() {
+        reload_timer = 0;
+        request_reload();
+      });
+    }
   }
 
-  void ledger_rest_runnable::set_update_fd() {
-    update_wds.clear();
-    update_fd = -1;
+  void ledger_rest_runnable::request_reload() {
+    {
+      std::lock_guard<std::mutex> lock(reload_mutex);
+      is_reload_requested = true;
+    }
+    reload_cv.notify_one();
+  }
 
-    auto watch_files = get_journal_include_files();
-    watch_files.push_back(ledger_file);
+  // Journals are parsed here so that requests keep being answered from the
+  // current snapshot while a new one is loaded. Requests that arrive during a
+  // reload coalesce into the next one.
+  void ledger_rest_runnable::reload() {
+    {
+      // A request may have already done the initial load. A snapshot from
+      // the snapshot file still needs the journal to be parsed.
+      std::lock_guard<std::mutex> lock(load_mutex);
+      std::shared_ptr<const journal_snapshot> current(get_snapshot());
+      if (!current || !current->session) {
+        reset_journal();
+      }
+    }
+
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(reload_mutex);
+        reload_cv.wait(lock, [this]() { return is_stopping || is_reload_requested; });
+        if (is_stopping)
+          return;
+        is_reload_requested = false;
+      }
+
+      std::lock_guard<std::mutex> lock(load_mutex);
+      reload_journal();
+    }
+  }
+
+  void ledger_rest_runnable::run_from_timeout() {
+  }
 
-    update_fd = inotify_init();
+  unsigned long long ledger_rest_runnable::get_poll_timeout() {
+    return ULLONG_MAX;
+  }
+
+  void ledger_rest_runnable::watch_journal_files() {
     if (update_fd == -1) {
-      lr_logger.log(5, "Could not create ledger file update fd.");
       return;
     }
 
+    std::lock_guard<std::mutex> lock(watch_mutex);
+    remove_watches();
+
+    auto watch_files = get_journal_include_files();
+    watch_files.push_back(ledger_file);
+
     for (auto iter = watch_files.cbegin(); iter != watch_files.cend(); iter++) {
-      int update_wd = inotify_add_watch(update_fd, iter->c_str(), IN_MODIFY|IN_MOVED_TO|IN_CLOSE);
+      // Reading the journal closes it too so IN_CLOSE_NOWRITE is not watched.
+      int update_wd = inotify_add_watch(update_fd, iter->c_str(),
+          IN_MODIFY|IN_MOVED_TO|IN_CLOSE_WRITE|IN_MOVE_SELF|IN_DELETE_SELF);
       if (update_wd == -1) {
         lr_logger.log(5, "Could not create ledger file watch fd.");
       } else {
@@ -93,14 +178,39 @@ namespace ledger_rest {
     }
   }
 
-  void ledger_rest_runnable::unset_update_fd() {
-    if (update_fd != -1) {
-      for (auto iter = update_wds.cbegin(); iter != update_wds.cend(); iter++) {
-        inotify_rm_watch(update_fd, *iter);
+  void ledger_rest_runnable::unwatch_journal_files() {
+    std::lock_guard<std::mutex> lock(watch_mutex);
+    remove_watches();
+  }
+
+  void ledger_rest_runnable::remove_watches() {
+    for (auto iter = update_wds.cbegin(); iter != update_wds.cend(); iter++) {
+      inotify_rm_watch(update_fd, *iter);
+    }
+    update_wds.clear();
+  }
+
+  // The fd is edge triggered so it must be read until empty. Returns true if
+  // any event belongs to a current watch; removing a watch queues IN_IGNORED
+  // and events for watches that are already gone must not cause a reload.
+  bool ledger_rest_runnable::drain_update_fd() {
+    char buffer[4096]
+      __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+
+    std::lock_guard<std::mutex> lock(watch_mutex);
+    ssize_t length;
+    while ((length = read(update_fd, buffer, sizeof(buffer))) > 0) {
+      for (char* ptr = buffer; ptr < buffer + length; ) {
+        const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(ptr);
+        if (!(event->mask & IN_IGNORED) &&
+            std::find(update_wds.cbegin(), update_wds.cend(), event->wd) != update_wds.cend()) {
+          changed = true;
+        }
+        ptr += sizeof(struct inotify_event) + event->len;
       }
-      close(update_fd);
-      update_wds.clear();
-      update_fd = -1;
     }
+
+    return changed;
   }
 }
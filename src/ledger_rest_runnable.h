@@ -28,34 +28,56 @@
 
 #include <unordered_map>
 #include <list>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 
 #include "ledger_rest_args.h"
 #include "ledger_rest.h"
 #include "logger.h"
 #include "runnable.h"
 #include "responder.h"
+#include "thread_pool.h"
 
 namespace ledger_rest {
   class ledger_rest_runnable : public ::ledger_rest::ledger_rest, public runnable, public responder {
     public:
-      ledger_rest_runnable(::ledger_rest::ledger_rest_args& args, ::ledger_rest::logger& logger);
+      ledger_rest_runnable(::ledger_rest::ledger_rest_args& args, ::ledger_rest::logger& logger,
+          thread_pool* pool = NULL);
       ledger_rest_runnable(const ledger_rest_runnable&) = delete;
       ledger_rest_runnable& operator=(const ledger_rest_runnable&) = delete;
       ledger_rest_runnable (ledger_rest_runnable&&) = delete;
       ledger_rest_runnable& operator=(const ledger_rest_runnable&&) = delete;
-      virtual ~ledger_rest_runnable() { }
+      virtual ~ledger_rest_runnable();
 
       virtual http::response respond(http::request request);
       virtual void reset_journal_or_throw();
-      virtual void run_from_select(const fd_set* read_fd_set, const fd_set* write_fd_set,
-          const fd_set* except_fd_set);
-      virtual int set_fdsets(fd_set* read_fd_set, fd_set* write_fd_set, fd_set* except_fd_set);
-      virtual unsigned long long get_select_timeout();
+      virtual bool update_journal_or_throw();
+      virtual void register_fds(event_loop& loop);
+      virtual void run_from_poll(int fd, uint32_t events);
+      virtual void run_from_timeout();
+      virtual unsigned long long get_poll_timeout();
 
     private:
+      std::thread reload_thread;
+      std::mutex reload_mutex;
+      std::condition_variable reload_cv;
+      bool is_reload_requested;
+      bool is_stopping;
+      const unsigned long long reload_delay;
+      event_loop* loop;
+      unsigned long long reload_timer;
+      void request_reload();
+      void reload();
+
+      // Journals are reloaded off the event loop thread while inotify events
+      // are read on it.
+      std::mutex watch_mutex;
       std::list<int> update_wds;
       int update_fd;
-      void set_update_fd();
-      void unset_update_fd();
+      void watch_journal_files();
+      void unwatch_journal_files();
+      void remove_watches();
+      bool drain_update_fd();
   };
 }
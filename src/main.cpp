@@ -35,15 +35,18 @@
 #include "ledger_rest_runnable.h"
 #include "runnable.h"
 #include "stderr_logger.h"
+#include "thread_pool.h"
 #include "signal_handler.h"
 
 int main(int argc, char** argv) {
   ledger_rest::args args(argc, argv);
 
   ledger_rest::stderr_logger logger(args.get_log_level());
-  ledger_rest::ledger_rest_runnable ledger(args, logger);
+  // Before ledger, which splits native registers across the pool.
+  ledger_rest::thread_pool pool(args.get_worker_threads(), logger);
+  ledger_rest::ledger_rest_runnable ledger(args, logger, &pool);
 
-  ledger_rest::mhd mhd(args, logger, ledger);
+  ledger_rest::mhd mhd(args, logger, ledger, pool);
 
   std::list<ledger_rest::runnable*> runners{ &mhd, &ledger };
   ledger_rest::runner runner(logger, runners);
@@ -33,16 +33,30 @@
 #include <termios.h>
 #include <sys/unistd.h>
 #include <arpa/inet.h>
+#include <sys/epoll.h>
 
 #include "mhd.h"
 
 namespace ledger_rest {
+  namespace {
+    // Most a streamed response buffers ahead of the client, and how much
+    // MHD asks for at a time.
+    const std::size_t stream_buffer_size = 256 * 1024;
+    const std::size_t stream_block_size = 32 * 1024;
+
+    struct stream_context {
+      std::shared_ptr<stream_buffer> stream;
+      struct MHD_Connection* connection;
+    };
+  }
+
   mhd::mhd(mhd_args& args, ::ledger_rest::logger& logger,
-      ::ledger_rest::responder& responder)
-    : logger(logger), responder(responder), port(args.get_port()),
+      ::ledger_rest::responder& responder, thread_pool& pool)
+    : logger(logger), responder(responder), pool(pool), dispatch_count(0), is_stopping(false),
+      port(args.get_port()),
       key(args.get_key()), cert(args.get_cert()),
       client_cert(args.get_client_cert()), user_pass(args.get_user_pass()),
-      address(args.get_address()) {
+      address(args.get_address()), connection_limit(args.get_connection_limit()) {
     start_daemon(&daemon);
     if (NULL == daemon) {
       throw std::runtime_error("Could not create MHD daemon.");
@@ -50,28 +64,45 @@ namespace ledger_rest {
   }
 
   mhd::~mhd() {
+    // Every dispatched request resumes its connection when it finishes and
+    // MHD must not be stopped with connections still suspended.
+    // Streams are cancelled since their clients can no longer be served,
+    // as are any that start from here on.
+    std::unique_lock<std::mutex> lock(dispatch_mutex);
+    is_stopping = true;
+    for (stream_buffer* stream : streams) {
+      stream->cancel();
+    }
+    dispatch_cv.wait(lock, [this]() { return dispatch_count == 0; });
     MHD_stop_daemon(daemon);
   }
 
-  void mhd::run_from_select(const fd_set* read_fd_set, const fd_set* write_fd_set,
-      const fd_set* except_fd_set) {
-    int status = MHD_run_from_select(daemon, read_fd_set, write_fd_set, except_fd_set);
+  void mhd::register_fds(event_loop& loop) {
+    const union MHD_DaemonInfo* info = MHD_get_daemon_info(daemon, MHD_DAEMON_INFO_EPOLL_FD);
+    if (info == NULL)
+      throw std::runtime_error("Could not get MHD epoll fd.");
 
-    if (status == MHD_NO)
-      throw std::runtime_error("MHD run failed.");
+    // Level triggered: MHD_run only drains a bounded number of events, so
+    // leftover readiness on its epoll fd has to wake us up again.
+    loop.add_fd(info->epoll_fd, EPOLLIN, this);
+  }
+
+  void mhd::run_from_poll(int fd, uint32_t events) {
+    run();
+  }
+
+  void mhd::run_from_timeout() {
+    run();
   }
 
-  int mhd::set_fdsets(fd_set* read_fd_set, fd_set* write_fd_set,
-      fd_set* except_fd_set) {
-    int max_fd;
-    int status = MHD_get_fdset(daemon, read_fd_set, write_fd_set, except_fd_set,
-        &max_fd);
+  void mhd::run() {
+    int status = MHD_run(daemon);
+
     if (status == MHD_NO)
-      throw std::runtime_error("Could not set fdsets.");
-    return max_fd;
+      throw std::runtime_error("MHD run failed.");
   }
 
-  unsigned long long mhd::get_select_timeout() {
+  unsigned long long mhd::get_poll_timeout() {
     unsigned long long timeout;
     int status = MHD_get_timeout(daemon, &timeout);
     if (status == MHD_NO)
@@ -88,10 +119,11 @@ namespace ledger_rest {
 
     if (cert.size() == 0 || key.size() == 0) {
       logger.log(5, "HTTP Mode");
-      *d = MHD_start_daemon(MHD_NO_FLAG,
+      *d = MHD_start_daemon(MHD_USE_EPOLL | MHD_ALLOW_SUSPEND_RESUME,
           0, NULL, NULL,
           &answer_callback_no_auth, this,
           MHD_OPTION_NOTIFY_COMPLETED, &request_completed_callback, NULL,
+          MHD_OPTION_CONNECTION_LIMIT, (unsigned int)connection_limit,
           MHD_OPTION_SOCK_ADDR, &sock_address,
           MHD_OPTION_END);
 
@@ -101,7 +133,7 @@ namespace ledger_rest {
       std::string key_pass(get_password());
 #endif
 
-      *d = MHD_start_daemon(MHD_USE_SSL,
+      *d = MHD_start_daemon(MHD_USE_SSL | MHD_USE_EPOLL | MHD_ALLOW_SUSPEND_RESUME,
           0, NULL, NULL,
           &answer_callback_auth, this,
           MHD_OPTION_SOCK_ADDR, &sock_address,
@@ -112,6 +144,7 @@ namespace ledger_rest {
           MHD_OPTION_HTTPS_MEM_KEY, key.c_str(),
           MHD_OPTION_HTTPS_CRED_TYPE, GNUTLS_CRD_CERTIFICATE,
           MHD_OPTION_NOTIFY_COMPLETED, &request_completed_callback, NULL,
+          MHD_OPTION_CONNECTION_LIMIT, (unsigned int)connection_limit,
           MHD_OPTION_END);
 
     } else {
@@ -120,7 +153,7 @@ namespace ledger_rest {
       std::string key_pass(get_password());
 #endif
 
-      *d = MHD_start_daemon(MHD_USE_SSL,
+      *d = MHD_start_daemon(MHD_USE_SSL | MHD_USE_EPOLL | MHD_ALLOW_SUSPEND_RESUME,
           0, NULL, NULL,
           &answer_callback_auth, this,
           MHD_OPTION_SOCK_ADDR, &sock_address,
@@ -132,6 +165,7 @@ namespace ledger_rest {
           MHD_OPTION_HTTPS_CRED_TYPE, GNUTLS_CRD_CERTIFICATE,
           MHD_OPTION_HTTPS_MEM_TRUST, client_cert.c_str(),
           MHD_OPTION_NOTIFY_COMPLETED, &request_completed_callback, NULL,
+          MHD_OPTION_CONNECTION_LIMIT, (unsigned int)connection_limit,
           MHD_OPTION_END);
     }
   };
@@ -147,9 +181,10 @@ namespace ledger_rest {
     MHD_Result ret;
 
     if (*con_cls == NULL) {
-      struct con_info* conn = (struct con_info*)malloc(sizeof(struct con_info));
+      struct con_info* conn = new con_info();
       conn->response = NULL;
       conn->call_count = 0;
+      conn->is_dispatched = false;
       *con_cls = conn;
       return MHD_YES;
 
@@ -157,38 +192,25 @@ namespace ledger_rest {
       struct con_info* conn = (struct con_info*)(*con_cls);
       conn->call_count = conn->call_count + 1;
 
-      const char *page  = "<html><body>Unauthorized</body></html>";
-      struct MHD_Response* unauthorized_response =
-        MHD_create_response_from_buffer(strlen(page), (void*)page, MHD_RESPMEM_PERSISTENT);
-
       mhd* mhd_obj = static_cast<mhd*>(cls);
 
       if (mhd_obj->client_cert.size() > 0 && !verify_certificate(mhd_obj, connection)) {
-          ret = MHD_queue_response(connection, MHD_HTTP_UNAUTHORIZED, unauthorized_response);
+        const char *page  = "<html><body>Unauthorized</body></html>";
+        struct MHD_Response* unauthorized_response =
+          MHD_create_response_from_buffer(strlen(page), (void*)page, MHD_RESPMEM_PERSISTENT);
+        ret = MHD_queue_response(connection, MHD_HTTP_UNAUTHORIZED, unauthorized_response);
+        MHD_destroy_response(unauthorized_response);
 
       } else if (mhd_obj->user_pass.size() > 0 && !verify_user_pass(mhd_obj, connection)) {
-          ret = MHD_queue_basic_auth_fail_response(connection, "", unauthorized_response);
-      } else {
-        if (conn->response == NULL) {
-          http::request request(build_request(connection, url, method, upload_data, *upload_data_size));
-          http::response* response = new http::response(mhd_obj->responder.respond(request));
-          conn->response = response;
-        }
-
-        if (*upload_data_size != 0) {
-          *upload_data_size = 0;
-          return MHD_YES;
-        }
-
-        const char* page = conn->response->body.c_str();
-        struct MHD_Response *mhd_response =
-          MHD_create_response_from_buffer(strlen(page), (void*)page, MHD_RESPMEM_MUST_COPY);
-        ret = MHD_queue_response(connection, conn->response->status_code, mhd_response);
-        MHD_destroy_response(mhd_response);
+        const char *page  = "<html><body>Unauthorized</body></html>";
+        struct MHD_Response* unauthorized_response =
+          MHD_create_response_from_buffer(strlen(page), (void*)page, MHD_RESPMEM_PERSISTENT);
+        ret = MHD_queue_basic_auth_fail_response(connection, "", unauthorized_response);
+        MHD_destroy_response(unauthorized_response);
 
+      } else {
+        ret = mhd_obj->answer(connection, url, method, upload_data, upload_data_size, conn);
       }
-      MHD_destroy_response(unauthorized_response);
-
     }
 
     return ret;
@@ -203,9 +225,10 @@ namespace ledger_rest {
       size_t* upload_data_size,
       void** con_cls) {
     if (*con_cls == NULL) {
-      struct con_info* conn = (struct con_info*)malloc(sizeof(struct con_info));
+      struct con_info* conn = new con_info();
       *con_cls = conn;
       conn->call_count = 0;
+      conn->is_dispatched = false;
       conn->response = NULL;
       return MHD_YES;
 
@@ -214,24 +237,182 @@ namespace ledger_rest {
       conn->call_count = conn->call_count + 1;
 
       mhd* mhd_obj = static_cast<mhd*>(cls);
-      if (conn->response == NULL) {
-        http::request request(build_request(connection, url, method, upload_data, *upload_data_size));
-        http::response* response = new http::response(mhd_obj->responder.respond(request));
+      return mhd_obj->answer(connection, url, method, upload_data, upload_data_size, conn);
+    }
+  }
+
+  MHD_Result mhd::answer(struct MHD_Connection* connection,
+      const char* url,
+      const char* method,
+      const char* upload_data,
+      size_t* upload_data_size,
+      struct con_info* conn) {
+    if (*upload_data_size != 0) {
+      conn->upload_data.append(upload_data, *upload_data_size);
+      *upload_data_size = 0;
+      return MHD_YES;
+    }
+
+    if (conn->response == NULL) {
+      if (!conn->is_dispatched) {
+        dispatch(connection, url, method, conn);
+      }
+      return MHD_YES;
+    }
+
+    struct MHD_Response *mhd_response;
+    if (conn->stream) {
+      // Without a size MHD uses chunked transfer encoding.
+      stream_context* context = new stream_context();
+      context->stream = conn->stream;
+      context->connection = connection;
+      mhd_response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, stream_block_size,
+          &stream_reader_callback, context, &stream_free_callback);
+
+    } else {
+      const std::string& page = *conn->response->body;
+#if MHD_VERSION >= 0x00097300
+      // MHD holds a reference to the body until it has been sent, so a
+      // cached body goes to the socket without being copied.
+      std::shared_ptr<const std::string>* body
+        = new std::shared_ptr<const std::string>(conn->response->body);
+      mhd_response = MHD_create_response_from_buffer_with_free_callback_cls(page.size(),
+          page.data(), &body_free_callback, body);
+#else
+      mhd_response = MHD_create_response_from_buffer(page.size(), (void*)page.data(),
+          MHD_RESPMEM_MUST_COPY);
+#endif
+    }
+    for (auto iter = conn->response->headers.cbegin();
+        iter != conn->response->headers.cend(); iter++) {
+      MHD_add_response_header(mhd_response, iter->first.c_str(), iter->second.c_str());
+    }
+    MHD_Result ret = MHD_queue_response(connection, conn->response->status_code, mhd_response);
+    MHD_destroy_response(mhd_response);
+    return ret;
+  }
+
+  // The responder runs on the worker pool while the connection is suspended
+  // so that a slow query does not hold up the event loop. The worker resumes
+  // the connection and MHD calls back into answer to queue the response.
+  void mhd::dispatch(struct MHD_Connection* connection, const char* url, const char* method,
+      struct con_info* conn) {
+    http::request request(build_request(connection, url, method,
+          conn->upload_data.data(), conn->upload_data.size()));
+    conn->is_dispatched = true;
+    MHD_suspend_connection(connection);
+
+    {
+      std::lock_guard<std::mutex> lock(dispatch_mutex);
+      dispatch_count++;
+    }
+
+    pool.submit([this, connection, conn, request]() {
+      http::response* response;
+      try {
+        response = new http::response(responder.respond(request));
+
+      } catch (const std::exception& e) {
+        logger.log(5, std::string("Error while responding to request: ") + e.what());
+        response = new http::response(http::status_code::INTERNAL_SERVER_ERROR,
+            std::string(""), std::map<std::string, std::string>());
+
+      } catch (...) {
+        logger.log(5, "Unknown error while responding to request.");
+        response = new http::response(http::status_code::INTERNAL_SERVER_ERROR,
+            std::string(""), std::map<std::string, std::string>());
+      }
+
+      if (response->producer) {
+        produce(connection, conn, response);
+
+      } else {
         conn->response = response;
+        MHD_resume_connection(connection);
       }
 
-      if (*upload_data_size != 0) {
-        *upload_data_size = 0;
-        return MHD_YES;
+      {
+        std::lock_guard<std::mutex> lock(dispatch_mutex);
+        dispatch_count--;
       }
+      dispatch_cv.notify_all();
+    });
+  }
 
-      const char* page = conn->response->body.c_str();
-      struct MHD_Response *mhd_response =
-        MHD_create_response_from_buffer(strlen(page), (void*)page, MHD_RESPMEM_MUST_COPY);
-      MHD_Result ret = MHD_queue_response(connection, conn->response->status_code, mhd_response);
-      MHD_destroy_response(mhd_response);
-      return ret;
+  // Streamed responses are produced on the worker while MHD sends what has
+  // been produced so far. The worker waits if the client falls behind.
+  void mhd::produce(struct MHD_Connection* connection, struct con_info* conn,
+      http::response* response) {
+    std::shared_ptr<stream_buffer> stream = std::make_shared<stream_buffer>(stream_buffer_size,
+        [connection]() { MHD_resume_connection(connection); });
+    bool is_skipped;
+    {
+      std::lock_guard<std::mutex> lock(dispatch_mutex);
+      streams.insert(stream.get());
+      is_skipped = is_stopping;
     }
+
+    // Once resumed the connection, and with it conn and response, may be
+    // freed at any time.
+    http::body_producer producer(response->producer);
+    conn->stream = stream;
+    conn->response = response;
+    MHD_resume_connection(connection);
+
+    try {
+      // The event loop that would drain the stream has stopped.
+      if (is_skipped) {
+        stream->cancel();
+        stream->close(true);
+
+      } else {
+        producer(*stream);
+        stream->close();
+      }
+
+    } catch (const std::exception& e) {
+      logger.log(5, std::string("Error while streaming response: ") + e.what());
+      stream->close(true);
+
+    } catch (...) {
+      logger.log(5, "Unknown error while streaming response.");
+      stream->close(true);
+    }
+
+    std::lock_guard<std::mutex> lock(dispatch_mutex);
+    streams.erase(stream.get());
+  }
+
+  // Runs on the event loop thread. When nothing has been produced yet the
+  // connection is suspended rather than returning 0 repeatedly; the stream
+  // resumes it once there is more.
+  ssize_t mhd::stream_reader_callback(void* cls, uint64_t pos, char* buffer, size_t max) {
+    stream_context* context = static_cast<stream_context*>(cls);
+    struct MHD_Connection* connection = context->connection;
+    std::size_t size;
+    switch (context->stream->read(buffer, max, size,
+          [connection]() { MHD_suspend_connection(connection); })) {
+      case stream_buffer::DATA:
+        return size;
+      case stream_buffer::WAITING:
+        return 0;
+      case stream_buffer::END:
+        return MHD_CONTENT_READER_END_OF_STREAM;
+      default:
+        return MHD_CONTENT_READER_END_WITH_ERROR;
+    }
+  }
+
+  void mhd::body_free_callback(void* cls) {
+    delete static_cast<std::shared_ptr<const std::string>*>(cls);
+  }
+
+  // The response is done with, possibly because the client went away, so
+  // the producer should stop.
+  void mhd::stream_free_callback(void* cls) {
+    stream_context* context = static_cast<stream_context*>(cls);
+    context->stream->cancel();
+    delete context;
   }
 
   bool mhd::verify_user_pass(mhd* mhd_obj, struct MHD_Connection* connection) {
@@ -353,7 +534,7 @@ namespace ledger_rest {
       if (conn->response != NULL) {
         delete conn->response;
       }
-      free(*con_cls);
+      delete conn;
     }
   }
 
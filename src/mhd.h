@@ -26,8 +26,12 @@
 
 #pragma once
 
+#include <condition_variable>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_set>
 #include <microhttpd.h>
 #include <gnutls/gnutls.h>
 #include <gnutls/x509.h>
@@ -37,24 +41,30 @@
 #include "runnable.h"
 #include "http.h"
 #include "responder.h"
+#include "stream_buffer.h"
+#include "thread_pool.h"
 
 namespace ledger_rest {
+  struct con_info;
+
   class mhd : public runnable {
     public:
-      mhd(mhd_args& args, ::ledger_rest::logger& logger, ledger_rest::responder& responder);
+      mhd(mhd_args& args, ::ledger_rest::logger& logger, ledger_rest::responder& responder,
+          thread_pool& pool);
       mhd(const mhd&) = delete;
       mhd& operator=(const mhd&) = delete;
       mhd (mhd&&) = delete;
       mhd& operator=(const mhd&&) = delete;
       virtual ~mhd();
 
-      void run_from_select(const fd_set* read_fd_set, const fd_set* write_fd_set,
-          const fd_set* except_fd_set);
-      int set_fdsets(fd_set* read_fd_set, fd_set* write_fd_set, fd_set* except_fd_set);
-      unsigned long long get_select_timeout();
+      void register_fds(event_loop& loop);
+      void run_from_poll(int fd, uint32_t events);
+      void run_from_timeout();
+      unsigned long long get_poll_timeout();
 
       const int port;
       const std::string address;
+      const int connection_limit;
       const std::string key;
       const std::string cert;
       const std::string client_cert;
@@ -63,7 +73,17 @@ namespace ledger_rest {
     private:
       ::ledger_rest::logger& logger;
       ledger_rest::responder& responder;
+      thread_pool& pool;
       struct MHD_Daemon* daemon;
+      std::mutex dispatch_mutex;
+      std::condition_variable dispatch_cv;
+      int dispatch_count;
+      // Set once the destructor has started. Guarded by dispatch_mutex.
+      bool is_stopping;
+      // Streamed responses still being produced. Guarded by dispatch_mutex.
+      std::unordered_set<stream_buffer*> streams;
+
+      void run();
 
       static MHD_Result answer_callback_auth(void *cls,
           struct MHD_Connection* connection,
@@ -88,6 +108,20 @@ namespace ledger_rest {
           void **con_cls,
           enum MHD_RequestTerminationCode toe);
 
+      MHD_Result answer(struct MHD_Connection* connection,
+          const char* url,
+          const char* method,
+          const char* upload_data,
+          size_t* upload_data_size,
+          struct con_info* conn);
+      void dispatch(struct MHD_Connection* connection, const char* url, const char* method,
+          struct con_info* conn);
+      void produce(struct MHD_Connection* connection, struct con_info* conn,
+          http::response* response);
+      static ssize_t stream_reader_callback(void* cls, uint64_t pos, char* buffer, size_t max);
+      static void stream_free_callback(void* cls);
+      static void body_free_callback(void* cls);
+
       static http::request build_request(struct MHD_Connection* connection,
           const char* url, const char* method, const char* upload_data, size_t upload_size);
       static std::map<std::string, std::string> get_headers(struct MHD_Connection* connection);
@@ -109,6 +143,9 @@ namespace ledger_rest {
 
   struct con_info {
     int call_count;
+    bool is_dispatched;
+    std::string upload_data;
     http::response* response;
+    std::shared_ptr<stream_buffer> stream;
   };
 }
@@ -0,0 +1,302 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include <algorithm>
+#include <iterator>
+
+#include "posting_bitmap.h"
+
+namespace ledger_rest {
+  const std::size_t posting_bitmap::max_array_size;
+  const std::size_t posting_bitmap::bitset_words;
+
+  namespace {
+    inline uint32_t count_bits(uint64_t word) {
+      return static_cast<uint32_t>(__builtin_popcountll(word));
+    }
+  }
+
+  bool posting_bitmap::container::contains(uint16_t low) const {
+    if (is_bitset()) {
+      return (bits[low >> 6] >> (low & 63)) & 1;
+    }
+    return std::binary_search(array.cbegin(), array.cend(), low);
+  }
+
+  void posting_bitmap::container::to_bitset() {
+    if (is_bitset()) {
+      return;
+    }
+    bits.assign(bitset_words, 0);
+    for (uint16_t low : array) {
+      bits[low >> 6] |= uint64_t(1) << (low & 63);
+    }
+    std::vector<uint16_t>().swap(array);
+  }
+
+  void posting_bitmap::container::normalize() {
+    if (!is_bitset() || cardinality > max_array_size) {
+      return;
+    }
+    array.reserve(cardinality);
+    for (std::size_t i = 0; i < bits.size(); i++) {
+      for (uint64_t word = bits[i]; word != 0; word &= word - 1) {
+        array.push_back(static_cast<uint16_t>(i * 64 + __builtin_ctzll(word)));
+      }
+    }
+    std::vector<uint64_t>().swap(bits);
+  }
+
+  posting_bitmap posting_bitmap::range(uint32_t begin, uint32_t end) {
+    posting_bitmap bitmap;
+    while (begin < end) {
+      uint32_t key = begin >> 16;
+      uint32_t container_end = std::min<uint64_t>(end, (uint64_t(key) + 1) << 16);
+      container c;
+      c.key = static_cast<uint16_t>(key);
+      c.cardinality = container_end - begin;
+      if (c.cardinality > max_array_size) {
+        c.bits.assign(bitset_words, 0);
+        for (uint32_t row = begin; row < container_end; row++) {
+          c.bits[(row & 0xFFFF) >> 6] |= uint64_t(1) << (row & 63);
+        }
+      } else {
+        for (uint32_t row = begin; row < container_end; row++) {
+          c.array.push_back(static_cast<uint16_t>(row & 0xFFFF));
+        }
+      }
+      bitmap.containers.push_back(std::move(c));
+      begin = container_end;
+    }
+    return bitmap;
+  }
+
+  void posting_bitmap::add(uint32_t row) {
+    uint16_t key = static_cast<uint16_t>(row >> 16);
+    uint16_t low = static_cast<uint16_t>(row & 0xFFFF);
+    if (containers.empty() || containers.back().key != key) {
+      containers.push_back(container());
+      containers.back().key = key;
+    }
+
+    container& c = containers.back();
+    if (c.is_bitset()) {
+      uint64_t& word = c.bits[low >> 6];
+      uint64_t bit = uint64_t(1) << (low & 63);
+      if (!(word & bit)) {
+        word |= bit;
+        c.cardinality++;
+      }
+    } else if (c.array.empty() || c.array.back() < low) {
+      c.array.push_back(low);
+      c.cardinality++;
+      if (c.cardinality > max_array_size) {
+        c.to_bitset();
+      }
+    }
+  }
+
+  bool posting_bitmap::contains(uint32_t row) const {
+    uint16_t key = static_cast<uint16_t>(row >> 16);
+    auto c = std::lower_bound(containers.cbegin(), containers.cend(), key,
+        [](const container& c, uint16_t key) { return c.key < key; });
+    return c != containers.cend() && c->key == key
+      && c->contains(static_cast<uint16_t>(row & 0xFFFF));
+  }
+
+  std::size_t posting_bitmap::size() const {
+    std::size_t size = 0;
+    for (const container& c : containers) {
+      size += c.cardinality;
+    }
+    return size;
+  }
+
+  bool posting_bitmap::empty() const {
+    return containers.empty();
+  }
+
+  void posting_bitmap::get_rows(std::vector<uint32_t>& rows) const {
+    for (const container& c : containers) {
+      uint32_t high = uint32_t(c.key) << 16;
+      if (c.is_bitset()) {
+        for (std::size_t i = 0; i < c.bits.size(); i++) {
+          for (uint64_t word = c.bits[i]; word != 0; word &= word - 1) {
+            rows.push_back(high | static_cast<uint32_t>(i * 64 + __builtin_ctzll(word)));
+          }
+        }
+      } else {
+        for (uint16_t low : c.array) {
+          rows.push_back(high | low);
+        }
+      }
+    }
+  }
+
+  posting_bitmap::container posting_bitmap::intersect(const container& a, const container& b) {
+    container result;
+    result.key = a.key;
+    if (a.is_bitset() && b.is_bitset()) {
+      result.bits.resize(bitset_words);
+      for (std::size_t i = 0; i < bitset_words; i++) {
+        result.bits[i] = a.bits[i] & b.bits[i];
+        result.cardinality += count_bits(result.bits[i]);
+      }
+      result.normalize();
+
+    } else if (a.is_bitset() || b.is_bitset()) {
+      const container& array = a.is_bitset() ? b : a;
+      const container& bitset = a.is_bitset() ? a : b;
+      for (uint16_t low : array.array) {
+        if (bitset.contains(low)) {
+          result.array.push_back(low);
+        }
+      }
+      result.cardinality = static_cast<uint32_t>(result.array.size());
+
+    } else {
+      std::set_intersection(a.array.cbegin(), a.array.cend(), b.array.cbegin(), b.array.cend(),
+          std::back_inserter(result.array));
+      result.cardinality = static_cast<uint32_t>(result.array.size());
+    }
+    return result;
+  }
+
+  posting_bitmap::container posting_bitmap::unite(const container& a, const container& b) {
+    container result;
+    result.key = a.key;
+    if (!a.is_bitset() && !b.is_bitset() && a.cardinality + b.cardinality <= max_array_size) {
+      std::set_union(a.array.cbegin(), a.array.cend(), b.array.cbegin(), b.array.cend(),
+          std::back_inserter(result.array));
+      result.cardinality = static_cast<uint32_t>(result.array.size());
+      return result;
+    }
+
+    result = a;
+    result.to_bitset();
+    if (b.is_bitset()) {
+      for (std::size_t i = 0; i < bitset_words; i++) {
+        result.bits[i] |= b.bits[i];
+      }
+    } else {
+      for (uint16_t low : b.array) {
+        result.bits[low >> 6] |= uint64_t(1) << (low & 63);
+      }
+    }
+    result.cardinality = 0;
+    for (uint64_t word : result.bits) {
+      result.cardinality += count_bits(word);
+    }
+    result.normalize();
+    return result;
+  }
+
+  posting_bitmap::container posting_bitmap::subtract(const container& a, const container& b) {
+    container result;
+    result.key = a.key;
+    if (a.is_bitset()) {
+      result = a;
+      if (b.is_bitset()) {
+        for (std::size_t i = 0; i < bitset_words; i++) {
+          result.bits[i] &= ~b.bits[i];
+        }
+      } else {
+        for (uint16_t low : b.array) {
+          result.bits[low >> 6] &= ~(uint64_t(1) << (low & 63));
+        }
+      }
+      result.cardinality = 0;
+      for (uint64_t word : result.bits) {
+        result.cardinality += count_bits(word);
+      }
+      result.normalize();
+
+    } else {
+      for (uint16_t low : a.array) {
+        if (!b.contains(low)) {
+          result.array.push_back(low);
+        }
+      }
+      result.cardinality = static_cast<uint32_t>(result.array.size());
+    }
+    return result;
+  }
+
+  // The container lists are sorted by key and merged like sorted arrays.
+  posting_bitmap posting_bitmap::intersect(const posting_bitmap& a, const posting_bitmap& b) {
+    posting_bitmap result;
+    auto i = a.containers.cbegin();
+    auto j = b.containers.cbegin();
+    while (i != a.containers.cend() && j != b.containers.cend()) {
+      if (i->key < j->key) {
+        i++;
+      } else if (j->key < i->key) {
+        j++;
+      } else {
+        container c(intersect(*i++, *j++));
+        if (c.cardinality > 0) {
+          result.containers.push_back(std::move(c));
+        }
+      }
+    }
+    return result;
+  }
+
+  posting_bitmap posting_bitmap::unite(const posting_bitmap& a, const posting_bitmap& b) {
+    posting_bitmap result;
+    auto i = a.containers.cbegin();
+    auto j = b.containers.cbegin();
+    while (i != a.containers.cend() || j != b.containers.cend()) {
+      if (j == b.containers.cend() || (i != a.containers.cend() && i->key < j->key)) {
+        result.containers.push_back(*i++);
+      } else if (i == a.containers.cend() || j->key < i->key) {
+        result.containers.push_back(*j++);
+      } else {
+        result.containers.push_back(unite(*i++, *j++));
+      }
+    }
+    return result;
+  }
+
+  posting_bitmap posting_bitmap::subtract(const posting_bitmap& a, const posting_bitmap& b) {
+    posting_bitmap result;
+    auto j = b.containers.cbegin();
+    for (auto i = a.containers.cbegin(); i != a.containers.cend(); i++) {
+      while (j != b.containers.cend() && j->key < i->key) {
+        j++;
+      }
+      if (j != b.containers.cend() && j->key == i->key) {
+        container c(subtract(*i, *j));
+        if (c.cardinality > 0) {
+          result.containers.push_back(std::move(c));
+        }
+      } else {
+        result.containers.push_back(*i);
+      }
+    }
+    return result;
+  }
+}
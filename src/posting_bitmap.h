@@ -0,0 +1,79 @@
+/* * Copyright (c) 2015-2020 Chad Voegele
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *  * The name of Chad Voegele may not be used to endorse or promote products
+ * derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ledger_rest {
+  // A set of posting rows stored roaring style. Rows are split by their
+  // upper 16 bits into containers that hold either a sorted array of the
+  // lower 16 bits or, once that would be larger, a 65536 bit bitset.
+  class posting_bitmap {
+    public:
+      // Rows [begin, end).
+      static posting_bitmap range(uint32_t begin, uint32_t end);
+      static posting_bitmap intersect(const posting_bitmap& a, const posting_bitmap& b);
+      static posting_bitmap unite(const posting_bitmap& a, const posting_bitmap& b);
+      // Rows of a that are not in b.
+      static posting_bitmap subtract(const posting_bitmap& a, const posting_bitmap& b);
+
+      // Rows must be added in increasing order.
+      void add(uint32_t row);
+      bool contains(uint32_t row) const;
+      std::size_t size() const;
+      bool empty() const;
+      // Appends the rows in increasing order.
+      void get_rows(std::vector<uint32_t>& rows) const;
+
+    private:
+      static const std::size_t max_array_size = 4096;
+      static const std::size_t bitset_words = 65536 / 64;
+
+      struct container {
+        uint16_t key = 0;
+        uint32_t cardinality = 0;
+        // Exactly one of these is used.
+        std::vector<uint16_t> array;
+        std::vector<uint64_t> bits;
+
+        bool is_bitset() const { return !bits.empty(); }
+        bool contains(uint16_t low) const;
+        void to_bitset();
+        // Back to an array if it is small enough.
+        void normalize();
+      };
+
+      std::vector<container> containers;
+
+      static container intersect(const container& a, const container& b);
+      static container unite(const container& a, const container& b);
+      static container subtract(const container& a, const container& b);
+  };
+}
@@ -0,0 +1,741 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <iterator>
+#include <map>
+#include <regex>
+#include <set>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "posting_query.h"
+
+namespace ledger_rest {
+  namespace {
+    typedef posting_query::term term;
+
+    // Words with a meaning in ledger's query language.
+    const char* const query_keywords[] = {
+      "and", "or", "not", "code", "desc", "payee", "note", "tag", "meta", "data",
+      "expr", "show", "only", "bold", "for", "since", "until"
+    };
+
+    // Terms made only of these are regular expressions to ledger.
+    bool is_pattern(const std::string& token) {
+      if (token.empty()) {
+        return false;
+      }
+      for (const char* keyword : query_keywords) {
+        if (token == keyword) {
+          return false;
+        }
+      }
+      for (char c : token) {
+        if (!isalnum(static_cast<unsigned char>(c)) && static_cast<unsigned char>(c) < 0x80
+            && c != ':' && c != '_' && c != '-' && c != '.' && c != '*' && c != '+'
+            && c != '?' && c != '[' && c != ']' && c != '^') {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    // Parses the part of ledger's query language made of account patterns,
+    // "payee" patterns, "not", "and", "or" and terms next to each other,
+    // which are or'ed. "and" binds tighter than "or"; "not" and "payee"
+    // apply to the one pattern that follows them. A term next to a "not" or
+    // "payee" term is not accepted rather than relying on which term ledger
+    // applies them to.
+    class query_parser {
+      public:
+        query_parser(const std::list<std::string>& tokens, posting_query& query)
+          : tokens(tokens.cbegin(), tokens.cend()), position(0), query(query),
+          is_last_plain(false) { }
+        query_parser(const query_parser&) = delete;
+        query_parser& operator=(const query_parser&) = delete;
+        query_parser (query_parser&&) = delete;
+        query_parser& operator=(const query_parser&&) = delete;
+        ~query_parser() { }
+
+        bool parse() {
+          query.root = -1;
+          if (tokens.empty()) {
+            return true;
+          }
+          return parse_or(query.root) && position == tokens.size();
+        }
+
+      private:
+        const std::vector<std::string> tokens;
+        std::size_t position;
+        posting_query& query;
+        bool is_last_plain;
+
+        bool parse_or(int& node) {
+          if (!parse_and(node)) {
+            return false;
+          }
+          while (position < tokens.size()) {
+            if (tokens[position] == "or") {
+              position++;
+            } else if (!is_last_plain) {
+              return false;
+            }
+
+            int right;
+            if (!parse_and(right)) {
+              return false;
+            }
+            node = add_term(term::OR, std::string(), node, right);
+          }
+          return true;
+        }
+
+        bool parse_and(int& node) {
+          if (!parse_unary(node)) {
+            return false;
+          }
+          while (position < tokens.size() && tokens[position] == "and") {
+            position++;
+            int right;
+            if (!parse_unary(right)) {
+              return false;
+            }
+            node = add_term(term::AND, std::string(), node, right);
+          }
+          return true;
+        }
+
+        bool parse_unary(int& node) {
+          if (position < tokens.size() && tokens[position] == "not") {
+            position++;
+            int operand;
+            if (!parse_pattern(operand)) {
+              return false;
+            }
+            node = add_term(term::NOT, std::string(), operand, -1);
+            is_last_plain = false;
+            return true;
+          }
+          return parse_pattern(node);
+        }
+
+        bool parse_pattern(int& node) {
+          term::term_kind kind = term::ACCOUNT;
+          if (position < tokens.size() && tokens[position] == "payee") {
+            kind = term::PAYEE;
+            position++;
+          }
+          if (position == tokens.size() || !is_pattern(tokens[position])) {
+            return false;
+          }
+          node = add_term(kind, tokens[position++], -1, -1);
+          is_last_plain = (kind == term::ACCOUNT);
+          return true;
+        }
+
+        int add_term(term::term_kind kind, const std::string& pattern, int left, int right) {
+          term t;
+          t.kind = kind;
+          t.pattern = pattern;
+          t.left = left;
+          t.right = right;
+          query.terms.push_back(t);
+          return static_cast<int>(query.terms.size()) - 1;
+        }
+    };
+
+    // Only unambiguous dates, YYYY/MM/DD or YYYY-MM-DD. ledger also accepts
+    // partial dates and periods, which it interprets relative to today.
+    bool parse_date(const std::string& s, int32_t& day_number) {
+      int year, month, day;
+      char separator1, separator2;
+      int length = 0;
+      if (sscanf(s.c_str(), "%4d%c%2d%c%2d%n", &year, &separator1, &month,
+            &separator2, &day, &length) != 5
+          || length != static_cast<int>(s.size()) || !isdigit(static_cast<unsigned char>(s[0]))
+          || (separator1 != '/' && separator1 != '-') || separator1 != separator2) {
+        return false;
+      }
+
+      try {
+        day_number = to_day_number(boost::gregorian::date(year, month, day));
+        return true;
+
+      } catch (const std::out_of_range&) {
+        return false;
+      }
+    }
+
+    bool parse_period(const std::string& s, posting_query::period_kind& period) {
+      if (s == "daily") {
+        period = posting_query::DAILY;
+      } else if (s == "weekly") {
+        period = posting_query::WEEKLY;
+      } else if (s == "monthly") {
+        period = posting_query::MONTHLY;
+      } else if (s == "quarterly") {
+        period = posting_query::QUARTERLY;
+      } else if (s == "yearly") {
+        period = posting_query::YEARLY;
+      } else {
+        return false;
+      }
+      return true;
+    }
+
+    // The first day of the period that a day is in. Periods are aligned as
+    // ledger aligns them when there is no begin date in the period.
+    int32_t get_period_start(posting_query::period_kind period, int32_t day_number) {
+      boost::gregorian::date date(from_day_number(day_number));
+      switch (period) {
+        case posting_query::WEEKLY:
+          // Weeks start on Sunday.
+          return day_number - date.day_of_week().as_number();
+        case posting_query::MONTHLY:
+          return to_day_number(boost::gregorian::date(date.year(), date.month(), 1));
+        case posting_query::QUARTERLY:
+          return to_day_number(boost::gregorian::date(date.year(),
+                (date.month() - 1) / 3 * 3 + 1, 1));
+        case posting_query::YEARLY:
+          return to_day_number(boost::gregorian::date(date.year(), 1, 1));
+        default:
+          return day_number;
+      }
+    }
+
+    int32_t get_next_period_start(posting_query::period_kind period, int32_t start) {
+      boost::gregorian::date date(from_day_number(start));
+      switch (period) {
+        case posting_query::WEEKLY:
+          return start + 7;
+        case posting_query::MONTHLY:
+          return to_day_number(date + boost::gregorian::months(1));
+        case posting_query::QUARTERLY:
+          return to_day_number(date + boost::gregorian::months(3));
+        case posting_query::YEARLY:
+          return to_day_number(date + boost::gregorian::years(1));
+        default:
+          return start + 1;
+      }
+    }
+
+    // Period lines have "- " and the period's last day as the payee, in
+    // ledger's default date format %y-%b-%d.
+    std::string get_period_payee(int32_t last_day) {
+      static const char* const months[] = {
+        "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+      };
+      boost::gregorian::date date(from_day_number(last_day));
+      char payee[16];
+      snprintf(payee, sizeof(payee), "- %02d-%s-%02d", static_cast<int>(date.year() % 100),
+          months[date.month() - 1], static_cast<int>(date.day()));
+      return std::string(payee);
+    }
+
+    // The names a pattern matches by term kind and pattern.
+    typedef std::map<std::pair<int, std::string>, std::vector<bool>> name_matches;
+
+    // Which names each pattern term matches. Patterns are matched once per
+    // name rather than once per posting, and known keeps queries from
+    // matching the same pattern again.
+    bool match_names(const posting_table& postings, const posting_query& query,
+        name_matches& known, std::vector<std::vector<bool>>& matches) {
+      matches.assign(query.terms.size(), std::vector<bool>());
+      for (std::size_t i = 0; i < query.terms.size(); i++) {
+        const term& t = query.terms[i];
+        if (t.kind != term::ACCOUNT && t.kind != term::PAYEE) {
+          continue;
+        }
+
+        std::pair<int, std::string> key(t.kind, t.pattern);
+        auto found = known.find(key);
+        if (found != known.end()) {
+          matches[i] = found->second;
+          continue;
+        }
+
+        const std::vector<std::string>& names = t.kind == term::ACCOUNT
+          ? postings.account_names : postings.payee_names;
+        try {
+          std::regex pattern(t.pattern,
+              std::regex::ECMAScript | std::regex::icase | std::regex::optimize);
+          matches[i].resize(names.size());
+          for (std::size_t j = 0; j < names.size(); j++) {
+            matches[i][j] = std::regex_search(names[j], pattern);
+          }
+        } catch (const std::regex_error&) {
+          return false;
+        }
+        known[key] = matches[i];
+      }
+      return true;
+    }
+
+    bool is_match(const posting_table& postings, const posting_query& query,
+        const std::vector<std::vector<bool>>& matches, int node, std::size_t row) {
+      const term& t = query.terms[node];
+      switch (t.kind) {
+        case term::ACCOUNT:
+          return matches[node][postings.account_ids[row]];
+        case term::PAYEE:
+          return matches[node][postings.payee_ids[row]];
+        case term::AND:
+          return is_match(postings, query, matches, t.left, row)
+            && is_match(postings, query, matches, t.right, row);
+        case term::OR:
+          return is_match(postings, query, matches, t.left, row)
+            || is_match(postings, query, matches, t.right, row);
+        case term::NOT:
+          return !is_match(postings, query, matches, t.left, row);
+      }
+      return false;
+    }
+
+    // Unites bitmaps pairwise so that each row is copied about log2(n)
+    // times rather than n times.
+    posting_bitmap unite_all(std::vector<posting_bitmap> bitmaps) {
+      if (bitmaps.empty()) {
+        return posting_bitmap();
+      }
+      while (bitmaps.size() > 1) {
+        std::vector<posting_bitmap> united;
+        for (std::size_t i = 0; i + 1 < bitmaps.size(); i += 2) {
+          united.push_back(posting_bitmap::unite(bitmaps[i], bitmaps[i + 1]));
+        }
+        if (bitmaps.size() % 2 == 1) {
+          united.push_back(std::move(bitmaps.back()));
+        }
+        bitmaps.swap(united);
+      }
+      return std::move(bitmaps.front());
+    }
+
+    posting_bitmap evaluate(const posting_table& postings, const posting_indexes& indexes,
+        const posting_query& query, const std::vector<std::vector<bool>>& matches, int node) {
+      const term& t = query.terms[node];
+      switch (t.kind) {
+        case term::ACCOUNT:
+        case term::PAYEE:
+          {
+            const std::vector<posting_bitmap>& id_rows = t.kind == term::ACCOUNT
+              ? indexes.account_rows : indexes.payee_rows;
+            std::vector<posting_bitmap> matched;
+            for (std::size_t id = 0; id < matches[node].size(); id++) {
+              if (matches[node][id]) {
+                matched.push_back(id_rows[id]);
+              }
+            }
+            return unite_all(std::move(matched));
+          }
+        case term::AND:
+          return posting_bitmap::intersect(
+              evaluate(postings, indexes, query, matches, t.left),
+              evaluate(postings, indexes, query, matches, t.right));
+        case term::OR:
+          return posting_bitmap::unite(
+              evaluate(postings, indexes, query, matches, t.left),
+              evaluate(postings, indexes, query, matches, t.right));
+        case term::NOT:
+          return posting_bitmap::subtract(
+              posting_bitmap::range(0, static_cast<uint32_t>(postings.size())),
+              evaluate(postings, indexes, query, matches, t.left));
+      }
+      return posting_bitmap();
+    }
+
+    // The rows inside the query's date range.
+    posting_bitmap get_date_window(const posting_table& postings,
+        const posting_indexes& indexes, const posting_query& query) {
+      auto is_before = [&](uint32_t row, int32_t date) { return postings.dates[row] < date; };
+      auto first = query.has_begin ? std::lower_bound(indexes.date_order.cbegin(),
+          indexes.date_order.cend(), query.begin, is_before) : indexes.date_order.cbegin();
+      auto last = query.has_end ? std::lower_bound(first, indexes.date_order.cend(),
+          query.end, is_before) : indexes.date_order.cend();
+      if (first >= last) {
+        return posting_bitmap();
+      }
+
+      if (indexes.is_date_ordered) {
+        return posting_bitmap::range(*first, *std::prev(last) + 1);
+      }
+      std::vector<uint32_t> window(first, last);
+      std::sort(window.begin(), window.end());
+      posting_bitmap bitmap;
+      for (uint32_t row : window) {
+        bitmap.add(row);
+      }
+      return bitmap;
+    }
+
+    bool is_in_range(const posting_query& query, int32_t date) {
+      return (!query.has_begin || date >= query.begin) && (!query.has_end || date < query.end);
+    }
+
+    // False if ledger could report rows differently than the native engine.
+    bool is_native(const posting_table& postings, const std::vector<uint32_t>& rows) {
+      bool has_commodity = false;
+      uint32_t commodity_id = 0;
+      for (uint32_t i : rows) {
+        if ((postings.post_flags[i] & (posting_table::POST_DATE | posting_table::INEXACT))
+            || postings.amounts[i] == 0
+            || (has_commodity && postings.commodity_ids[i] != commodity_id)) {
+          return false;
+        }
+        has_commodity = true;
+        commodity_id = postings.commodity_ids[i];
+      }
+      return true;
+    }
+  }
+
+  posting_indexes get_posting_indexes(const posting_table& postings) {
+    posting_indexes indexes;
+    indexes.date_order.resize(postings.size());
+    for (std::size_t i = 0; i < indexes.date_order.size(); i++) {
+      indexes.date_order[i] = static_cast<uint32_t>(i);
+    }
+    // Journals are usually written in date order already.
+    indexes.is_date_ordered = std::is_sorted(postings.dates.cbegin(), postings.dates.cend());
+    if (!indexes.is_date_ordered) {
+      std::stable_sort(indexes.date_order.begin(), indexes.date_order.end(),
+          [&](uint32_t a, uint32_t b) { return postings.dates[a] < postings.dates[b]; });
+    }
+
+    indexes.account_rows.resize(postings.account_names.size());
+    indexes.payee_rows.resize(postings.payee_names.size());
+    for (std::size_t i = 0; i < postings.size(); i++) {
+      indexes.account_rows[postings.account_ids[i]].add(static_cast<uint32_t>(i));
+      indexes.payee_rows[postings.payee_ids[i]].add(static_cast<uint32_t>(i));
+    }
+    return indexes;
+  }
+
+  std::list<std::string> normalize_register_args(const std::list<std::string>& args) {
+    static const std::map<std::string, std::string> flag_names = {
+      { "-n", "--collapse" }, { "--collapse", "--collapse" },
+      { "-E", "--empty" }, { "--empty", "--empty" },
+      { "-R", "--real" }, { "--real", "--real" }
+    };
+    static const std::map<std::string, std::string> option_names = {
+      { "-b", "--begin" }, { "--begin", "--begin" },
+      { "-e", "--end" }, { "--end", "--end" },
+      { "-p", "--period" }, { "--period", "--period" }
+    };
+
+    std::set<std::string> flags;
+    std::list<std::string> options;
+    auto iter = args.cbegin();
+    for (; iter != args.cend(); iter++) {
+      if (iter->empty()) {
+        continue;
+      }
+
+      auto flag = flag_names.find(*iter);
+      if (flag != flag_names.end()) {
+        flags.insert(flag->second);
+        continue;
+      }
+
+      // Options with a value, as two args or as --option=value.
+      std::size_t equals = iter->find('=');
+      auto option = option_names.find(iter->substr(0, equals));
+      if (option == option_names.end() || (equals != std::string::npos
+            && option->first.compare(0, 2, "--") != 0)) {
+        break;
+      }
+      if (equals != std::string::npos) {
+        options.push_back(option->second);
+        options.push_back(iter->substr(equals + 1));
+      } else if (std::next(iter) != args.cend()) {
+        options.push_back(option->second);
+        options.push_back(*++iter);
+      } else {
+        break;
+      }
+    }
+
+    std::list<std::string> normalized(flags.cbegin(), flags.cend());
+    normalized.splice(normalized.end(), options);
+    normalized.insert(normalized.end(), iter, args.cend());
+    return normalized;
+  }
+
+  std::list<std::string> normalize_register_query(const std::list<std::string>& query) {
+    std::set<std::string> patterns;
+    for (const std::string& token : query) {
+      if (token.empty()) {
+        continue;
+      }
+      if (!is_pattern(token)) {
+        return query;
+      }
+      patterns.insert(token);
+    }
+    return std::list<std::string>(patterns.cbegin(), patterns.cend());
+  }
+
+  bool parse_posting_query(const std::list<std::string>& args,
+      const std::list<std::string>& query, posting_query& parsed) {
+    parsed = posting_query();
+
+    for (auto iter = args.cbegin(); iter != args.cend(); iter++) {
+      bool is_begin;
+      std::string value;
+      if (*iter == "-b" || *iter == "--begin" || *iter == "-e" || *iter == "--end") {
+        is_begin = (*iter == "-b" || *iter == "--begin");
+        if (std::next(iter) == args.cend()) {
+          return false;
+        }
+        value = *++iter;
+
+      } else if (iter->compare(0, 8, "--begin=") == 0) {
+        is_begin = true;
+        value = iter->substr(8);
+
+      } else if (iter->compare(0, 6, "--end=") == 0) {
+        is_begin = false;
+        value = iter->substr(6);
+
+      } else if (*iter == "--collapse" || *iter == "-n") {
+        parsed.is_collapsed = true;
+        continue;
+
+      } else if (*iter == "--empty" || *iter == "-E") {
+        parsed.is_empty_shown = true;
+        continue;
+
+      } else if (*iter == "--period" || *iter == "-p" || iter->compare(0, 9, "--period=") == 0) {
+        if (iter->compare(0, 9, "--period=") == 0) {
+          value = iter->substr(9);
+        } else if (std::next(iter) == args.cend()) {
+          return false;
+        } else {
+          value = *++iter;
+        }
+        // A second period would be appended to the first by ledger.
+        if (parsed.period != posting_query::NO_PERIOD || !parse_period(value, parsed.period)) {
+          return false;
+        }
+        continue;
+
+      } else {
+        return false;
+      }
+
+      int32_t day_number;
+      if (!parse_date(value, day_number)) {
+        return false;
+      }
+      if (is_begin) {
+        parsed.has_begin = true;
+        parsed.begin = day_number;
+      } else {
+        parsed.has_end = true;
+        parsed.end = day_number;
+      }
+    }
+
+    // Without a period --empty changes which postings ledger shows.
+    if (parsed.is_empty_shown && parsed.period == posting_query::NO_PERIOD) {
+      return false;
+    }
+
+    query_parser parser(query, parsed);
+    return parser.parse();
+  }
+
+  bool posting_query::is_summarized() const {
+    return period != NO_PERIOD || is_collapsed;
+  }
+
+  // Ledger's interval_posts subtotals each period's postings by account, in
+  // account name order, and collapse_posts then makes each period, or each
+  // transaction without a period, a single <Total> line if it has more than
+  // one. Whether ledger shows lines that add up to zero depends on options
+  // the native engine does not model, so those are left to it.
+  bool summarize_postings(const posting_table& postings, const posting_query& query,
+      const std::vector<uint32_t>& rows, posting_table& summary) {
+    summary = posting_table();
+    std::unordered_map<std::string, uint32_t> account_ids;
+    std::unordered_map<std::string, uint32_t> payee_ids;
+    auto get_id = [](std::unordered_map<std::string, uint32_t>& ids,
+        std::vector<std::string>& names, const std::string& name) {
+      auto id = ids.emplace(name, static_cast<uint32_t>(names.size()));
+      if (id.second) {
+        names.push_back(name);
+      }
+      return id.first->second;
+    };
+    auto add_line = [&](int32_t date, int64_t amount, const std::string& payee,
+        const std::string& account) {
+      summary.dates.push_back(date);
+      summary.amounts.push_back(amount);
+      summary.account_ids.push_back(get_id(account_ids, summary.account_names, account));
+      summary.payee_ids.push_back(get_id(payee_ids, summary.payee_names, payee));
+      summary.xact_ids.push_back(static_cast<uint32_t>(summary.xact_ids.size()));
+      summary.commodity_ids.push_back(0);
+      summary.post_flags.push_back(0);
+    };
+
+    if (query.period == posting_query::NO_PERIOD) {
+      for (std::size_t begin = 0; begin < rows.size(); ) {
+        uint32_t first = rows[begin];
+        int64_t amount = postings.amounts[first];
+        std::size_t end = begin + 1;
+        for (; end < rows.size() && postings.xact_ids[rows[end]] == postings.xact_ids[first];
+            end++) {
+          if (postings.payee_ids[rows[end]] != postings.payee_ids[first]) {
+            return false;
+          }
+          amount += postings.amounts[rows[end]];
+        }
+
+        const std::string& payee(postings.payee_names[postings.payee_ids[first]]);
+        if (end - begin == 1) {
+          add_line(postings.dates[first], amount, payee,
+              postings.account_names[postings.account_ids[first]]);
+        } else if (amount == 0) {
+          return false;
+        } else {
+          add_line(postings.dates[first], amount, payee, "<Total>");
+        }
+        begin = end;
+      }
+      return true;
+    }
+
+    std::vector<uint32_t> dated(rows);
+    std::stable_sort(dated.begin(), dated.end(),
+        [&](uint32_t a, uint32_t b) { return postings.dates[a] < postings.dates[b]; });
+    int32_t start = dated.empty() ? 0 : get_period_start(query.period, postings.dates[dated[0]]);
+    for (std::size_t i = 0; i < dated.size(); ) {
+      int32_t next = get_next_period_start(query.period, start);
+      std::map<std::string, int64_t> subtotals;
+      for (; i < dated.size() && postings.dates[dated[i]] < next; i++) {
+        subtotals[postings.account_names[postings.account_ids[dated[i]]]]
+          += postings.amounts[dated[i]];
+      }
+
+      std::string payee(get_period_payee(next - 1));
+      int64_t amount = 0;
+      for (const auto& subtotal : subtotals) {
+        if (subtotal.second == 0) {
+          return false;
+        }
+        amount += subtotal.second;
+      }
+      if (subtotals.empty()) {
+        if (query.is_empty_shown) {
+          add_line(start, 0, payee, "<None>");
+        }
+      } else if (query.is_collapsed && subtotals.size() > 1) {
+        if (amount == 0) {
+          return false;
+        }
+        add_line(start, amount, payee, "<Total>");
+      } else {
+        for (const auto& subtotal : subtotals) {
+          add_line(start, subtotal.second, payee, subtotal.first);
+        }
+      }
+      start = next;
+    }
+    return true;
+  }
+
+  bool find_postings(const posting_table& postings, const posting_query& query,
+      std::vector<uint32_t>& rows, const posting_indexes* indexes) {
+    std::vector<std::vector<uint32_t>> found_rows;
+    std::vector<bool> found;
+    find_postings(postings, std::vector<const posting_query*>{ &query }, found_rows, found,
+        indexes);
+    rows.swap(found_rows.front());
+    return found.front();
+  }
+
+  void find_postings(const posting_table& postings,
+      const std::vector<const posting_query*>& queries,
+      std::vector<std::vector<uint32_t>>& rows, std::vector<bool>& found,
+      const posting_indexes* indexes) {
+    rows.assign(queries.size(), std::vector<uint32_t>());
+    found.assign(queries.size(), false);
+
+    name_matches known;
+    std::vector<std::vector<std::vector<bool>>> matches(queries.size());
+    std::vector<std::size_t> matched;
+    for (std::size_t q = 0; q < queries.size(); q++) {
+      if (match_names(postings, *queries[q], known, matches[q])) {
+        matched.push_back(q);
+      }
+    }
+    if (matched.empty()) {
+      return;
+    }
+
+    const posting_query& range(*queries[matched.front()]);
+    if (indexes) {
+      bool is_windowed = range.has_begin || range.has_end;
+      posting_bitmap window = is_windowed ? get_date_window(postings, *indexes, range)
+        : posting_bitmap::range(0, static_cast<uint32_t>(postings.size()));
+      for (std::size_t q : matched) {
+        const posting_query& query(*queries[q]);
+        if (query.root == -1) {
+          window.get_rows(rows[q]);
+          continue;
+        }
+        posting_bitmap bitmap = evaluate(postings, *indexes, query, matches[q], query.root);
+        if (is_windowed) {
+          bitmap = posting_bitmap::intersect(bitmap, window);
+        }
+        bitmap.get_rows(rows[q]);
+      }
+
+    } else {
+      for (std::size_t i = 0; i < postings.size(); i++) {
+        if (!is_in_range(range, postings.dates[i])) {
+          continue;
+        }
+        for (std::size_t q : matched) {
+          const posting_query& query(*queries[q]);
+          if (query.root == -1 || is_match(postings, query, matches[q], query.root, i)) {
+            rows[q].push_back(static_cast<uint32_t>(i));
+          }
+        }
+      }
+    }
+
+    for (std::size_t q : matched) {
+      found[q] = is_native(postings, rows[q]);
+      if (!found[q]) {
+        rows[q].clear();
+      }
+    }
+  }
+}
@@ -0,0 +1,122 @@
+/* * Copyright (c) 2015-2020 Chad Voegele
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *  * The name of Chad Voegele may not be used to endorse or promote products
+ * derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <string>
+#include <vector>
+
+#include "posting_bitmap.h"
+#include "posting_table.h"
+
+namespace ledger_rest {
+  // A register request that a posting_table can answer without ledger: a
+  // boolean expression of account and payee patterns and a date range that
+  // starts at begin and ends before end, optionally subtotaled by period or
+  // collapsed.
+  struct posting_query {
+    struct term {
+      enum term_kind { ACCOUNT, PAYEE, AND, OR, NOT };
+
+      term_kind kind;
+      // The regular expression of an ACCOUNT or PAYEE term.
+      std::string pattern;
+      // Operands of AND, OR and NOT as indexes into terms.
+      int left;
+      int right;
+    };
+
+    std::vector<term> terms;
+    // The term the query evaluates to or -1 if every posting matches.
+    int root = -1;
+    bool has_begin = false;
+    int32_t begin = 0;
+    bool has_end = false;
+    int32_t end = 0;
+
+    enum period_kind { NO_PERIOD, DAILY, WEEKLY, MONTHLY, QUARTERLY, YEARLY };
+    // --period: each account's postings in a period are one line.
+    period_kind period = NO_PERIOD;
+    // --collapse: the lines of a transaction, or of a period, are one line.
+    bool is_collapsed = false;
+    // --empty: periods without postings have a line too.
+    bool is_empty_shown = false;
+
+    bool is_summarized() const;
+  };
+
+  // Indexes over a posting_table so that a query only reads the postings it
+  // can match.
+  struct posting_indexes {
+    // Rows ordered by date, rows of the same date in journal order.
+    std::vector<uint32_t> date_order;
+    // True if the table itself is in date order.
+    bool is_date_ordered = false;
+    // The rows of each account and payee id.
+    std::vector<posting_bitmap> account_rows;
+    std::vector<posting_bitmap> payee_rows;
+  };
+
+  posting_indexes get_posting_indexes(const posting_table& postings);
+
+  // Register args and query rewritten so that requests ledger answers the
+  // same way are the same: options it knows are spelled one way, flags are
+  // sorted and given once, empty args are dropped and a query of patterns
+  // only, which ledger ors together, is sorted and given once. Args after
+  // an option it does not know are kept as they are.
+  std::list<std::string> normalize_register_args(const std::list<std::string>& args);
+  std::list<std::string> normalize_register_query(const std::list<std::string>& query);
+
+  // Returns false if args or query use anything that only ledger can
+  // evaluate.
+  bool parse_posting_query(const std::list<std::string>& args,
+      const std::list<std::string>& query, posting_query& parsed);
+  // Fills rows with the postings matching query in journal order. Returns
+  // false if ledger could report them differently: postings in more than
+  // one commodity, with their own date or with no amount. Without indexes
+  // every posting is read.
+  bool find_postings(const posting_table& postings, const posting_query& query,
+      std::vector<uint32_t>& rows, const posting_indexes* indexes = NULL);
+  // The lines ledger reports for the rows find_postings found with query's
+  // --period and --collapse, as a table with one row per line in report
+  // order and names of its own. Returns false if ledger could report them
+  // differently: lines that add up to zero or collapsed postings with
+  // different payees.
+  bool summarize_postings(const posting_table& postings, const posting_query& query,
+      const std::vector<uint32_t>& rows, posting_table& summary);
+  // find_postings for several queries with the same date range, which
+  // share the work they have in common. Each pattern is matched against the
+  // names once and without indexes the postings are read in one pass for
+  // all of the queries. found[i] is what find_postings would return for
+  // queries[i].
+  void find_postings(const posting_table& postings,
+      const std::vector<const posting_query*>& queries,
+      std::vector<std::vector<uint32_t>>& rows, std::vector<bool>& found,
+      const posting_indexes* indexes = NULL);
+}
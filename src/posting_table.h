@@ -0,0 +1,68 @@
+/* * Copyright (c) 2015-2020 Chad Voegele
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *  * The name of Chad Voegele may not be used to endorse or promote products
+ * derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "boost/date_time/gregorian/gregorian.hpp"
+
+namespace ledger_rest {
+  // The postings of a journal in parse order, one column per field. Names
+  // are stored once and referenced by index.
+  struct posting_table {
+    // Amounts are fixed point in millionths of a unit.
+    static const int64_t amount_scale = 1000000;
+
+    enum flags : uint8_t {
+      VIRTUAL = 0x1,
+      // The posting has its own date instead of the transaction's.
+      POST_DATE = 0x2,
+      // The amount is not a whole number of millionths or does not fit, so
+      // only ledger has it exactly. Its amount in the table is 0.
+      INEXACT = 0x4,
+    };
+
+    std::vector<int32_t> dates;
+    std::vector<int64_t> amounts;
+    std::vector<uint32_t> account_ids;
+    std::vector<uint32_t> payee_ids;
+    std::vector<uint32_t> xact_ids;
+    std::vector<uint32_t> commodity_ids;
+    std::vector<uint8_t> post_flags;
+
+    std::vector<std::string> account_names;
+    std::vector<std::string> payee_names;
+    std::vector<std::string> commodity_names;
+
+    std::size_t size() const;
+  };
+
+  int32_t to_day_number(const boost::gregorian::date& date);
+  boost::gregorian::date from_day_number(int32_t day_number);
+}
@@ -0,0 +1,111 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+#include "register_batcher.h"
+
+namespace ledger_rest {
+  register_batcher::register_batcher(unsigned int window) : window(window), batch_count(0) {
+  }
+
+  register_batcher::body_ptr register_batcher::run(unsigned long long generation,
+      const std::string& key, const posting_query& query, const batch_function& answer) {
+    std::shared_ptr<batch> joined;
+    std::size_t index = 0;
+    if (window > 0) {
+      std::string group(std::to_string(generation) + ';'
+          + (query.has_begin ? std::to_string(query.begin) : std::string("-")) + ';'
+          + (query.has_end ? std::to_string(query.end) : std::string("-")));
+
+      std::unique_lock<std::mutex> lock(batches_mutex);
+      auto found = open_batches.find(group);
+      if (found != open_batches.end()) {
+        joined = found->second;
+        index = joined->keys.size();
+        joined->keys.push_back(key);
+        joined->queries.push_back(&query);
+
+        // The query is used until the batch is done, which this waits for.
+        batches_cv.wait(lock, [&joined]() { return joined->is_done; });
+        if (joined->error) {
+          std::rethrow_exception(joined->error);
+        }
+        return joined->bodies[index];
+      }
+
+      joined = std::make_shared<batch>();
+      joined->keys.push_back(key);
+      joined->queries.push_back(&query);
+      open_batches[group] = joined;
+      lock.unlock();
+
+      std::this_thread::sleep_for(std::chrono::microseconds(window));
+      lock.lock();
+      open_batches.erase(group);
+
+    } else {
+      joined = std::make_shared<batch>();
+      joined->keys.push_back(key);
+      joined->queries.push_back(&query);
+    }
+
+    std::vector<body_ptr> bodies;
+    std::exception_ptr error;
+    try {
+      bodies = answer(joined->keys, joined->queries);
+      if (bodies.size() != joined->queries.size()) {
+        throw std::runtime_error("Batch answered with the wrong number of bodies.");
+      }
+
+    } catch (...) {
+      error = std::current_exception();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(batches_mutex);
+      joined->bodies.swap(bodies);
+      joined->error = error;
+      joined->is_done = true;
+      batch_count++;
+    }
+    batches_cv.notify_all();
+
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    return joined->bodies[index];
+  }
+
+  unsigned long long register_batcher::get_batch_count() {
+    std::lock_guard<std::mutex> lock(batches_mutex);
+    return batch_count;
+  }
+}
@@ -0,0 +1,86 @@
+/* * Copyright (c) 2015-2020 Chad Voegele
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *  * The name of Chad Voegele may not be used to endorse or promote products
+ * derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "posting_query.h"
+
+namespace ledger_rest {
+  // Collects native register queries on the same journal generation and
+  // date range that arrive within window microseconds of the first of them,
+  // so that they are answered by one find_postings call. The first query of
+  // a batch waits out the window and answers the batch; the others wait for
+  // it. The first waits the whole window even if no other query joins. A
+  // window of 0 answers every query on its own.
+  class register_batcher {
+    public:
+      typedef std::shared_ptr<const std::string> body_ptr;
+      // Answers the queries of a batch, a body for each. Keys are those the
+      // queries were given with.
+      typedef std::function<std::vector<body_ptr>(const std::vector<std::string>& keys,
+          const std::vector<const posting_query*>& queries)> batch_function;
+
+      register_batcher(unsigned int window);
+      register_batcher(const register_batcher&) = delete;
+      register_batcher& operator=(const register_batcher&) = delete;
+      register_batcher (register_batcher&&) = delete;
+      register_batcher& operator=(const register_batcher&&) = delete;
+      virtual ~register_batcher() { }
+
+      // Returns the body answer gave for query, or throws what it threw.
+      // answer is the one of the first query in the batch.
+      body_ptr run(unsigned long long generation, const std::string& key,
+          const posting_query& query, const batch_function& answer);
+
+      // Batches answered, each by one call to answer.
+      unsigned long long get_batch_count();
+
+    private:
+      struct batch {
+        std::vector<std::string> keys;
+        std::vector<const posting_query*> queries;
+        std::vector<body_ptr> bodies;
+        bool is_done = false;
+        std::exception_ptr error;
+      };
+
+      const unsigned int window;
+      std::mutex batches_mutex;
+      std::condition_variable batches_cv;
+      // Batches still in their window by generation and date range.
+      std::map<std::string, std::shared_ptr<batch>> open_batches;
+      unsigned long long batch_count;
+  };
+}
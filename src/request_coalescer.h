@@ -0,0 +1,110 @@
+/* * Copyright (c) 2015-2020 Chad Voegele
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *  * The name of Chad Voegele may not be used to endorse or promote products
+ * derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace ledger_rest {
+  // Lets concurrent requests for the same response compute it once. The
+  // first caller for a key computes the body while later callers for that
+  // key wait and share it. Nothing is kept once the first caller is done;
+  // that is what response_cache is for.
+  template<typename T>
+  class basic_request_coalescer {
+    public:
+      typedef std::shared_ptr<const T> body_ptr;
+
+      basic_request_coalescer() : coalesced_count(0) { }
+      basic_request_coalescer(const basic_request_coalescer&) = delete;
+      basic_request_coalescer& operator=(const basic_request_coalescer&) = delete;
+      basic_request_coalescer (basic_request_coalescer&&) = delete;
+      basic_request_coalescer& operator=(const basic_request_coalescer&&) = delete;
+      virtual ~basic_request_coalescer() { }
+
+      // Returns compute() or what the call already computing key for
+      // generation returns, which throws to every caller if compute throws.
+      // compute may return null when its body can not be shared, which then
+      // leaves the waiting callers to compute their own.
+      body_ptr run(unsigned long long generation, const std::string& key,
+          const std::function<body_ptr()>& compute) {
+        // A reload may start a new flight for the key while one for the
+        // older journal is still running.
+        std::string flight_key(std::to_string(generation) + ';' + key);
+        std::promise<body_ptr> promise;
+        std::shared_future<body_ptr> flight;
+        bool is_computing = false;
+        {
+          std::lock_guard<std::mutex> lock(flights_mutex);
+          auto found = flights.find(flight_key);
+          if (found != flights.end()) {
+            coalesced_count++;
+            flight = found->second;
+
+          } else {
+            flight = promise.get_future().share();
+            flights[flight_key] = flight;
+            is_computing = true;
+          }
+        }
+        if (!is_computing) {
+          return flight.get();
+        }
+
+        try {
+          promise.set_value(compute());
+
+        } catch (...) {
+          promise.set_exception(std::current_exception());
+        }
+
+        {
+          std::lock_guard<std::mutex> lock(flights_mutex);
+          flights.erase(flight_key);
+        }
+        return flight.get();
+      }
+
+      // Calls that waited for another rather than computing.
+      unsigned long long get_coalesced_count() {
+        std::lock_guard<std::mutex> lock(flights_mutex);
+        return coalesced_count;
+      }
+
+    private:
+      std::mutex flights_mutex;
+      std::unordered_map<std::string, std::shared_future<body_ptr>> flights;
+      unsigned long long coalesced_count;
+  };
+
+  typedef basic_request_coalescer<std::string> request_coalescer;
+}
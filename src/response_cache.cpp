@@ -0,0 +1,112 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include "response_cache.h"
+
+namespace ledger_rest {
+  response_cache::response_cache(std::size_t capacity)
+    : capacity(capacity), generation(0) {
+    cache_stats.capacity = capacity;
+  }
+
+  std::shared_ptr<const std::string> response_cache::get(unsigned long long generation,
+      const std::string& key) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    set_generation(generation);
+
+    auto found = index.find(key);
+    if (this->generation != generation || found == index.end()) {
+      cache_stats.misses++;
+      return std::shared_ptr<const std::string>();
+    }
+
+    entries.splice(entries.begin(), entries, found->second);
+    cache_stats.hits++;
+    return found->second->second;
+  }
+
+  void response_cache::put(unsigned long long generation, const std::string& key,
+      std::shared_ptr<const std::string> body) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    set_generation(generation);
+
+    // A request that started on an older journal finished after a reload.
+    if (this->generation != generation) {
+      return;
+    }
+
+    entry e(key, body);
+    std::size_t size = get_entry_size(e);
+    if (size > capacity) {
+      return;
+    }
+
+    auto found = index.find(key);
+    if (found != index.end()) {
+      cache_stats.bytes -= get_entry_size(*found->second);
+      entries.erase(found->second);
+      index.erase(found);
+    }
+
+    while (cache_stats.bytes + size > capacity) {
+      cache_stats.bytes -= get_entry_size(entries.back());
+      index.erase(entries.back().first);
+      entries.pop_back();
+      cache_stats.evictions++;
+    }
+
+    entries.push_front(e);
+    index[key] = entries.begin();
+    cache_stats.bytes += size;
+    cache_stats.entries = entries.size();
+  }
+
+  response_cache::stats response_cache::get_stats() {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    cache_stats.entries = entries.size();
+    return cache_stats;
+  }
+
+  std::size_t response_cache::get_capacity() const {
+    return capacity;
+  }
+
+  // Must be called with cache_mutex held.
+  void response_cache::set_generation(unsigned long long generation) {
+    if (generation > this->generation) {
+      this->generation = generation;
+      entries.clear();
+      index.clear();
+      cache_stats.bytes = 0;
+      cache_stats.entries = 0;
+    }
+  }
+
+  // The key is stored twice, in the list and in the index.
+  std::size_t response_cache::get_entry_size(const entry& e) {
+    return 2 * e.first.size() + e.second->size() + sizeof(entry);
+  }
+}
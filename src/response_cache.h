@@ -0,0 +1,81 @@
+/* * Copyright (c) 2015-2020 Chad Voegele
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *  * The name of Chad Voegele may not be used to endorse or promote products
+ * derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace ledger_rest {
+  // Response bodies of the current journal generation, least recently used
+  // first out once more than capacity bytes are held. A newer generation
+  // drops everything cached for older ones.
+  class response_cache {
+    public:
+      struct stats {
+        unsigned long long hits = 0;
+        unsigned long long misses = 0;
+        unsigned long long evictions = 0;
+        std::size_t bytes = 0;
+        std::size_t entries = 0;
+        std::size_t capacity = 0;
+      };
+
+      response_cache(std::size_t capacity);
+      response_cache(const response_cache&) = delete;
+      response_cache& operator=(const response_cache&) = delete;
+      response_cache (response_cache&&) = delete;
+      response_cache& operator=(const response_cache&&) = delete;
+      virtual ~response_cache() { }
+
+      // Returns null on a miss.
+      std::shared_ptr<const std::string> get(unsigned long long generation,
+          const std::string& key);
+      void put(unsigned long long generation, const std::string& key,
+          std::shared_ptr<const std::string> body);
+      stats get_stats();
+      std::size_t get_capacity() const;
+
+    private:
+      typedef std::pair<std::string, std::shared_ptr<const std::string>> entry;
+
+      const std::size_t capacity;
+      std::mutex cache_mutex;
+      unsigned long long generation;
+      // Most recently used first.
+      std::list<entry> entries;
+      std::unordered_map<std::string, std::list<entry>::iterator> index;
+      stats cache_stats;
+
+      void set_generation(unsigned long long generation);
+      static std::size_t get_entry_size(const entry& e);
+  };
+}
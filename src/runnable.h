@@ -26,15 +26,17 @@
 
 #pragma once
 
-#include <sys/select.h>
+#include <cstdint>
+
+#include "event_loop.h"
 
 namespace ledger_rest {
   class runnable {
     public:
-      virtual void run_from_select(const fd_set* read_fd_set, const fd_set* write_fd_set,
-          const fd_set* except_fd_set) = 0;
-      virtual int set_fdsets(fd_set* read_fd_set, fd_set* write_fd_set, fd_set* except_fd_set) = 0;
-      virtual unsigned long long get_select_timeout() = 0;
+      virtual void register_fds(event_loop& loop) = 0;
+      virtual void run_from_poll(int fd, uint32_t events) = 0;
+      virtual void run_from_timeout() = 0;
+      virtual unsigned long long get_poll_timeout() = 0;
       virtual ~runnable() { }
   };
 }
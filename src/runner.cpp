@@ -25,21 +25,60 @@
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //
 
+#include <chrono>
 #include <climits>
 #include <csignal>
+#include <cerrno>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 #include "runner.h"
 
 namespace ledger_rest {
+  static const int max_events = 64;
+
+  runner::runner(ledger_rest::logger& logger, std::list<runnable*> runners)
+    : logger(logger), is_running(true), runners(runners), epoll_fd(-1), wakeup_fd(-1),
+    next_timer_id(1) {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1)
+      throw std::runtime_error("Could not create epoll fd.");
+
+    // stop() may be called from a signal handler or another thread, so it
+    // pokes this eventfd to get the loop out of epoll_wait.
+    wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_fd == -1) {
+      close(epoll_fd);
+      throw std::runtime_error("Could not create wakeup fd.");
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = wakeup_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wakeup_fd, &event) == -1) {
+      close(wakeup_fd);
+      close(epoll_fd);
+      throw std::runtime_error("Could not add wakeup fd to epoll.");
+    }
+
+    for (auto iter = this->runners.begin(); iter != this->runners.end(); iter++) {
+      (*iter)->register_fds(*this);
+    }
+  }
+
+  runner::~runner() {
+    close(wakeup_fd);
+    close(epoll_fd);
+  }
+
   void runner::run() {
     sigset_t emptyset;
     sigemptyset(&emptyset);
 
-    struct timespec tv;
-    fd_set rs;
-    fd_set ws;
-    fd_set es;
-    int max_fd, max_fd_t;
+    struct epoll_event events[max_events];
+    std::list<unsigned long long> timeouts;
     unsigned long long timeout, timeout_t;
     std::list<runnable*>::iterator iter;
     int nready;
@@ -47,38 +86,140 @@ namespace ledger_rest {
     logger.log(0, "Starting server");
     while (is_running) {
       timeout = ULLONG_MAX;
-      max_fd = -1;
-      FD_ZERO(&rs);
-      FD_ZERO(&ws);
-      FD_ZERO(&es);
+      timeouts.clear();
 
       for (iter = runners.begin(); iter != runners.end(); iter++) {
-        max_fd_t = (*iter)->set_fdsets(&rs, &ws, &es);
-        if (max_fd_t > max_fd)
-          max_fd = max_fd_t;
-        timeout_t = (*iter)->get_select_timeout();
+        timeout_t = (*iter)->get_poll_timeout();
+        timeouts.push_back(timeout_t);
         if (timeout_t < timeout)
-          timeout = timeout;
+          timeout = timeout_t;
       }
 
-      convert_timeout(timeout, tv);
-      nready = pselect(max_fd + 1, &rs, &ws, &es, &tv, &emptyset);
-      if (nready > 0 || errno != EINTR) {
-        for (iter = runners.begin(); iter != runners.end(); iter++) {
-          (*iter)->run_from_select(&rs, &ws, &es);
+      timeout_t = get_timer_timeout();
+      if (timeout_t < timeout)
+        timeout = timeout_t;
+
+      auto start = std::chrono::steady_clock::now();
+      nready = epoll_pwait(epoll_fd, events, max_events, convert_timeout(timeout), &emptyset);
+      if (nready == -1) {
+        if (errno == EINTR)
+          continue;
+        throw std::runtime_error("epoll wait failed.");
+      }
+
+      for (int i = 0; i < nready; i++) {
+        int fd = events[i].data.fd;
+        if (fd == wakeup_fd) {
+          drain_wakeup_fd();
+          continue;
+        }
+
+        // An earlier callback in this batch may have removed the fd.
+        auto owner = fd_owners.find(fd);
+        if (owner != fd_owners.end()) {
+          owner->second->run_from_poll(fd, events[i].events);
         }
       }
+
+      auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::steady_clock::now() - start).count();
+      run_timeouts(timeouts, elapsed);
+      run_timers();
     }
   }
 
   void runner::stop() {
     logger.log(0, "Stopping server");
     is_running = false;
+
+    uint64_t one = 1;
+    if (write(wakeup_fd, &one, sizeof(one)) == -1) {
+      // The counter only overflows if nobody is reading it, and then the
+      // loop is already awake.
+    }
+  }
+
+  void runner::add_fd(int fd, uint32_t events, runnable* owner) {
+    struct epoll_event event;
+    event.events = events;
+    event.data.fd = fd;
+
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1)
+      throw std::runtime_error("Could not add fd to epoll.");
+    fd_owners[fd] = owner;
+  }
+
+  void runner::remove_fd(int fd) {
+    if (fd_owners.erase(fd) > 0) {
+      epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    }
+  }
+
+  unsigned long long runner::add_timer(unsigned long long delay,
+      std::function<void()> callback) {
+    unsigned long long id = next_timer_id++;
+    timers[id] = callback;
+    timer_heap.push(timer_entry(clock::now() + std::chrono::milliseconds(delay), id));
+    return id;
+  }
+
+  void runner::cancel_timer(unsigned long long id) {
+    timers.erase(id);
+  }
+
+  unsigned long long runner::get_timer_timeout() {
+    while (!timer_heap.empty() && timers.count(timer_heap.top().second) == 0) {
+      timer_heap.pop();
+    }
+    if (timer_heap.empty())
+      return ULLONG_MAX;
+
+    auto now = clock::now();
+    if (timer_heap.top().first <= now)
+      return 0;
+
+    // Round up so the loop does not wake just before the deadline.
+    auto remaining = std::chrono::duration_cast<std::chrono::microseconds>(
+        timer_heap.top().first - now).count();
+    return (remaining + 999) / 1000;
+  }
+
+  void runner::run_timers() {
+    auto now = clock::now();
+    while (!timer_heap.empty() && timer_heap.top().first <= now) {
+      unsigned long long id = timer_heap.top().second;
+      timer_heap.pop();
+
+      // The callback may add or cancel timers.
+      auto timer = timers.find(id);
+      if (timer != timers.end()) {
+        std::function<void()> callback(timer->second);
+        timers.erase(timer);
+        callback();
+      }
+    }
+  }
+
+  void runner::run_timeouts(const std::list<unsigned long long>& timeouts,
+      unsigned long long elapsed) {
+    auto timeout = timeouts.cbegin();
+    for (auto iter = runners.begin(); iter != runners.end(); iter++, timeout++) {
+      if (*timeout <= elapsed)
+        (*iter)->run_from_timeout();
+    }
+  }
+
+  int runner::convert_timeout(unsigned long long timeout) {
+    if (timeout == ULLONG_MAX)
+      return -1;
+    else if (timeout > INT_MAX)
+      return INT_MAX;
+    else
+      return static_cast<int>(timeout);
   }
 
-  void runner::convert_timeout(unsigned long long& timeout,
-      timespec& tv) {
-    tv.tv_sec = timeout / 1000LL;
-    tv.tv_nsec = (timeout - (tv.tv_sec * 1000LL)) * 1000000LL;
+  void runner::drain_wakeup_fd() {
+    uint64_t count;
+    while (read(wakeup_fd, &count, sizeof(count)) > 0) { }
   }
 }
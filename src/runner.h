@@ -26,30 +26,59 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <list>
+#include <queue>
+#include <unordered_map>
+#include <vector>
 
 #include "logger.h"
+#include "event_loop.h"
 #include "runnable.h"
 
 namespace ledger_rest {
-  class runner {
+  class runner : public event_loop {
     public:
-      runner(ledger_rest::logger& logger, std::list<runnable*> runners)
-        : logger(logger), runners(runners), is_running(true) { }
+      runner(ledger_rest::logger& logger, std::list<runnable*> runners);
       runner(const runner&) = delete;
       runner& operator=(const runner&) = delete;
       runner (runner&&) = delete;
       runner& operator=(const runner&&) = delete;
-      virtual ~runner() { }
+      virtual ~runner();
 
       void run();
       void stop();
 
+      virtual void add_fd(int fd, uint32_t events, runnable* owner);
+      virtual void remove_fd(int fd);
+      virtual unsigned long long add_timer(unsigned long long delay,
+          std::function<void()> callback);
+      virtual void cancel_timer(unsigned long long id);
+
     private:
+      typedef std::chrono::steady_clock clock;
+      typedef std::pair<clock::time_point, unsigned long long> timer_entry;
+
       ledger_rest::logger& logger;
-      bool is_running;
+      std::atomic<bool> is_running;
       std::list<runnable*> runners;
+      std::unordered_map<int, runnable*> fd_owners;
+      int epoll_fd;
+      int wakeup_fd;
+      // Earliest deadline first. Cancelled timers stay in the heap until they
+      // expire and are skipped because they are no longer in timers.
+      std::priority_queue<timer_entry, std::vector<timer_entry>,
+        std::greater<timer_entry>> timer_heap;
+      std::unordered_map<unsigned long long, std::function<void()>> timers;
+      unsigned long long next_timer_id;
 
-      void convert_timeout(unsigned long long& timeout, timespec& tv);
+      unsigned long long get_timer_timeout();
+      void run_timers();
+      void run_timeouts(const std::list<unsigned long long>& timeouts,
+          unsigned long long elapsed);
+      int convert_timeout(unsigned long long timeout);
+      void drain_wakeup_fd();
   };
 }
@@ -0,0 +1,203 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "snapshot_file.h"
+#include "mapped_file.h"
+
+namespace ledger_rest {
+  namespace {
+    // Version 2 layout, all integers in host byte order:
+    //   magic, uint32 version, uint32 reserved, uint64 key
+    //   accounts, account names, payee names, commodity names: uint64 count
+    //     and then uint32 length and bytes for each string
+    //   uint64 posting count and then each posting_table column in turn
+    const char magic[8] = { 'L', 'R', 'S', 'N', 'A', 'P', '\0', '\0' };
+    // Version 1 amounts were rounded and had no posting_table::INEXACT.
+    const uint32_t version = 2;
+
+    template<typename T>
+    void append(std::string& buffer, T value) {
+      buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    template<typename T>
+    void append_column(std::string& buffer, const std::vector<T>& column) {
+      buffer.append(reinterpret_cast<const char*>(column.data()), column.size() * sizeof(T));
+    }
+
+    template<typename C>
+    void append_strings(std::string& buffer, const C& strings) {
+      append<uint64_t>(buffer, strings.size());
+      for (const std::string& s : strings) {
+        append<uint32_t>(buffer, s.size());
+        buffer.append(s);
+      }
+    }
+
+    class reader {
+      public:
+        reader(const char* data, std::size_t size) : p(data), end(data + size) { }
+
+        void read_bytes(void* out, std::size_t size) {
+          if (static_cast<std::size_t>(end - p) < size)
+            throw std::runtime_error("Snapshot file is truncated.");
+          memcpy(out, p, size);
+          p += size;
+        }
+
+        template<typename T>
+        T read() {
+          T value;
+          read_bytes(&value, sizeof(value));
+          return value;
+        }
+
+        template<typename T>
+        void read_column(std::vector<T>& column, std::size_t count) {
+          if (static_cast<std::size_t>(end - p) / sizeof(T) < count)
+            throw std::runtime_error("Snapshot file is truncated.");
+          column.resize(count);
+          read_bytes(column.data(), count * sizeof(T));
+        }
+
+        template<typename C>
+        void read_strings(C& strings) {
+          uint64_t count = read<uint64_t>();
+          for (uint64_t i = 0; i < count; i++) {
+            uint32_t length = read<uint32_t>();
+            if (static_cast<std::size_t>(end - p) < length)
+              throw std::runtime_error("Snapshot file is truncated.");
+            strings.push_back(std::string(p, length));
+            p += length;
+          }
+        }
+
+        bool is_done() const {
+          return p == end;
+        }
+
+      private:
+        const char* p;
+        const char* end;
+    };
+
+    void check_ids(const std::vector<uint32_t>& ids, std::size_t limit) {
+      for (uint32_t id : ids) {
+        if (id >= limit)
+          throw std::runtime_error("Snapshot file has an invalid name index.");
+      }
+    }
+  }
+
+  // Written to a temporary file and renamed so that readers never see a
+  // partial snapshot.
+  void write_snapshot_file(const std::string& path, unsigned long long key,
+      const std::list<std::string>& accounts, const posting_table& postings) {
+    std::string buffer;
+    buffer.append(magic, sizeof(magic));
+    append<uint32_t>(buffer, version);
+    append<uint32_t>(buffer, 0);
+    append<uint64_t>(buffer, key);
+
+    append_strings(buffer, accounts);
+    append_strings(buffer, postings.account_names);
+    append_strings(buffer, postings.payee_names);
+    append_strings(buffer, postings.commodity_names);
+
+    append<uint64_t>(buffer, postings.size());
+    append_column(buffer, postings.dates);
+    append_column(buffer, postings.amounts);
+    append_column(buffer, postings.account_ids);
+    append_column(buffer, postings.payee_ids);
+    append_column(buffer, postings.xact_ids);
+    append_column(buffer, postings.commodity_ids);
+    append_column(buffer, postings.post_flags);
+
+    std::string temp_path(path + ".tmp");
+    {
+      std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+      out.write(buffer.data(), buffer.size());
+      out.close();
+      if (!out)
+        throw std::runtime_error("Could not write snapshot file " + temp_path);
+    }
+
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+      std::remove(temp_path.c_str());
+      throw std::runtime_error("Could not rename snapshot file to " + path);
+    }
+  }
+
+  bool read_snapshot_file(const std::string& path, unsigned long long key,
+      std::list<std::string>& accounts, posting_table& postings) {
+    mapped_file file(path);
+    if (file.size() == 0) {
+      return false;
+    }
+
+    reader in(file.data(), file.size());
+    char file_magic[sizeof(magic)];
+    in.read_bytes(file_magic, sizeof(file_magic));
+    if (memcmp(file_magic, magic, sizeof(magic)) != 0)
+      throw std::runtime_error("Not a snapshot file: " + path);
+    if (in.read<uint32_t>() != version)
+      return false;
+    in.read<uint32_t>();
+    if (in.read<uint64_t>() != key)
+      return false;
+
+    std::list<std::string> file_accounts;
+    posting_table table;
+    in.read_strings(file_accounts);
+    in.read_strings(table.account_names);
+    in.read_strings(table.payee_names);
+    in.read_strings(table.commodity_names);
+
+    uint64_t count = in.read<uint64_t>();
+    in.read_column(table.dates, count);
+    in.read_column(table.amounts, count);
+    in.read_column(table.account_ids, count);
+    in.read_column(table.payee_ids, count);
+    in.read_column(table.xact_ids, count);
+    in.read_column(table.commodity_ids, count);
+    in.read_column(table.post_flags, count);
+    if (!in.is_done())
+      throw std::runtime_error("Snapshot file has trailing data: " + path);
+
+    check_ids(table.account_ids, table.account_names.size());
+    check_ids(table.payee_ids, table.payee_names.size());
+    check_ids(table.commodity_ids, table.commodity_names.size());
+
+    accounts.swap(file_accounts);
+    postings = std::move(table);
+    return true;
+  }
+}
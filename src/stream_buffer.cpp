@@ -0,0 +1,116 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "stream_buffer.h"
+
+namespace ledger_rest {
+  const std::chrono::seconds stream_buffer::stall_timeout(60);
+
+  stream_buffer::stream_buffer(std::size_t capacity, std::function<void()> wake)
+    : capacity(capacity), wake(wake), read_offset(0), is_closed(false), is_failed(false),
+    is_cancelled(false), is_reader_paused(false) {
+  }
+
+  // Large writes are split so that the buffer never holds more than
+  // capacity bytes.
+  void stream_buffer::write(const char* data, std::size_t size) {
+    std::unique_lock<std::mutex> lock(buffer_mutex);
+    while (size > 0) {
+      bool has_space = space_cv.wait_for(lock, stall_timeout, [this]() {
+        return is_cancelled || this->data.size() - read_offset < capacity;
+      });
+      if (!has_space) {
+        is_cancelled = true;
+        throw std::runtime_error("Client stopped reading the response.");
+      } else if (is_cancelled) {
+        throw std::runtime_error("Client went away before the response was done.");
+      }
+
+      // Drop what has been read before growing the buffer.
+      if (read_offset > 0) {
+        this->data.erase(0, read_offset);
+        read_offset = 0;
+      }
+
+      std::size_t chunk = std::min(size, capacity - this->data.size());
+      this->data.append(data, chunk);
+      data += chunk;
+      size -= chunk;
+      wake_reader();
+    }
+  }
+
+  void stream_buffer::close(bool is_failed) {
+    std::lock_guard<std::mutex> lock(buffer_mutex);
+    is_closed = true;
+    this->is_failed = is_failed;
+    wake_reader();
+  }
+
+  void stream_buffer::cancel() {
+    {
+      std::lock_guard<std::mutex> lock(buffer_mutex);
+      is_cancelled = true;
+    }
+    space_cv.notify_all();
+  }
+
+  stream_buffer::read_status stream_buffer::read(char* buffer, std::size_t size,
+      std::size_t& read_size, const std::function<void()>& pause) {
+    read_size = 0;
+    {
+      std::lock_guard<std::mutex> lock(buffer_mutex);
+      std::size_t available = data.size() - read_offset;
+      if (available == 0) {
+        if (is_closed) {
+          return is_failed ? FAILED : END;
+        }
+        is_reader_paused = true;
+        pause();
+        return WAITING;
+      }
+
+      read_size = std::min(size, available);
+      memcpy(buffer, data.data() + read_offset, read_size);
+      read_offset += read_size;
+    }
+    space_cv.notify_one();
+    return DATA;
+  }
+
+  // Must be called with buffer_mutex held so that wake cannot run before
+  // the reader has finished pausing.
+  void stream_buffer::wake_reader() {
+    if (is_reader_paused) {
+      is_reader_paused = false;
+      wake();
+    }
+  }
+}
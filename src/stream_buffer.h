@@ -0,0 +1,84 @@
+/* * Copyright (c) 2015-2020 Chad Voegele
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *  * The name of Chad Voegele may not be used to endorse or promote products
+ * derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include "http.h"
+
+namespace ledger_rest {
+  // A bounded pipe from a producer on a worker thread to the event loop
+  // thread, which must never block. The producer waits while the buffer is
+  // full. When the reader finds the buffer empty it is given a chance to
+  // pause (e.g. suspend its connection) and wake is called once there is
+  // something to read again.
+  class stream_buffer : public http::body_writer {
+    public:
+      stream_buffer(std::size_t capacity, std::function<void()> wake);
+      stream_buffer(const stream_buffer&) = delete;
+      stream_buffer& operator=(const stream_buffer&) = delete;
+      stream_buffer (stream_buffer&&) = delete;
+      stream_buffer& operator=(const stream_buffer&&) = delete;
+      virtual ~stream_buffer() { }
+
+      virtual void write(const char* data, std::size_t size);
+      using http::body_writer::write;
+      // No more data will be written. is_failed marks the body as
+      // incomplete.
+      void close(bool is_failed = false);
+      // The reader has gone away; further writes throw.
+      void cancel();
+
+      enum read_status { DATA, WAITING, END, FAILED };
+      // Copies up to size bytes out. If there is nothing to read yet, calls
+      // pause with the buffer locked and returns WAITING.
+      read_status read(char* buffer, std::size_t size, std::size_t& read_size,
+          const std::function<void()>& pause);
+
+      // How long a write waits for the reader before giving up on it.
+      static const std::chrono::seconds stall_timeout;
+
+    private:
+      const std::size_t capacity;
+      const std::function<void()> wake;
+      std::mutex buffer_mutex;
+      std::condition_variable space_cv;
+      std::string data;
+      std::size_t read_offset;
+      bool is_closed;
+      bool is_failed;
+      bool is_cancelled;
+      bool is_reader_paused;
+
+      void wake_reader();
+  };
+}
@@ -0,0 +1,62 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include "json_writer.h"
+#include "string_dictionary.h"
+
+namespace ledger_rest {
+  uint32_t string_dictionary::intern(const std::string& s) {
+    auto id = ids.emplace(s, static_cast<uint32_t>(strings.size()));
+    if (id.second) {
+      strings.push_back(s);
+      json_writer writer(s.size() + 2);
+      writer.write_string(s);
+      json_strings.push_back(writer.release());
+    }
+    return id.first->second;
+  }
+
+  bool string_dictionary::find(const std::string& s, uint32_t& id) const {
+    auto found = ids.find(s);
+    if (found == ids.end()) {
+      return false;
+    }
+    id = found->second;
+    return true;
+  }
+
+  const std::string& string_dictionary::get_string(uint32_t id) const {
+    return strings[id];
+  }
+
+  const std::string& string_dictionary::get_json(uint32_t id) const {
+    return json_strings[id];
+  }
+
+  std::size_t string_dictionary::size() const {
+    return strings.size();
+  }
+}
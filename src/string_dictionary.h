@@ -0,0 +1,61 @@
+/* * Copyright (c) 2015-2020 Chad Voegele
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *  * The name of Chad Voegele may not be used to endorse or promote products
+ * derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ledger_rest {
+  // Strings interned with ids in order of first appearance. Each string is
+  // also kept as a quoted, escaped JSON string so that reports copy it rather
+  // than escape it again for every posting.
+  class string_dictionary {
+    public:
+      string_dictionary() { }
+      string_dictionary(const string_dictionary&) = delete;
+      string_dictionary& operator=(const string_dictionary&) = delete;
+      string_dictionary (string_dictionary&&) = delete;
+      string_dictionary& operator=(const string_dictionary&&) = delete;
+      virtual ~string_dictionary() { }
+
+      uint32_t intern(const std::string& s);
+      // Returns false if s has not been interned.
+      bool find(const std::string& s, uint32_t& id) const;
+      const std::string& get_string(uint32_t id) const;
+      const std::string& get_json(uint32_t id) const;
+      std::size_t size() const;
+
+    private:
+      std::vector<std::string> strings;
+      std::vector<std::string> json_strings;
+      std::unordered_map<std::string, uint32_t> ids;
+  };
+}
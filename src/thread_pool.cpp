@@ -0,0 +1,199 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+
+#include "thread_pool.h"
+
+namespace ledger_rest {
+  thread_pool::thread_pool(unsigned int size, ::ledger_rest::logger& logger)
+    : logger(logger), is_stopping(false) {
+    if (size == 0)
+      throw std::runtime_error("Thread pool needs at least one worker.");
+
+    for (unsigned int i = 0; i < size; i++) {
+      workers.push_back(std::thread(&thread_pool::work, this));
+    }
+  }
+
+  thread_pool::~thread_pool() {
+    {
+      std::lock_guard<std::mutex> lock(tasks_mutex);
+      is_stopping = true;
+    }
+    tasks_cv.notify_all();
+
+    for (auto iter = workers.begin(); iter != workers.end(); iter++) {
+      iter->join();
+    }
+  }
+
+  void thread_pool::submit(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(tasks_mutex);
+      tasks.push(task);
+    }
+    tasks_cv.notify_one();
+  }
+
+  void thread_pool::parallel_for(std::size_t count, std::function<void(std::size_t)> body) {
+    parallel_for(count, std::move(body), std::function<void(std::size_t)>());
+  }
+
+  void thread_pool::parallel_for(std::size_t count, std::function<void(std::size_t)> body,
+      std::function<void(std::size_t)> ready) {
+    if (count == 0) {
+      return;
+    }
+
+    // Workers may only get to their task after this returns, by which time
+    // no index is left and they return at once.
+    struct shared_state {
+      std::function<void(std::size_t)> body;
+      std::size_t count;
+      std::mutex mutex;
+      std::condition_variable cv;
+      std::size_t next;
+      std::size_t running;
+      std::vector<bool> is_done;
+      bool is_stopped;
+      std::exception_ptr error;
+    };
+    std::shared_ptr<shared_state> state = std::make_shared<shared_state>();
+    state->body = std::move(body);
+    state->count = count;
+    state->next = 0;
+    state->running = 0;
+    state->is_done.assign(count, false);
+    state->is_stopped = false;
+
+    // Runs the next index. Called and returns with the mutex held.
+    auto run_next = [state](std::unique_lock<std::mutex>& lock) {
+      std::size_t i = state->next++;
+      state->running++;
+      lock.unlock();
+      std::exception_ptr error;
+      try {
+        state->body(i);
+
+      } catch (...) {
+        error = std::current_exception();
+      }
+      lock.lock();
+
+      state->running--;
+      state->is_done[i] = true;
+      if (error && !state->error) {
+        state->error = error;
+        state->is_stopped = true;
+      }
+      state->cv.notify_all();
+    };
+
+    auto run = [state, run_next]() {
+      std::unique_lock<std::mutex> lock(state->mutex);
+      while (!state->is_stopped && state->next < state->count) {
+        run_next(lock);
+      }
+    };
+
+    std::size_t helpers = std::min<std::size_t>(count - 1, workers.size());
+    for (std::size_t i = 0; i < helpers; i++) {
+      submit(run);
+    }
+
+    // Indexes that are ready are passed on before more are taken.
+    std::exception_ptr ready_error;
+    std::size_t ready_count = 0;
+    std::unique_lock<std::mutex> lock(state->mutex);
+    while (!state->is_stopped && ready_count < count) {
+      if (state->is_done[ready_count]) {
+        lock.unlock();
+        try {
+          if (ready) {
+            ready(ready_count);
+          }
+        } catch (...) {
+          ready_error = std::current_exception();
+        }
+        ready_count++;
+        lock.lock();
+        if (ready_error) {
+          state->is_stopped = true;
+        }
+
+      } else if (state->next < count) {
+        run_next(lock);
+
+      } else {
+        state->cv.wait(lock);
+      }
+    }
+
+    state->cv.wait(lock, [&state]() { return state->running == 0; });
+    if (ready_error) {
+      std::rethrow_exception(ready_error);
+    }
+    if (state->error) {
+      std::rethrow_exception(state->error);
+    }
+  }
+
+  unsigned int thread_pool::size() const {
+    return workers.size();
+  }
+
+  // Queued tasks are still run after the pool starts stopping so that
+  // nothing waiting on them (e.g. a suspended connection) is left hanging.
+  void thread_pool::work() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(tasks_mutex);
+        tasks_cv.wait(lock, [this]() { return is_stopping || !tasks.empty(); });
+        if (tasks.empty())
+          return;
+
+        task = tasks.front();
+        tasks.pop();
+      }
+
+      try {
+        task();
+
+      } catch (const std::exception& e) {
+        logger.log(5, e.what());
+
+      } catch (...) {
+        logger.log(5, "Unknown error in worker thread.");
+      }
+    }
+  }
+}
@@ -0,0 +1,72 @@
+/* * Copyright (c) 2015-2020 Chad Voegele
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice, this
+ * list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation and/or
+ * other materials provided with the distribution.
+ *  * The name of Chad Voegele may not be used to endorse or promote products
+ * derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "logger.h"
+
+namespace ledger_rest {
+  class thread_pool {
+    public:
+      thread_pool(unsigned int size, ::ledger_rest::logger& logger);
+      thread_pool(const thread_pool&) = delete;
+      thread_pool& operator=(const thread_pool&) = delete;
+      thread_pool (thread_pool&&) = delete;
+      thread_pool& operator=(const thread_pool&&) = delete;
+      virtual ~thread_pool();
+
+      void submit(std::function<void()> task);
+      // Runs body for each index below count and returns once all have run.
+      // The calling thread runs indexes too so that a task of this pool may
+      // call it without waiting on workers that are all busy. Once body
+      // throws no more indexes are started and the exception is rethrown.
+      void parallel_for(std::size_t count, std::function<void(std::size_t)> body);
+      // Also calls ready on the calling thread, in order, for each index
+      // once body has run for it and every index before it. An exception
+      // from ready stops parallel_for as one from body does.
+      void parallel_for(std::size_t count, std::function<void(std::size_t)> body,
+          std::function<void(std::size_t)> ready);
+      unsigned int size() const;
+
+    private:
+      ::ledger_rest::logger& logger;
+      std::vector<std::thread> workers;
+      std::queue<std::function<void()>> tasks;
+      std::mutex tasks_mutex;
+      std::condition_variable tasks_cv;
+      bool is_stopping;
+
+      void work();
+  };
+}
@@ -0,0 +1,81 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include <string>
+#include <gtest/gtest.h>
+
+#include "body_spool.h"
+
+TEST(body_spool, memory_test) {
+  ledger_rest::body_spool spool(16);
+  spool.write(std::string("[1, "));
+  spool.write(std::string("2]"));
+  ASSERT_FALSE(spool.is_spilled());
+  ASSERT_EQ(6u, spool.size());
+
+  http::string_body_writer out;
+  spool.write_to(out);
+  ASSERT_EQ(std::string("[1, 2]"), out.body);
+  ASSERT_EQ(std::string("[1, 2]"), spool.release());
+}
+
+TEST(body_spool, spill_test) {
+  ledger_rest::body_spool spool(100);
+  std::string expected;
+  for (int i = 0; i < 100000; i++) {
+    std::string s(std::to_string(i) + ",");
+    spool.write(s);
+    expected += s;
+  }
+  ASSERT_TRUE(spool.is_spilled());
+  ASSERT_EQ(expected.size(), spool.size());
+  ASSERT_THROW(spool.release(), std::runtime_error);
+
+  // Sending the body does not use it up.
+  for (int i = 0; i < 2; i++) {
+    http::string_body_writer out;
+    spool.write_to(out);
+    ASSERT_EQ(expected, out.body);
+  }
+}
+
+TEST(body_spool, memory_limit_test) {
+  // A register many times the limit, written as post_writer does.
+  ledger_rest::body_spool spool(64 * 1024);
+  std::string chunk;
+  while (chunk.size() < 16 * 1024) {
+    chunk += "{\"amount\" : 10.5, \"date\" : \"2015-05-16\", \"account_name\" : \"expenses\"}, ";
+  }
+  spool.write(std::string("["));
+  for (int i = 0; i < 256; i++) {
+    spool.write(chunk);
+    ASSERT_LE(spool.get_memory_size(), 64u * 1024);
+  }
+  spool.write(std::string("]"));
+  ASSERT_TRUE(spool.is_spilled());
+  ASSERT_EQ(0u, spool.get_memory_size());
+  ASSERT_EQ(2 + 256 * chunk.size(), spool.size());
+}
@@ -0,0 +1,107 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include <gtest/gtest.h>
+
+#include "compression.h"
+
+std::string inflate_string(const std::string& data, int window_bits) {
+  z_stream zlib = {};
+  inflateInit2(&zlib, window_bits);
+  zlib.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  zlib.avail_in = data.size();
+
+  std::string result;
+  char buffer[4096];
+  int status;
+  do {
+    zlib.next_out = reinterpret_cast<Bytef*>(buffer);
+    zlib.avail_out = sizeof(buffer);
+    status = inflate(&zlib, Z_NO_FLUSH);
+    result.append(buffer, sizeof(buffer) - zlib.avail_out);
+  } while (status == Z_OK);
+  inflateEnd(&zlib);
+  return result;
+}
+
+std::string build_register_json() {
+  std::string json("[");
+  for (int i = 0; i < 2000; i++) {
+    json += "{\"amount\" : 10.00, \"total\" : 10.00, \"date\" : \"2015-05-16\", "
+      "\"payee\" : \"movie\", \"account_name\" : \"expenses:fun\"}, ";
+  }
+  return json + "]";
+}
+
+TEST(compression, negotiate_encoding_test) {
+  ASSERT_EQ(ledger_rest::content_encoding::IDENTITY, ledger_rest::negotiate_encoding(""));
+  ASSERT_EQ(ledger_rest::content_encoding::GZIP, ledger_rest::negotiate_encoding("gzip"));
+  ASSERT_EQ(ledger_rest::content_encoding::GZIP,
+      ledger_rest::negotiate_encoding("deflate, gzip"));
+  ASSERT_EQ(ledger_rest::content_encoding::DEFLATE,
+      ledger_rest::negotiate_encoding("deflate;q=1.0, gzip;q=0.5"));
+  ASSERT_EQ(ledger_rest::content_encoding::IDENTITY,
+      ledger_rest::negotiate_encoding("gzip;q=0, br"));
+  ASSERT_EQ(ledger_rest::content_encoding::DEFLATE,
+      ledger_rest::negotiate_encoding("*, gzip;q=0, zstd;q=0"));
+}
+
+TEST(compression, gzip_test) {
+  std::string json(build_register_json());
+  std::string compressed(ledger_rest::compress(json, ledger_rest::content_encoding::GZIP, 6));
+  ASSERT_LT(compressed.size() * 10, json.size());
+  ASSERT_EQ(json, inflate_string(compressed, 15 + 16));
+}
+
+#ifdef HAVE_ZSTD
+TEST(compression, zstd_test) {
+  std::string json(build_register_json());
+  std::string compressed(ledger_rest::compress(json, ledger_rest::content_encoding::ZSTD, 3));
+  ASSERT_LT(compressed.size() * 10, json.size());
+
+  std::string decompressed(json.size(), '\0');
+  std::size_t size = ZSTD_decompress(&decompressed[0], decompressed.size(),
+      compressed.data(), compressed.size());
+  ASSERT_FALSE(ZSTD_isError(size));
+  decompressed.resize(size);
+  ASSERT_EQ(json, decompressed);
+}
+#endif
+
+TEST(compression, deflate_stream_test) {
+  std::string json(build_register_json());
+  http::string_body_writer output;
+  ledger_rest::compressing_body_writer writer(output, ledger_rest::content_encoding::DEFLATE, 1);
+  for (std::size_t i = 0; i < json.size(); i += 1000) {
+    writer.write(json.substr(i, 1000));
+  }
+  writer.finish();
+  ASSERT_EQ(json, inflate_string(output.body, 15));
+}
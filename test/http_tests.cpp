@@ -0,0 +1,67 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include <gtest/gtest.h>
+
+#include "http.h"
+
+TEST(http, get_header_test) {
+  http::request req(std::string("GET"), std::string("/a"),
+      std::map<std::string, std::string>{{"if-none-match", "\"abc\""}},
+      std::multimap<std::string, std::string>());
+  ASSERT_EQ(std::string("\"abc\""), req.get_header("If-None-Match"));
+  ASSERT_EQ(std::string(""), req.get_header("If-Modified-Since"));
+}
+
+TEST(http, http_date_test) {
+  std::string date(http::format_http_date(784111777));
+  ASSERT_EQ(std::string("Sun, 06 Nov 1994 08:49:37 GMT"), date);
+
+  std::time_t time;
+  ASSERT_TRUE(http::parse_http_date(date, time));
+  ASSERT_EQ(784111777, time);
+  ASSERT_FALSE(http::parse_http_date("yesterday", time));
+}
+
+TEST(http, etag_matches_test) {
+  ASSERT_TRUE(http::etag_matches("\"abc\"", "\"abc\""));
+  ASSERT_TRUE(http::etag_matches("\"x\", W/\"abc\"", "\"abc\""));
+  ASSERT_TRUE(http::etag_matches("*", "\"abc\""));
+  ASSERT_FALSE(http::etag_matches("\"abcd\"", "\"abc\""));
+  ASSERT_FALSE(http::etag_matches("", "\"abc\""));
+}
+
+TEST(http, response_shares_body_test) {
+  http::response res(http::status_code::OK, std::string("[1, 2]"),
+      std::map<std::string, std::string>());
+  http::response copy(res);
+  ASSERT_EQ(res.body.get(), copy.body.get());
+
+  const std::string* body = res.body.get();
+  http::response moved(std::move(res));
+  ASSERT_EQ(body, moved.body.get());
+  ASSERT_EQ(std::string("[1, 2]"), *moved.body);
+}
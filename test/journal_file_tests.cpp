@@ -0,0 +1,124 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include <gtest/gtest.h>
+
+#include "definitions.h"
+#include "journal_file.h"
+
+TEST(journal_file, hash_bytes_test) {
+  std::string a("2015/05/15 payee\n");
+  std::string b("2015/05/16 payee\n");
+  ASSERT_EQ(ledger_rest::hash_bytes(a.data(), a.size()),
+      ledger_rest::hash_bytes(a.data(), a.size()));
+  ASSERT_NE(ledger_rest::hash_bytes(a.data(), a.size()),
+      ledger_rest::hash_bytes(b.data(), b.size()));
+}
+
+TEST(journal_file, hash_bytes_xxh64_test) {
+  ASSERT_EQ(0xEF46DB3751D8E999ULL, ledger_rest::hash_bytes("", 0));
+  ASSERT_EQ(0xD24EC4F1A98C6E5BULL, ledger_rest::hash_bytes("a", 1));
+  ASSERT_EQ(0x44BC2CF5AD770999ULL, ledger_rest::hash_bytes("abc", 3));
+  std::string long_input("Nobody inspects the spammish repetition");
+  ASSERT_EQ(0xFBCEA83C8A378BF1ULL, ledger_rest::hash_bytes(long_input.data(), long_input.size()));
+}
+
+TEST(journal_file, hash_journal_files_test) {
+  std::list<ledger_rest::journal_file_state> files(1);
+  files.front().path = "a.txt";
+  files.front().hash = 1;
+  unsigned long long key = ledger_rest::hash_journal_files(files);
+  ASSERT_EQ(key, ledger_rest::hash_journal_files(files));
+
+  files.front().hash = 2;
+  ASSERT_NE(key, ledger_rest::hash_journal_files(files));
+}
+
+TEST(journal_file, stateful_directives_test) {
+  ASSERT_FALSE(ledger_rest::has_stateful_directives(
+        "~Monthly\n  assets:cash\n\n2015/01/15 payee\n  assets:cash  $10\n  income\n"));
+  ASSERT_TRUE(ledger_rest::has_stateful_directives(
+        "apply account personal\n2015/01/15 payee\n  assets:cash  $10\n  income\n"));
+  ASSERT_TRUE(ledger_rest::has_stateful_directives("year 2015\n01/15 payee\n"));
+  ASSERT_TRUE(ledger_rest::has_stateful_directives("= expenses\n  (budget)  1\n"));
+  ASSERT_TRUE(ledger_rest::has_stateful_directives("!apply tag x\n"));
+}
+
+TEST(journal_file, appendable_tail_test) {
+  ASSERT_TRUE(ledger_rest::is_appendable_tail(
+        "\n2015/07/21 payee\n  assets:cash   -$20\n  expenses:fun   $20\n"));
+  ASSERT_TRUE(ledger_rest::is_appendable_tail(
+        "; note\n2015-7-21 * payee\n  assets:cash   -$20\n  expenses:fun"));
+  ASSERT_TRUE(ledger_rest::is_appendable_tail(""));
+}
+
+TEST(journal_file, unappendable_tail_test) {
+  ASSERT_FALSE(ledger_rest::is_appendable_tail("  expenses:fun   $20\n"));
+  ASSERT_FALSE(ledger_rest::is_appendable_tail("07/21 payee\n  assets:cash   -$20\n"));
+  ASSERT_FALSE(ledger_rest::is_appendable_tail("include other.txt\n"));
+  ASSERT_FALSE(ledger_rest::is_appendable_tail("P 2015/07/21 AAPL $100\n"));
+  ASSERT_FALSE(ledger_rest::is_appendable_tail("2015/07/21 payee\n\n  assets:cash\n"));
+}
+
+TEST(journal_file, appended_offset_test) {
+  std::string before("2015/07/20 payee\n  assets:cash   -$20\n  expenses:fun   $20\n");
+  ledger_rest::journal_file_state state
+    = ledger_rest::get_journal_file_state("a.txt", before);
+
+  std::string appended(before + "\n2015/07/21 payee\n  assets:cash   -$20\n  expenses:fun\n");
+  ASSERT_EQ(before.size(), ledger_rest::get_appended_offset(state, appended));
+
+  std::string edited(appended);
+  edited[0] = '3';
+  ASSERT_EQ(std::string::npos, ledger_rest::get_appended_offset(state, edited));
+  ASSERT_EQ(std::string::npos, ledger_rest::get_appended_offset(state, before));
+}
+
+TEST(journal_file, plain_journal_test) {
+  ASSERT_TRUE(ledger_rest::is_plain_journal(
+        "account expenses:fun\n  note For fun\n\ninclude 2015.txt\n"
+        "2015/01/15 payee\n  assets:cash  $10\n  income\n"));
+  ASSERT_FALSE(ledger_rest::is_plain_journal("~Monthly\n  assets:cash\n"));
+  ASSERT_FALSE(ledger_rest::is_plain_journal("P 2015/07/21 AAPL $100\n"));
+}
+
+TEST(journal_file, include_directives_test) {
+  std::list<std::string> expected = { "a.txt", "b.txt", "c/*.txt" };
+  ASSERT_EQ(expected, ledger_rest::get_include_directives(
+        "include a.txt\n; include x.txt\n!include b.txt \n@include c/*.txt\n"));
+}
+
+TEST(journal_file, resolve_include_test) {
+  std::string main(RESOURCE_PATH + std::string("/ledger_nested.txt"));
+  std::list<std::string> expected = {
+    RESOURCE_PATH + std::string("/nested/year_2014.txt"),
+    RESOURCE_PATH + std::string("/nested/year_2015.txt")
+  };
+  ASSERT_EQ(expected, ledger_rest::resolve_include(main, "nested/year_*.txt"));
+
+  std::list<std::string> absolute = { "/a/b.txt" };
+  ASSERT_EQ(absolute, ledger_rest::resolve_include(main, "/a/b.txt"));
+}
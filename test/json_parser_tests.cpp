@@ -28,6 +28,7 @@
 #include <gtest/gtest.h>
 
 #include "json_parser.h"
+#include "scaling.h"
 
 void run_trim_whitespace_test(std::string input, std::string expected) {
   std::string actual = ledger_rest::trim_whitespace(input);
@@ -101,3 +102,59 @@ TEST(json_parser, parse_register_request5) {
   };
   run_parse_register_request_json_test(input, expected);
 }
+
+TEST(json_parser, parse_register_request_escapes) {
+  std::string input = "[ {\"query\" : [\"say \\\"hi\\\"\", \"a\\\\b\", \"caf\\u00e9\", \"\\ud83d\\ude00\"]} ]\n";
+  std::list<std::unordered_map<std::string, std::list<std::string>>> expected = {
+    { {"query", {"say \"hi\"", "a\\b", "caf\xc3\xa9", "\xf0\x9f\x98\x80"}} }
+  };
+  run_parse_register_request_json_test(input, expected);
+}
+
+TEST(json_parser, parse_register_request_numbers_and_nesting) {
+  std::string input = "[{\"args\": [\"--depth\", 2], \"options\": {\"a\": [1, {\"b\": null}]}, \"query\": [\"expenses\"]}]";
+  std::list<std::unordered_map<std::string, std::list<std::string>>> expected = {
+    { {"args", {"--depth", "2"}}, {"query", {"expenses"}} }
+  };
+  run_parse_register_request_json_test(input, expected);
+}
+
+TEST(json_parser, parse_register_request_invalid) {
+  std::list<std::unordered_map<std::string, std::list<std::string>>> expected = { };
+  run_parse_register_request_json_test("[{\"query\": [\"expenses\"]}", expected);
+  run_parse_register_request_json_test("[{\"query\": [\"expenses]}]", expected);
+  run_parse_register_request_json_test("[{\"query\": [\"expenses\"]}] x", expected);
+  run_parse_register_request_json_test("", expected);
+  // Lone surrogates have no UTF-8 encoding.
+  run_parse_register_request_json_test("[{\"query\": [\"\\ud800\"]}]", expected);
+  run_parse_register_request_json_test("[{\"query\": [\"\\ud800x\"]}]", expected);
+  run_parse_register_request_json_test("[{\"query\": [\"\\ud800\\u0041\"]}]", expected);
+  run_parse_register_request_json_test("[{\"query\": [\"\\ude00\"]}]", expected);
+}
+
+std::string build_register_batch_json(std::size_t size) {
+  std::string input("[");
+  for (std::size_t i = 0; i < size; i++) {
+    if (i > 0) {
+      input += ", ";
+    }
+    input += "{\"args\": [\"-E\", \"--collapse\"], \"query\": [\"expenses:" + std::to_string(i) + "\"]}";
+  }
+  input += "]";
+  return input;
+}
+
+TEST(json_parser, parse_register_request_large_batch) {
+  std::list<std::unordered_map<std::string, std::list<std::string>>> actual
+    = ledger_rest::parse_register_request_json(build_register_batch_json(20000));
+  ASSERT_EQ(20000u, actual.size());
+  std::list<std::string> expected_query = { "expenses:19999" };
+  ASSERT_EQ(expected_query, actual.back()["query"]);
+
+  // Parsing consumed the body with erase(0, n) once, which was quadratic.
+  std::string small(build_register_batch_json(5000));
+  std::string large(build_register_batch_json(20000));
+  ASSERT_LT(get_scaling_ratio(
+        [&]() { ledger_rest::parse_register_request_json(small); },
+        [&]() { ledger_rest::parse_register_request_json(large); }), 10);
+}
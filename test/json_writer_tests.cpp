@@ -0,0 +1,121 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <random>
+
+#include "json_writer.h"
+#include "scaling.h"
+
+std::string printf_fixed2(double value) {
+  char formatted[512];
+  std::snprintf(formatted, sizeof(formatted), "%.2f", value);
+  return formatted;
+}
+
+std::string write_fixed2(double value) {
+  ledger_rest::json_writer writer;
+  writer.write_fixed2(value);
+  return writer.release();
+}
+
+TEST(json_writer, fixed2_test) {
+  ASSERT_EQ("100.53", write_fixed2(100.534));
+  ASSERT_EQ("-10.50", write_fixed2(-10.5));
+  ASSERT_EQ("0.00", write_fixed2(0));
+  ASSERT_EQ("-0.00", write_fixed2(-0.0));
+  ASSERT_EQ("-0.00", write_fixed2(-0.001));
+  ASSERT_EQ("1234567.89", write_fixed2(1234567.89));
+  ASSERT_EQ(printf_fixed2(0.125), write_fixed2(0.125));
+  ASSERT_EQ(printf_fixed2(2.675), write_fixed2(2.675));
+  ASSERT_EQ(printf_fixed2(1e20), write_fixed2(1e20));
+}
+
+TEST(json_writer, fixed2_matches_printf_test) {
+  std::mt19937_64 generator(7);
+  std::uniform_int_distribution<long long> cents(-1000000000LL, 1000000000LL);
+  std::uniform_real_distribution<double> values(-1e7, 1e7);
+  for (int i = 0; i < 100000; i++) {
+    double amount = cents(generator) / 100.0;
+    ASSERT_EQ(printf_fixed2(amount), write_fixed2(amount));
+    double value = values(generator);
+    ASSERT_EQ(printf_fixed2(value), write_fixed2(value));
+    double half = (cents(generator) + 0.5) / 100.0;
+    ASSERT_EQ(printf_fixed2(half), write_fixed2(half));
+  }
+}
+
+TEST(json_writer, string_test) {
+  ledger_rest::json_writer writer;
+  writer.write_string("Grocery \"Mart\" C:\\ \n\t\x01 and a long tail without escapes");
+  ASSERT_EQ("\"Grocery \\\"Mart\\\" C:\\\\ \\n\\t\\u0001 and a long tail without escapes\"",
+      writer.get_buffer());
+}
+
+TEST(json_writer, string_without_escapes_test) {
+  ledger_rest::json_writer writer;
+  writer.write_string("Expenses:Food:Groceries");
+  writer.write_raw(", ");
+  writer.write_string("");
+  writer.write_raw(", ");
+  writer.write_string("caf\xc3\xa9");
+  ASSERT_EQ("\"Expenses:Food:Groceries\", \"\", \"caf\xc3\xa9\"", writer.get_buffer());
+}
+
+TEST(json_writer, date_test) {
+  ledger_rest::json_writer writer;
+  writer.write_date(2010, 7, 1);
+  writer.write_raw(' ');
+  writer.write_unsigned(0);
+  writer.write_raw(' ');
+  writer.write_unsigned(18446744073709551615ULL);
+  ASSERT_EQ("\"2010-07-01\" 0 18446744073709551615", writer.get_buffer());
+}
+
+void write_register_rows(std::size_t rows) {
+  // Without a capacity, so that the buffer grows as a large register's does.
+  ledger_rest::json_writer writer;
+  writer.write_raw('[');
+  for (std::size_t i = 0; i < rows; i++) {
+    writer.write_raw("{\"amount\": ");
+    writer.write_fixed2(i * 0.25);
+    writer.write_raw(", \"date\": ");
+    writer.write_date(2015, 5, 17);
+    writer.write_raw(", \"payee\": ");
+    writer.write_string("Grocery \"Mart\"");
+    writer.write_raw("}, ");
+  }
+  writer.write_raw(']');
+  ASSERT_GT(writer.release().size(), rows * 50);
+}
+
+TEST(json_writer, large_register_test) {
+  ASSERT_LT(get_scaling_ratio(
+        []() { write_register_rows(50000); },
+        []() { write_register_rows(200000); }), 10);
+}
@@ -25,7 +25,16 @@
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 //
 
+#include <algorithm>
 #include <unordered_map>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <gtest/gtest.h>
 
 #include "ledger_rest_args.h"
@@ -33,6 +42,8 @@
 
 #include "black_hole_logger.h"
 #include "definitions.h"
+#include "file_reader.h"
+#include "thread_pool.h"
 
 typedef ledger_rest::ledger_rest::post_result post_result;
 
@@ -48,6 +59,34 @@ class simple_args : public ledger_rest::ledger_rest_args {
       return std::string("ledger");;
     }
 
+    virtual int get_reload_delay() {
+      return 0;
+    }
+
+    virtual std::string get_snapshot_path() {
+      return snapshot_path;
+    }
+
+    virtual int get_cache_size() {
+      return 1;
+    }
+
+    virtual int get_compression_level() {
+      return 6;
+    }
+
+    virtual int get_compression_min_size() {
+      return compression_min_size;
+    }
+
+    virtual int get_batch_window() {
+      return batch_window;
+    }
+
+    std::string snapshot_path;
+    int batch_window = 0;
+    int compression_min_size = 0;
+
   private:
     std::string path;
 };
@@ -214,6 +253,896 @@ TEST(ledger_rest, respond_fail) {
   ASSERT_EQ(http::status_code::BAD_REQUEST, res3.status_code);
 }
 
+TEST(ledger_rest, respond_not_modified) {
+  black_hole_logger logger;
+  simple_args args(RESOURCE_PATH + std::string("/ledger1.txt"));
+  ledger_rest::ledger_rest lr(args, logger);
+
+  http::request req(std::string("GET"), std::string("/ledger/accounts"),
+      std::map<std::string, std::string>(),
+      std::multimap<std::string, std::string>());
+  http::response res(lr.respond(req));
+  ASSERT_EQ(http::status_code::OK, res.status_code);
+  ASSERT_EQ(1u, res.headers.count("ETag"));
+  ASSERT_EQ(1u, res.headers.count("Last-Modified"));
+
+  http::request req2(std::string("GET"), std::string("/ledger/accounts"),
+      std::map<std::string, std::string>{{"If-None-Match", res.headers.at("ETag")}},
+      std::multimap<std::string, std::string>());
+  http::response res2(lr.respond(req2));
+  ASSERT_EQ(http::status_code::NOT_MODIFIED, res2.status_code);
+  ASSERT_EQ(std::string(""), *res2.body);
+
+  http::request req3(std::string("GET"), std::string("/ledger/report/register"),
+      std::map<std::string, std::string>{{"If-None-Match", res.headers.at("ETag")}},
+      std::multimap<std::string, std::string>{{"query", "expenses"}});
+  http::response res3(lr.respond(req3));
+  ASSERT_EQ(http::status_code::OK, res3.status_code);
+  ASSERT_NE(res.headers.at("ETag"), res3.headers.at("ETag"));
+
+  http::request req4(std::string("GET"), std::string("/ledger/accounts"),
+      std::map<std::string, std::string>{{"if-modified-since", res.headers.at("Last-Modified")}},
+      std::multimap<std::string, std::string>());
+  http::response res4(lr.respond(req4));
+  ASSERT_EQ(http::status_code::NOT_MODIFIED, res4.status_code);
+}
+
+// Exposes what the tests check besides the responses.
+class observed_ledger_rest : public ::ledger_rest::ledger_rest {
+  public:
+    observed_ledger_rest(::ledger_rest::ledger_rest_args& args, ::ledger_rest::logger& logger,
+        ::ledger_rest::thread_pool* pool = NULL)
+      : ::ledger_rest::ledger_rest(args, logger, pool) {
+    }
+
+    // Whether another thread would have to wait for ledger.
+    bool is_ledger_locked() {
+      return std::async(std::launch::async, [this]() {
+        if (!ledger_mutex.try_lock()) {
+          return true;
+        }
+        ledger_mutex.unlock();
+        return false;
+      }).get();
+    }
+
+    void set_spool_memory_limit(std::size_t limit) {
+      spool_memory_limit = limit;
+    }
+
+    std::unique_lock<std::recursive_mutex> lock_ledger() {
+      return std::unique_lock<std::recursive_mutex>(ledger_mutex);
+    }
+
+    unsigned long long get_coalesced_count() {
+      return flights.get_coalesced_count() + renders.get_coalesced_count();
+    }
+
+    unsigned long long get_batch_count() {
+      return batcher.get_batch_count();
+    }
+
+    bool is_loaded() {
+      return is_file_loaded;
+    }
+
+    unsigned long long get_generation() {
+      std::lock_guard<std::recursive_mutex> lock(ledger_mutex);
+      return generation;
+    }
+
+    std::shared_ptr<const journal_snapshot> get_current_snapshot() {
+      return get_snapshot();
+    }
+
+    std::list<post_result> run_register_on(const journal_snapshot& snapshot,
+        const std::list<std::string>& args, const std::list<std::string>& query) {
+      return run_register(snapshot, args, query);
+    }
+};
+
+// Keeps what is logged so tests can check which path a request took.
+class recording_logger : public ::ledger_rest::logger {
+  public:
+    virtual void log(int level, std::string message) {
+      std::lock_guard<std::mutex> lock(mutex);
+      messages.push_back(message);
+    }
+
+    bool has_message(const std::string& message) {
+      std::lock_guard<std::mutex> lock(mutex);
+      return std::find(messages.cbegin(), messages.cend(), message) != messages.cend();
+    }
+
+  private:
+    std::mutex mutex;
+    std::vector<std::string> messages;
+};
+
+// Records whether ledger was locked while the client was sent the body.
+class locked_body_writer : public http::body_writer {
+  public:
+    locked_body_writer(observed_ledger_rest& lr) : is_locked(false), lr(lr) { }
+
+    virtual void write(const char* data, std::size_t size) {
+      is_locked = is_locked || lr.is_ledger_locked();
+      body.append(data, size);
+    }
+    using http::body_writer::write;
+
+    std::string body;
+    bool is_locked;
+
+  private:
+    observed_ledger_rest& lr;
+};
+
+TEST(ledger_rest, respond_register_streamed) {
+  black_hole_logger logger;
+  simple_args args(RESOURCE_PATH + std::string("/ledger1.txt"));
+  observed_ledger_rest lr(args, logger);
+
+  http::request req(std::string("GET"), std::string("/ledger/report/register"),
+      std::map<std::string, std::string>(),
+      std::multimap<std::string, std::string>{{"query", "expenses"}, {"args", "--real"}});
+  http::response res(lr.respond(req));
+  ASSERT_EQ(http::status_code::OK, res.status_code);
+  ASSERT_TRUE(static_cast<bool>(res.producer));
+
+  // A slow client must not keep ledger from other requests.
+  locked_body_writer writer(lr);
+  res.producer(writer);
+  ASSERT_FALSE(writer.is_locked);
+  std::string expected(ledger_rest::ledger_rest::to_json(
+        lr.run_register({ "--real" }, { "expenses" })));
+  ASSERT_EQ(expected, writer.body);
+
+  // The streamed result was small enough to be cached.
+  http::response res2(lr.respond(req));
+  ASSERT_FALSE(static_cast<bool>(res2.producer));
+  ASSERT_EQ(expected, *res2.body);
+}
+
+TEST(ledger_rest, respond_register_normalized) {
+  black_hole_logger logger;
+  simple_args args(RESOURCE_PATH + std::string("/ledger1.txt"));
+  ledger_rest::ledger_rest lr(args, logger);
+
+  http::request req(std::string("GET"), std::string("/ledger/report/register"),
+      std::map<std::string, std::string>(),
+      std::multimap<std::string, std::string>{{"query", "expenses"}, {"query", "assets"},
+        {"args", "--real"}, {"args", "-R"}, {"args", ""}});
+  http::response res(lr.respond(req));
+  ASSERT_TRUE(static_cast<bool>(res.producer));
+  http::string_body_writer writer;
+  res.producer(writer);
+
+  // The same request written differently is answered from the cache.
+  http::request req2(std::string("GET"), std::string("/ledger/report/register"),
+      std::map<std::string, std::string>(),
+      std::multimap<std::string, std::string>{{"query", "assets"}, {"query", "expenses"},
+        {"args", "--real"}});
+  http::response res2(lr.respond(req2));
+  ASSERT_FALSE(static_cast<bool>(res2.producer));
+  ASSERT_EQ(writer.body, *res2.body);
+  ASSERT_EQ(res.headers.at("ETag"), res2.headers.at("ETag"));
+}
+
+TEST(ledger_rest, respond_register_spilled) {
+  recording_logger logger;
+  simple_args args(RESOURCE_PATH + std::string("/ledger1.txt"));
+  observed_ledger_rest lr(args, logger);
+  lr.set_spool_memory_limit(16);
+
+  http::request req(std::string("GET"), std::string("/ledger/report/register"),
+      std::map<std::string, std::string>(),
+      std::multimap<std::string, std::string>{{"query", "expenses"}, {"args", "--real"}});
+  std::string expected(ledger_rest::ledger_rest::to_json(
+        lr.run_register({ "--real" }, { "expenses" })));
+  for (int i = 0; i < 2; i++) {
+    http::response res(lr.respond(req));
+    ASSERT_TRUE(static_cast<bool>(res.producer));
+    locked_body_writer writer(lr);
+    res.producer(writer);
+    ASSERT_FALSE(writer.is_locked);
+    ASSERT_EQ(expected, writer.body);
+  }
+  // Larger than the limit, so it was not held in memory.
+  ASSERT_TRUE(logger.has_message("Register of " + std::to_string(expected.size())
+        + " bytes was rendered to a temporary file."));
+}
+
+TEST(ledger_rest, respond_register_batch) {
+  black_hole_logger logger;
+  simple_args args(RESOURCE_PATH + std::string("/ledger1.txt"));
+  ledger_rest::ledger_rest lr(args, logger);
+
+  // Collapsed posts have accounts and payees that are not in the journal.
+  // --real leaves them to ledger.
+  http::request req(std::string("POST"), std::string("/ledger/report/register"),
+      std::map<std::string, std::string>(),
+      std::multimap<std::string, std::string>(),
+      "[{\"args\": [\"--real\", \"--collapse\", \"--period\", \"monthly\"], \"query\": [\"expenses\"]},"
+      " {\"query\": [\"payee\", \"movie\"]}]");
+  http::response res(lr.respond(req));
+  ASSERT_EQ(http::status_code::OK, res.status_code);
+  ASSERT_TRUE(static_cast<bool>(res.producer));
+
+  std::list<std::list<post_result>> expected = {
+    lr.run_register({ "--real", "--collapse", "--period", "monthly" }, { "expenses" }),
+    lr.run_register({}, { "payee", "movie" })
+  };
+  http::string_body_writer writer;
+  res.producer(writer);
+  ASSERT_EQ(ledger_rest::ledger_rest::to_json(expected), writer.body);
+}
+
+TEST(ledger_rest, respond_register_batch_error) {
+  black_hole_logger logger;
+  simple_args args(RESOURCE_PATH + std::string("/ledger1.txt"));
+  ledger_rest::ledger_rest lr(args, logger);
+
+  http::request req(std::string("POST"), std::string("/ledger/report/register"),
+      std::map<std::string, std::string>(),
+      std::multimap<std::string, std::string>(),
+      "[{\"query\": [\"expenses\"]}, {\"args\": [\"--no-such-option\"], \"query\": []}]");
+  std::list<std::list<post_result>> expected = {
+    lr.run_register({}, { "expenses" }),
+    std::list<post_result>()
+  };
+  // The failed register is sent as an empty one but is not cached, so the
+  // batch is answered again rather than from the cache.
+  for (int i = 0; i < 2; i++) {
+    http::response res(lr.respond(req));
+    ASSERT_EQ(http::status_code::OK, res.status_code);
+    ASSERT_TRUE(static_cast<bool>(res.producer));
+    http::string_body_writer writer;
+    res.producer(writer);
+    ASSERT_EQ(ledger_rest::ledger_rest::to_json(expected), writer.body);
+  }
+
+  // The good register was cached and the failed one was not.
+  http::request expenses_req(std::string("GET"), std::string("/ledger/report/register"),
+      std::map<std::string, std::string>(),
+      std::multimap<std::string, std::string>{{"query", "expenses"}});
+  ASSERT_FALSE(static_cast<bool>(lr.respond(expenses_req).producer));
+  http::request failed_req(std::string("GET"), std::string("/ledger/report/register"),
+      std::map<std::string, std::string>(),
+      std::multimap<std::string, std::string>{{"args", "--no-such-option"}});
+  ASSERT_TRUE(static_cast<bool>(lr.respond(failed_req).producer));
+}
+
+TEST(ledger_rest, respond_register_error) {
+  black_hole_logger logger;
+  simple_args args(RESOURCE_PATH + std::string("/ledger1.txt"));
+  ledger_rest::ledger_rest lr(args, logger);
+
+  // Sent as an empty register, compressed or not, and never cached.
+  for (const std::string& accept : { std::string(""), std::string("gzip") }) {
+    for (int i = 0; i < 2; i++) {
+      http::request req(std::string("GET"), std::string("/ledger/report/register"),
+          std::map<std::string, std::string>{{"Accept-Encoding", accept}},
+          std::multimap<std::string, std::string>{{"args", "--no-such-option"}});
+      http::response res(lr.respond(req));
+      ASSERT_EQ(http::status_code::OK, res.status_code);
+      ASSERT_TRUE(static_cast<bool>(res.producer));
+      http::string_body_writer writer;
+      res.producer(writer);
+      if (accept.empty()) {
+        ASSERT_EQ(std::string("[]"), writer.body);
+      } else {
+        ASSERT_EQ(std::string("gzip"), res.headers.at("Content-Encoding"));
+        ASSERT_FALSE(writer.body.empty());
+      }
+    }
+  }
+}
+
+// Checks a batch of native requests of two date ranges, a duplicate and
+// two for ledger.
+void check_register_batch(ledger_rest::ledger_rest& lr) {
+  http::request req(std::string("POST"), std::string("/ledger/report/register"),
+      std::map<std::string, std::string>(),
+      std::multimap<std::string, std::string>(),
+      "[{\"query\": [\"expenses\"]},"
+      " {\"args\": [\"-b\", \"2015/06/01\"], \"query\": [\"assets\"]},"
+      " {\"query\": [\"payee\", \"movie\"]},"
+      " {\"args\": [\"--real\"], \"query\": [\"expenses\"]},"
+      " {\"args\": [\"-b\", \"2015/06/01\"], \"query\": [\"expenses\"]},"
+      " {\"args\": [\"--real\"], \"query\": [\"assets\"]},"
+      " {\"query\": [\"expenses\"]}]");
+  http::response res(lr.respond(req));
+  ASSERT_EQ(http::status_code::OK, res.status_code);
+  http::string_body_writer writer;
+  res.producer(writer);
+
+  std::list<std::list<post_result>> expected = {
+    lr.run_register({}, { "expenses" }),
+    lr.run_register({ "-b", "2015/06/01" }, { "assets" }),
+    lr.run_register({}, { "payee", "movie" }),
+    lr.run_register({ "--real" }, { "expenses" }),
+    lr.run_register({ "-b", "2015/06/01" }, { "expenses" }),
+    lr.run_register({ "--real" }, { "assets" }),
+    lr.run_register({}, { "expenses" })
+  };
+  ASSERT_FALSE(expected.front().empty());
+  ASSERT_EQ(ledger_rest::ledger_rest::to_json(expected), writer.body);
+
+  // Answered again from the cache, whole.
+  http::response res2(lr.respond(req));
+  ASSERT_FALSE(static_cast<bool>(res2.producer));
+  ASSERT_EQ(writer.body, *res2.body);
+}
+
+TEST(ledger_rest, respond_register_batch_shared) {
+  black_hole_logger logger;
+  simple_args args(RESOURCE_PATH + std::string("/ledger1.txt"));
+  ledger_rest::ledger_rest lr(args, logger);
+  check_register_batch(lr);
+}
+
+TEST(ledger_rest, respond_register_batch_parallel) {
+  black_hole_logger logger;
+  ledger_rest::thread_pool pool(3, logger);
+  simple_args args(RESOURCE_PATH + std::string("/ledger1.txt"));
+  ledger_rest::ledger_rest lr(args, logger, &pool);
+  check_register_batch(lr);
+}
+
+TEST(ledger_rest, respond_register_concurrent) {
+  black_hole_logger logger;
+  simple_args args(RESOURCE_PATH + std::string("/ledger1.txt"));
+  ledger_rest::ledger_rest lr(args, logger);
+
+  // Identical requests at once, as after a reload, all get the same body.
+  http::request req(std::string("GET"), std::string("/ledger/report/register"),
+      std::map<std::string, std::string>(),
+      std::multimap<std::string, std::string>{{"query", "expenses"}});
+  std::vector<std::shared_ptr<const std::string>> bodies(8);
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    threads.push_back(std::thread([&lr, &req, &bodies, i]() {
+      bodies[i] = lr.respond(req).body;
+    }));
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  std::string expected(ledger_rest::ledger_rest::to_json(lr.run_register({}, { "expenses" })));
+  for (const std::shared_ptr<const std::string>& body : bodies) {
+    ASSERT_EQ(expected, *body);
+  }
+}
+
+TEST(ledger_rest, respond_register_concurrent_ledger) {
+  black_hole_logger logger;
+  simple_args args(RESOURCE_PATH + std::string("/ledger1.txt"));
+  observed_ledger_rest lr(args, logger);
+
+  http::request req(std::string("GET"), std::string("/ledger/report/register"),
+      std::map<std::string, std::string>(),
+      std::multimap<std::string, std::string>{{"query", "expenses"}, {"args", "--real"}});
+  std::string expected(ledger_rest::ledger_rest::to_json(
+        lr.run_register({ "--real" }, { "expenses" })));
+
+  // Ledger is held until every request but the first waits for it, so the
+  // register is rendered once for all of them.
+  std::vector<std::string> bodies(8);
+  std::vector<std::thread> threads;
+  {
+    std::unique_lock<std::recursive_mutex> lock(lr.lock_ledger());
+    for (std::size_t i = 0; i < bodies.size(); i++) {
+      threads.push_back(std::thread([&lr, &req, &bodies, i]() {
+        http::string_body_writer writer;
+        lr.respond(req).producer(writer);
+        bodies[i] = writer.body;
+      }));
+    }
+    while (lr.get_coalesced_count() < bodies.size() - 1) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  ASSERT_EQ(bodies.size() - 1, lr.get_coalesced_count());
+  for (const std::string& body : bodies) {
+    ASSERT_EQ(expected, body);
+  }
+}
+
+TEST(ledger_rest, respond_register_batch_window) {
+  black_hole_logger logger;
+  simple_args args(RESOURCE_PATH + std::string("/ledger1.txt"));
+  // Long enough for every thread to join the first one's batch.
+  args.batch_window = 200 * 1000;
+  observed_ledger_rest lr(args, logger);
+
+  // Different registers at once are answered together but each gets its
+  // own body.
+  std::vector<std::list<std::string>> queries = {
+    { "expenses" }, { "assets" }, { "payee", "movie" }, { "income" }, { "^exp", "books" }
+  };
+  std::vector<std::shared_ptr<const std::string>> bodies(queries.size());
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < queries.size(); i++) {
+    threads.push_back(std::thread([&lr, &queries, &bodies, i]() {
+      std::multimap<std::string, std::string> uri_args;
+      for (const std::string& term : queries[i]) {
+        uri_args.insert(std::make_pair(std::string("query"), term));
+      }
+      http::request req(std::string("GET"), std::string("/ledger/report/register"),
+          std::map<std::string, std::string>(), uri_args);
+      bodies[i] = lr.respond(req).body;
+    }));
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  ASSERT_EQ(1u, lr.get_batch_count());
+  for (std::size_t i = 0; i < queries.size(); i++) {
+    ASSERT_EQ(ledger_rest::ledger_rest::to_json(lr.run_register({}, queries[i])), *bodies[i]);
+  }
+}
+
+TEST(ledger_rest, respond_register_native) {
+  black_hole_logger logger;
+  simple_args args(RESOURCE_PATH + std::string("/ledger1.txt"));
+  ledger_rest::ledger_rest lr(args, logger);
+
+  http::request req(std::string("GET"), std::string("/ledger/report/register"),
+      std::map<std::string, std::string>(),
+      std::multimap<std::string, std::string>{{"query", "^exp"}, {"query", "books"},
+        {"args", "-b"}, {"args", "2015/05/16"}, {"args", "--end=2015/06/16"}});
+  http::response res(lr.respond(req));
+  ASSERT_EQ(http::status_code::OK, res.status_code);
+  ASSERT_FALSE(static_cast<bool>(res.producer));
+
+  std::list<post_result> expected(lr.run_register({ "-b", "2015/05/16", "--end=2015/06/16" },
+        { "^exp", "books" }));
+  ASSERT_EQ(6u, expected.size());
+  ASSERT_EQ(ledger_rest::ledger_rest::to_json(expected), *res.body);
+
+  http::request req2(std::string("GET"), std::string("/ledger/report/register"),
+      std::map<std::string, std::string>(),
+      std::multimap<std::string, std::string>{{"query", "expenses"}, {"query", "and"},
+        {"query", "not"}, {"query", "payee"}, {"query", "movie"}});
+  http::response res2(lr.respond(req2));
+  ASSERT_FALSE(static_cast<bool>(res2.producer));
+  ASSERT_EQ(ledger_rest::ledger_rest::to_json(
+        lr.run_register({}, { "expenses", "and", "not", "payee", "movie" })), *res2.body);
+}
+
+// Exposes both register engines so that their results can be compared.
+class differential_ledger_rest : public ::ledger_rest::ledger_rest {
+  public:
+    differential_ledger_rest(::ledger_rest::ledger_rest_args& args, ::ledger_rest::logger& logger,
+        ::ledger_rest::thread_pool* pool = NULL, std::size_t chunk_rows = 32 * 1024)
+      : ::ledger_rest::ledger_rest(args, logger, pool) {
+      register_chunk_rows = chunk_rows;
+    }
+
+    bool run_native(const std::list<std::string>& args, const std::list<std::string>& query,
+        std::list<post_result>& results) {
+      return run_native_register(*get_loaded_snapshot(), args, query, results);
+    }
+
+    std::shared_ptr<const std::string> run_native_json(const std::string& key,
+        const std::list<std::string>& args, const std::list<std::string>& query) {
+      return get_native_register_json(*get_loaded_snapshot(), key, args, query);
+    }
+
+    std::list<post_result> run_ledger(const std::list<std::string>& args,
+        const std::list<std::string>& query) {
+      post_capturer* capturer = new post_capturer();
+      ledger::post_handler_ptr capturer_ptr(capturer);
+      run_register_or_throw(*get_loaded_snapshot(), args, query, capturer_ptr);
+      return capturer->get_post_results();
+    }
+};
+
+// Every request the native engine answers must give what ledger gives.
+// Returns the number of requests the native engine answered.
+const std::list<std::list<std::string>> differential_date_args = {
+  {},
+  { "-b", "2015/06/01" },
+  { "-e", "2015/07/01" },
+  { "--begin=2015/05/17", "--end=2015/07/17" },
+  { "-b", "2016/01/01" }
+};
+
+const std::list<std::list<std::string>> differential_summary_args = {
+  { "--collapse" },
+  { "--period", "monthly" },
+  { "-p", "weekly", "-e", "2015/07/01" },
+  { "--period=quarterly", "--collapse" },
+  { "-E", "--collapse", "--period", "monthly" },
+  { "-E", "-p", "daily", "-b", "2015/06/01" },
+  { "--collapse", "-p", "yearly", "-b", "2015/05/01" }
+};
+
+int run_differential_test(const std::string& ledger_file,
+    ::ledger_rest::thread_pool* pool = NULL, std::size_t chunk_rows = 32 * 1024,
+    const std::list<std::list<std::string>>& args_list = differential_date_args) {
+  black_hole_logger logger;
+  simple_args lr_args(RESOURCE_PATH + std::string("/") + ledger_file);
+  differential_ledger_rest lr(lr_args, logger, pool, chunk_rows);
+
+  std::list<std::list<std::string>> queries = {
+    {},
+    { "expenses" },
+    { "assets" },
+    { "^exp", "books" },
+    { "expenses", "and", "payee", "movie" },
+    { "payee", "movie", "or", "books" },
+    { "not", "assets" },
+    { "expenses", "and", "not", "payee", "movie" },
+    { "fun", "or", "payee", "book" },
+    { "income", "or", "cash" },
+    { "liabilities" }
+  };
+
+  int native_count = 0;
+  for (const std::list<std::string>& args : args_list) {
+    for (const std::list<std::string>& query : queries) {
+      std::list<post_result> native;
+      if (!lr.run_native(args, query, native)) {
+        continue;
+      }
+      native_count++;
+
+      std::list<post_result> expected(lr.run_ledger(args, query));
+      EXPECT_EQ(expected.size(), native.size());
+      auto actual = native.cbegin();
+      for (auto iter = expected.cbegin(); iter != expected.cend() && actual != native.cend();
+          iter++, actual++) {
+        EXPECT_EQ(iter->amount, actual->amount);
+        EXPECT_EQ(iter->total, actual->total);
+        EXPECT_EQ(iter->date, actual->date);
+        EXPECT_EQ(iter->payee, actual->payee);
+        EXPECT_EQ(iter->account_name, actual->account_name);
+      }
+    }
+  }
+  return native_count;
+}
+
+TEST(ledger_rest, register_native_matches_ledger1) {
+  // The journal has a single commodity so every request is native.
+  ASSERT_EQ(55, run_differential_test("ledger1.txt"));
+}
+
+TEST(ledger_rest, register_native_matches_ledger2) {
+  // Queries that reach the GOLD posting fall back to ledger.
+  ASSERT_GT(run_differential_test("ledger2.txt"), 0);
+}
+
+TEST(ledger_rest, register_native_summaries_match_ledger) {
+  // Collapsed transactions that balance fall back to ledger, so not every
+  // request is native.
+  ASSERT_GT(run_differential_test("ledger1.txt", NULL, 32 * 1024, differential_summary_args), 0);
+  ASSERT_GT(run_differential_test("ledger2.txt", NULL, 32 * 1024, differential_summary_args), 0);
+}
+
+TEST(ledger_rest, register_native_chunked) {
+  black_hole_logger logger;
+  ::ledger_rest::thread_pool pool(3, logger);
+  // Chunks of two rows so that running totals cross many chunks.
+  ASSERT_EQ(55, run_differential_test("ledger1.txt", &pool, 2));
+  run_differential_test("ledger2.txt", &pool, 3);
+
+  simple_args lr_args(RESOURCE_PATH + std::string("/ledger1.txt"));
+  differential_ledger_rest sequential(lr_args, logger);
+  differential_ledger_rest chunked(lr_args, logger, &pool, 2);
+  std::shared_ptr<const std::string> expected(sequential.run_native_json("expenses", {}, { "expenses" }));
+  ASSERT_TRUE(static_cast<bool>(expected));
+  std::shared_ptr<const std::string> actual(chunked.run_native_json("expenses", {}, { "expenses" }));
+  ASSERT_TRUE(static_cast<bool>(actual));
+  ASSERT_EQ(*expected, *actual);
+}
+
+TEST(ledger_rest, register_native_fallback) {
+  black_hole_logger logger;
+  simple_args lr_args(RESOURCE_PATH + std::string("/ledger1.txt"));
+  differential_ledger_rest lr(lr_args, logger);
+
+  std::list<post_result> results;
+  // Every transaction balances, so each collapses to zero.
+  ASSERT_FALSE(lr.run_native({ "--collapse" }, {}, results));
+  ASSERT_FALSE(lr.run_native({ "--period", "every 2 weeks" }, { "expenses" }, results));
+  ASSERT_FALSE(lr.run_native({ "-E" }, { "expenses" }, results));
+  ASSERT_FALSE(lr.run_native({}, { "tag", "x" }, results));
+  // Answered by ledger instead.
+  ASSERT_FALSE(lr.run_register({ "--period", "every 2 weeks" }, { "expenses" }).empty());
+}
+
+TEST(ledger_rest, respond_compressed) {
+  black_hole_logger logger;
+  simple_args args(RESOURCE_PATH + std::string("/ledger1.txt"));
+  ledger_rest::ledger_rest lr(args, logger);
+
+  http::request plain_req(std::string("GET"), std::string("/ledger/accounts"),
+      std::map<std::string, std::string>(),
+      std::multimap<std::string, std::string>());
+  http::response plain(lr.respond(plain_req));
+  ASSERT_EQ(0u, plain.headers.count("Content-Encoding"));
+
+  http::request req(std::string("GET"), std::string("/ledger/accounts"),
+      std::map<std::string, std::string>{{"Accept-Encoding", "gzip"}},
+      std::multimap<std::string, std::string>());
+  http::response res(lr.respond(req));
+  ASSERT_EQ(std::string("gzip"), res.headers.at("Content-Encoding"));
+  ASSERT_EQ(std::string("Accept-Encoding"), res.headers.at("Vary"));
+  ASSERT_NE(plain.headers.at("ETag"), res.headers.at("ETag"));
+  ASSERT_EQ(ledger_rest::compress(*plain.body, ledger_rest::content_encoding::GZIP, 6), *res.body);
+
+  // The compressed body is cached.
+  http::response res2(lr.respond(req));
+  ASSERT_EQ(res.body.get(), res2.body.get());
+
+  http::request req3(std::string("GET"), std::string("/ledger/accounts"),
+      std::map<std::string, std::string>{{"Accept-Encoding", "gzip"},
+        {"If-None-Match", res.headers.at("ETag")}},
+      std::multimap<std::string, std::string>());
+  http::response res3(lr.respond(req3));
+  ASSERT_EQ(http::status_code::NOT_MODIFIED, res3.status_code);
+  ASSERT_EQ(res.headers.at("ETag"), res3.headers.at("ETag"));
+  ASSERT_EQ(std::string("Accept-Encoding"), res3.headers.at("Vary"));
+
+  // The client holds a different representation than the one it would get.
+  http::request req4(std::string("GET"), std::string("/ledger/accounts"),
+      std::map<std::string, std::string>{{"Accept-Encoding", "gzip"},
+        {"If-None-Match", plain.headers.at("ETag")}},
+      std::multimap<std::string, std::string>());
+  ASSERT_EQ(http::status_code::OK, lr.respond(req4).status_code);
+  http::request req5(std::string("GET"), std::string("/ledger/accounts"),
+      std::map<std::string, std::string>{{"If-None-Match", res.headers.at("ETag")}},
+      std::multimap<std::string, std::string>());
+  ASSERT_EQ(http::status_code::OK, lr.respond(req5).status_code);
+}
+
+TEST(ledger_rest, respond_not_modified_uncompressed) {
+  black_hole_logger logger;
+  simple_args args(RESOURCE_PATH + std::string("/ledger1.txt"));
+  args.compression_min_size = 1 << 20;
+  ledger_rest::ledger_rest lr(args, logger);
+
+  http::request req(std::string("GET"), std::string("/ledger/accounts"),
+      std::map<std::string, std::string>{{"Accept-Encoding", "gzip"}},
+      std::multimap<std::string, std::string>());
+  http::response res(lr.respond(req));
+  ASSERT_EQ(0u, res.headers.count("Content-Encoding"));
+
+  // Too small to be compressed, so the identity ETag is the current one.
+  http::request req2(std::string("GET"), std::string("/ledger/accounts"),
+      std::map<std::string, std::string>{{"Accept-Encoding", "gzip"},
+        {"If-None-Match", res.headers.at("ETag")}},
+      std::multimap<std::string, std::string>());
+  http::response res2(lr.respond(req2));
+  ASSERT_EQ(http::status_code::NOT_MODIFIED, res2.status_code);
+  ASSERT_EQ(res.headers.at("ETag"), res2.headers.at("ETag"));
+  ASSERT_EQ(std::string("Accept-Encoding"), res2.headers.at("Vary"));
+}
+
+TEST(ledger_rest, respond_register_batch_uncompressed) {
+  black_hole_logger logger;
+  simple_args args(RESOURCE_PATH + std::string("/ledger1.txt"));
+  args.compression_min_size = 1 << 20;
+  ledger_rest::ledger_rest lr(args, logger);
+
+  http::request req(std::string("POST"), std::string("/ledger/report/register"),
+      std::map<std::string, std::string>{{"Accept-Encoding", "gzip"}},
+      std::multimap<std::string, std::string>(),
+      "[{\"query\": [\"expenses\"]}, {\"args\": [\"--real\"], \"query\": [\"assets\"]}]");
+  // Its size is not known until it is answered.
+  http::response res(lr.respond(req));
+  ASSERT_EQ(std::string("gzip"), res.headers.at("Content-Encoding"));
+  http::string_body_writer writer;
+  res.producer(writer);
+
+  // Once cached it is known to be too small to be compressed.
+  http::response res2(lr.respond(req));
+  ASSERT_EQ(0u, res2.headers.count("Content-Encoding"));
+  ASSERT_EQ(std::string("Accept-Encoding"), res2.headers.at("Vary"));
+  std::list<std::list<post_result>> expected = {
+    lr.run_register({}, { "expenses" }),
+    lr.run_register({ "--real" }, { "assets" })
+  };
+  ASSERT_EQ(ledger_rest::ledger_rest::to_json(expected), *res2.body);
+}
+
+TEST(ledger_rest, get_nested_journal_include_files) {
+  black_hole_logger logger;
+  std::string ledger_file("ledger_nested.txt");
+  simple_args args(RESOURCE_PATH + std::string("/") + ledger_file);
+  ledger_rest::ledger_rest lr(args, logger);
+  auto actual = lr.get_journal_include_files();
+
+  std::list<std::string> expected = {
+    RESOURCE_PATH + std::string("/nested/a.txt"),
+    RESOURCE_PATH + std::string("/nested/b.txt"),
+    RESOURCE_PATH + std::string("/nested/year_2014.txt"),
+    RESOURCE_PATH + std::string("/nested/year_2015.txt")
+  };
+
+  ASSERT_EQ(expected, actual);
+}
+
+TEST(ledger_rest, reload_unchanged) {
+  black_hole_logger logger;
+  simple_args args(RESOURCE_PATH + std::string("/ledger1.txt"));
+  observed_ledger_rest lr(args, logger);
+
+  http::request req(std::string("HEAD"), std::string("/a"),
+      std::map<std::string, std::string>(),
+      std::multimap<std::string, std::string>());
+  http::response res(lr.respond(req));
+  ASSERT_TRUE(lr.is_loaded());
+  unsigned long long generation = lr.get_generation();
+
+  // A change notification without a change keeps the snapshot and does not
+  // leave every later request to check the files again.
+  lr.lazy_reload_journal();
+  ASSERT_FALSE(lr.is_loaded());
+  http::response res2(lr.respond(req));
+  ASSERT_TRUE(lr.is_loaded());
+  ASSERT_EQ(generation, lr.get_generation());
+}
+
+TEST(ledger_rest, reload_appended) {
+  char path[] = "/tmp/ledger_rest_testXXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_NE(-1, fd);
+  close(fd);
+
+  std::string journal(ledger_rest::read_whole_file(RESOURCE_PATH + std::string("/ledger1.txt")));
+  {
+    std::ofstream out(path);
+    out << journal;
+  }
+
+  recording_logger logger;
+  simple_args args(path);
+  observed_ledger_rest lr(args, logger);
+
+  http::request req(std::string("HEAD"), std::string("/a"),
+      std::map<std::string, std::string>(),
+      std::multimap<std::string, std::string>());
+  http::response res(lr.respond(req));
+  std::shared_ptr<const ledger_rest::ledger_rest::journal_snapshot> previous(
+      lr.get_current_snapshot());
+
+  {
+    std::ofstream out(path, std::ios::app);
+    out << "\n2015/07/21 movie\n  assets:cash   -$5\n  expenses:movie   $5\n";
+  }
+  lr.lazy_reload_journal();
+  http::response res2(lr.respond(req));
+  ASSERT_TRUE(logger.has_message("Appended 1 transactions from ledger file."));
+  ASSERT_NE(previous->generation, lr.get_current_snapshot()->generation);
+
+  // The previous snapshot shares the session the transaction was parsed
+  // into, so ledger reports on it include it but its posting table does not.
+  ASSERT_EQ(previous->session, lr.get_current_snapshot()->session);
+  ASSERT_EQ(2u, lr.run_register_on(*previous, { "--real" }, { "expenses:movie" }).size());
+  ASSERT_EQ(1u, lr.run_register_on(*previous, {}, { "expenses:movie" }).size());
+
+  std::vector<post_result> expected = {
+    build_result("2015/5/16", "movie", "expenses:fun", 10, 10),
+    build_result("2015/7/17", "movie", "expenses:movie", 20, 30),
+    build_result("2015/7/21", "movie", "expenses:movie", 5, 35)
+  };
+  std::list<post_result> actual = lr.run_register({}, { "expenses", "and", "payee", "movie" });
+  std::remove(path);
+
+  compare_post_results(actual, expected);
+}
+
+TEST(ledger_rest, reload_changed_include) {
+  char dir[] = "/tmp/ledger_rest_testXXXXXX";
+  ASSERT_NE(nullptr, mkdtemp(dir));
+  std::string main_path(dir + std::string("/main.txt"));
+  std::string path_2014(dir + std::string("/2014.txt"));
+  std::string path_2015(dir + std::string("/2015.txt"));
+
+  std::ofstream(main_path) << "include 2014.txt\ninclude 2015.txt\n";
+  std::ofstream(path_2014) << "2014/03/01 movie\n  assets:cash   -$10\n  expenses:fun   $10\n";
+  std::ofstream(path_2015) << "2015/03/01 movie\n  assets:cash   -$20\n  expenses:fun   $20\n";
+
+  black_hole_logger logger;
+  simple_args args(main_path);
+  ledger_rest::ledger_rest lr(args, logger);
+
+  http::request req(std::string("HEAD"), std::string("/a"),
+      std::map<std::string, std::string>(),
+      std::multimap<std::string, std::string>());
+  http::response res(lr.respond(req));
+
+  std::ofstream(path_2014) << "2014/03/01 movie\n  assets:cash   -$15\n  expenses:movie   $15\n\n"
+    << "2014/04/01 movie\n  assets:cash   -$1\n  expenses:fun   $1\n";
+  lr.lazy_reload_journal();
+  http::response res2(lr.respond(req));
+
+  std::vector<post_result> expected = {
+    build_result("2014/3/01", "movie", "expenses:movie", 15, 15),
+    build_result("2014/4/01", "movie", "expenses:fun", 1, 16),
+    build_result("2015/3/01", "movie", "expenses:fun", 20, 36)
+  };
+  std::list<post_result> actual = lr.run_register({}, { "expenses" });
+  std::remove(path_2015.c_str());
+  std::remove(path_2014.c_str());
+  std::remove(main_path.c_str());
+  rmdir(dir);
+
+  compare_post_results(actual, expected);
+}
+
+// With a pool the snapshot file is written on it, which is done by the
+// time the ledger_rest that wrote it is gone.
+void check_snapshot_file(::ledger_rest::thread_pool* pool) {
+  char path[] = "/tmp/ledger_rest_testXXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_NE(-1, fd);
+  close(fd);
+  std::remove(path);
+
+  black_hole_logger logger;
+  simple_args args(RESOURCE_PATH + std::string("/ledger1.txt"));
+  args.snapshot_path = path;
+  std::list<std::string> expected;
+  {
+    ledger_rest::ledger_rest lr(args, logger, pool);
+    ASSERT_FALSE(lr.load_snapshot_file());
+
+    http::request req(std::string("HEAD"), std::string("/a"),
+        std::map<std::string, std::string>(),
+        std::multimap<std::string, std::string>());
+    http::response res(lr.respond(req));
+    expected = lr.get_accounts();
+  }
+
+  ledger_rest::ledger_rest lr(args, logger);
+  ASSERT_TRUE(lr.load_snapshot_file());
+  std::list<std::string> actual(lr.get_accounts());
+  ASSERT_EQ(4u, lr.run_register({}, { "payee", "movie" }).size());
+  std::remove(path);
+
+  ASSERT_EQ(expected, actual);
+}
+
+TEST(ledger_rest, load_snapshot_file) {
+  check_snapshot_file(NULL);
+}
+
+TEST(ledger_rest, load_snapshot_file_written_on_pool) {
+  black_hole_logger logger;
+  ::ledger_rest::thread_pool pool(2, logger);
+  check_snapshot_file(&pool);
+}
+
+TEST(ledger_rest, register_native_inexact) {
+  char path[] = "/tmp/ledger_rest_testXXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_NE(-1, fd);
+  close(fd);
+  // A ten-millionth of a dollar is finer than the table's millionths.
+  std::ofstream(path) << "2015/05/16 movie\n  assets:cash   -$10.0000001\n"
+    << "  expenses:fun   $10.0000001\n\n"
+    << "2015/05/17 book\n  assets:cash   -$20\n  expenses:books   $20\n";
+
+  black_hole_logger logger;
+  simple_args args(path);
+  differential_ledger_rest lr(args, logger);
+  std::list<post_result> results;
+  ASSERT_FALSE(lr.run_native({}, { "fun" }, results));
+  ASSERT_TRUE(lr.run_native({}, { "books" }, results));
+  ASSERT_EQ(1u, lr.run_register({}, { "fun" }).size());
+  std::remove(path);
+}
+
 TEST(ledger_rest, post_to_json) {
   post_result pr(build_result("2010/07/01", "paycheck", "assets", 100.534, 200.534));
   std::string json(ledger_rest::ledger_rest::to_json(pr));
@@ -231,6 +1160,13 @@ TEST(ledger_rest, posts_to_json) {
   ASSERT_EQ(expected, json);
 }
 
+TEST(ledger_rest, post_to_json_escapes) {
+  post_result pr(build_result("2010/07/01", "\"Joe's\" \\ Diner", "expenses", -0.001, 12));
+  std::string json(ledger_rest::ledger_rest::to_json(pr));
+  std::string expected("{\"amount\" : -0.00, \"total\" : 12.00, \"date\" : \"2010-07-01\", \"payee\" : \"\\\"Joe's\\\" \\\\ Diner\", \"account_name\" : \"expenses\"}");
+  ASSERT_EQ(expected, json);
+}
+
 TEST(ledger_rest, accounts_to_json) {
   std::list<std::string> accounts = { "grass", "is", "always", "greener" };
   std::string json(ledger_rest::ledger_rest::to_json(accounts));
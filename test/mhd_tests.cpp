@@ -37,6 +37,7 @@
 #include "http.h"
 #include "runnable.h"
 #include "runner.h"
+#include "thread_pool.h"
 
 #include "black_hole_logger.h"
 
@@ -77,6 +78,10 @@ class predef_mhd_args : public ::ledger_rest::mhd_args {
         return 8080;
       }
 
+      virtual int get_connection_limit() {
+        return 16;
+      }
+
       virtual std::string get_key() {
         return std::string("");
       }
@@ -117,7 +122,8 @@ void run_mhd_request_test(std::string url,
   magnet_responder mr;
   predef_mhd_args args;
   black_hole_logger logger;
-  ledger_rest::mhd mhd(args, logger, mr);
+  ledger_rest::thread_pool pool(2, logger);
+  ledger_rest::mhd mhd(args, logger, mr, pool);
 
   std::list<ledger_rest::runnable*> runners{ &mhd };
   ledger_rest::runner runner(logger, runners);
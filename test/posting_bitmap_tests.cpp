@@ -0,0 +1,116 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <set>
+
+#include "posting_bitmap.h"
+
+ledger_rest::posting_bitmap build_bitmap(const std::set<uint32_t>& rows) {
+  ledger_rest::posting_bitmap bitmap;
+  for (uint32_t row : rows) {
+    bitmap.add(row);
+  }
+  return bitmap;
+}
+
+std::vector<uint32_t> get_bitmap_rows(const ledger_rest::posting_bitmap& bitmap) {
+  std::vector<uint32_t> rows;
+  bitmap.get_rows(rows);
+  return rows;
+}
+
+// Sparse sets stay arrays and dense ones become bitsets.
+std::set<uint32_t> random_rows(std::mt19937& generator, uint32_t size, uint32_t one_in) {
+  std::set<uint32_t> rows;
+  std::uniform_int_distribution<uint32_t> distribution(0, one_in - 1);
+  for (uint32_t row = 0; row < size; row++) {
+    if (distribution(generator) == 0) {
+      rows.insert(row);
+    }
+  }
+  return rows;
+}
+
+TEST(posting_bitmap, add_test) {
+  std::set<uint32_t> rows = { 0, 1, 65535, 65536, 200000 };
+  ledger_rest::posting_bitmap bitmap(build_bitmap(rows));
+  ASSERT_EQ(5u, bitmap.size());
+  ASSERT_TRUE(bitmap.contains(65536));
+  ASSERT_FALSE(bitmap.contains(2));
+  ASSERT_EQ(std::vector<uint32_t>(rows.cbegin(), rows.cend()), get_bitmap_rows(bitmap));
+  ASSERT_TRUE(ledger_rest::posting_bitmap().empty());
+}
+
+TEST(posting_bitmap, range_test) {
+  ledger_rest::posting_bitmap bitmap(ledger_rest::posting_bitmap::range(10, 140000));
+  ASSERT_EQ(139990u, bitmap.size());
+  ASSERT_FALSE(bitmap.contains(9));
+  ASSERT_TRUE(bitmap.contains(10));
+  ASSERT_TRUE(bitmap.contains(139999));
+  ASSERT_FALSE(bitmap.contains(140000));
+  ASSERT_TRUE(ledger_rest::posting_bitmap::range(5, 5).empty());
+}
+
+TEST(posting_bitmap, operations_test) {
+  std::mt19937 generator(11);
+  const uint32_t size = 300000;
+  std::vector<std::set<uint32_t>> sets = {
+    random_rows(generator, size, 2), random_rows(generator, size, 3),
+    random_rows(generator, size, 50), random_rows(generator, size, 1000), {}
+  };
+
+  for (const std::set<uint32_t>& a : sets) {
+    for (const std::set<uint32_t>& b : sets) {
+      ledger_rest::posting_bitmap bitmap_a(build_bitmap(a));
+      ledger_rest::posting_bitmap bitmap_b(build_bitmap(b));
+
+      std::vector<uint32_t> expected;
+      std::set_intersection(a.cbegin(), a.cend(), b.cbegin(), b.cend(),
+          std::back_inserter(expected));
+      ledger_rest::posting_bitmap actual(ledger_rest::posting_bitmap::intersect(bitmap_a, bitmap_b));
+      ASSERT_EQ(expected, get_bitmap_rows(actual));
+      ASSERT_EQ(expected.size(), actual.size());
+
+      expected.clear();
+      std::set_union(a.cbegin(), a.cend(), b.cbegin(), b.cend(), std::back_inserter(expected));
+      actual = ledger_rest::posting_bitmap::unite(bitmap_a, bitmap_b);
+      ASSERT_EQ(expected, get_bitmap_rows(actual));
+      ASSERT_EQ(expected.size(), actual.size());
+
+      expected.clear();
+      std::set_difference(a.cbegin(), a.cend(), b.cbegin(), b.cend(),
+          std::back_inserter(expected));
+      actual = ledger_rest::posting_bitmap::subtract(bitmap_a, bitmap_b);
+      ASSERT_EQ(expected, get_bitmap_rows(actual));
+      ASSERT_EQ(expected.size(), actual.size());
+    }
+  }
+}
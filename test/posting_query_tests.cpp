@@ -0,0 +1,344 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include <gtest/gtest.h>
+
+#include "posting_query.h"
+
+ledger_rest::posting_table build_query_table() {
+  ledger_rest::posting_table postings;
+  postings.account_names = { "Assets:Cash", "Expenses:Fun", "Expenses:Books", "Income:Pay" };
+  postings.payee_names = { "movie", "book", "paycheck" };
+  postings.commodity_names = { "$", "EUR" };
+
+  auto day = [](const char* date) {
+    return ledger_rest::to_day_number(boost::gregorian::from_string(date));
+  };
+  const int64_t scale = ledger_rest::posting_table::amount_scale;
+  postings.dates = { day("2015/05/16"), day("2015/05/16"), day("2015/05/17"),
+    day("2015/05/17"), day("2015/06/01"), day("2015/06/01") };
+  postings.amounts = { -10 * scale, 10 * scale, -20 * scale, 20 * scale, 100 * scale,
+    -100 * scale };
+  postings.account_ids = { 0, 1, 0, 2, 0, 3 };
+  postings.payee_ids = { 0, 0, 1, 1, 2, 2 };
+  postings.xact_ids = { 0, 0, 1, 1, 2, 2 };
+  postings.commodity_ids = { 0, 0, 0, 0, 0, 0 };
+  postings.post_flags = { 0, 0, 0, 0, 0, 0 };
+  return postings;
+}
+
+// Finds the rows both by scanning and through the indexes, which must agree.
+std::vector<uint32_t> find_query_rows(const ledger_rest::posting_table& postings,
+    const std::list<std::string>& args, const std::list<std::string>& query) {
+  ledger_rest::posting_query parsed;
+  EXPECT_TRUE(ledger_rest::parse_posting_query(args, query, parsed));
+  std::vector<uint32_t> scanned;
+  EXPECT_TRUE(ledger_rest::find_postings(postings, parsed, scanned));
+
+  ledger_rest::posting_indexes indexes(ledger_rest::get_posting_indexes(postings));
+  std::vector<uint32_t> indexed;
+  EXPECT_TRUE(ledger_rest::find_postings(postings, parsed, indexed, &indexes));
+  EXPECT_EQ(scanned, indexed);
+  return indexed;
+}
+
+TEST(posting_query, parse_test) {
+  ledger_rest::posting_query parsed;
+  ASSERT_TRUE(ledger_rest::parse_posting_query({ "-b", "2015/05/17", "--end=2015-06-01" },
+        { "expenses", "^assets:cash" }, parsed));
+  ASSERT_TRUE(parsed.has_begin);
+  ASSERT_EQ(ledger_rest::to_day_number(boost::gregorian::date(2015, 5, 17)), parsed.begin);
+  ASSERT_TRUE(parsed.has_end);
+  ASSERT_EQ(ledger_rest::to_day_number(boost::gregorian::date(2015, 6, 1)), parsed.end);
+
+  ASSERT_EQ(3u, parsed.terms.size());
+  ASSERT_EQ(ledger_rest::posting_query::term::OR, parsed.terms[parsed.root].kind);
+  ASSERT_EQ(std::string("expenses"), parsed.terms[0].pattern);
+  ASSERT_EQ(std::string("^assets:cash"), parsed.terms[1].pattern);
+}
+
+TEST(posting_query, parse_operators_test) {
+  typedef ledger_rest::posting_query::term term;
+  ledger_rest::posting_query parsed;
+  ASSERT_TRUE(ledger_rest::parse_posting_query({},
+        { "expenses", "and", "payee", "movie", "or", "not", "income" }, parsed));
+  // (expenses and payee movie) or (not income)
+  const term& root = parsed.terms[parsed.root];
+  ASSERT_EQ(term::OR, root.kind);
+  ASSERT_EQ(term::AND, parsed.terms[root.left].kind);
+  ASSERT_EQ(term::PAYEE, parsed.terms[parsed.terms[root.left].right].kind);
+  ASSERT_EQ(term::NOT, parsed.terms[root.right].kind);
+
+  ASSERT_TRUE(ledger_rest::parse_posting_query({}, {}, parsed));
+  ASSERT_EQ(-1, parsed.root);
+}
+
+TEST(posting_query, parse_unsupported_test) {
+  ledger_rest::posting_query parsed;
+  ASSERT_FALSE(ledger_rest::parse_posting_query({ "--related" }, { "expenses" }, parsed));
+  ASSERT_FALSE(ledger_rest::parse_posting_query({ "-E" }, { "expenses" }, parsed));
+  ASSERT_FALSE(ledger_rest::parse_posting_query({ "-p" }, {}, parsed));
+  ASSERT_FALSE(ledger_rest::parse_posting_query({ "--period", "every 2 weeks" }, {}, parsed));
+  ASSERT_FALSE(ledger_rest::parse_posting_query({ "-p", "monthly", "-p", "yearly" }, {}, parsed));
+  ASSERT_FALSE(ledger_rest::parse_posting_query({ "-b" }, { "expenses" }, parsed));
+  ASSERT_FALSE(ledger_rest::parse_posting_query({ "-b", "last month" }, {}, parsed));
+  ASSERT_FALSE(ledger_rest::parse_posting_query({ "-b", "2015/05" }, {}, parsed));
+  ASSERT_FALSE(ledger_rest::parse_posting_query({ "-e", "2015/02/30" }, {}, parsed));
+  ASSERT_FALSE(ledger_rest::parse_posting_query({}, { "@movie" }, parsed));
+  ASSERT_FALSE(ledger_rest::parse_posting_query({}, { "expenses", "and" }, parsed));
+  ASSERT_FALSE(ledger_rest::parse_posting_query({}, { "or", "expenses" }, parsed));
+  ASSERT_FALSE(ledger_rest::parse_posting_query({}, { "not", "not", "fun" }, parsed));
+  ASSERT_FALSE(ledger_rest::parse_posting_query({}, { "payee", "movie", "book" }, parsed));
+  ASSERT_FALSE(ledger_rest::parse_posting_query({}, { "not", "fun", "books" }, parsed));
+  ASSERT_FALSE(ledger_rest::parse_posting_query({}, { "tag", "x" }, parsed));
+  ASSERT_FALSE(ledger_rest::parse_posting_query({}, { "(expenses)" }, parsed));
+}
+
+TEST(posting_query, parse_period_test) {
+  ledger_rest::posting_query parsed;
+  ASSERT_TRUE(ledger_rest::parse_posting_query({ "-E", "--collapse", "--period", "monthly" },
+        { "expenses" }, parsed));
+  ASSERT_EQ(ledger_rest::posting_query::MONTHLY, parsed.period);
+  ASSERT_TRUE(parsed.is_collapsed);
+  ASSERT_TRUE(parsed.is_empty_shown);
+  ASSERT_TRUE(parsed.is_summarized());
+
+  ASSERT_TRUE(ledger_rest::parse_posting_query({ "--period=weekly", "-b", "2015/05/01" }, {},
+        parsed));
+  ASSERT_EQ(ledger_rest::posting_query::WEEKLY, parsed.period);
+  ASSERT_FALSE(parsed.is_collapsed);
+  ASSERT_TRUE(parsed.has_begin);
+
+  ASSERT_TRUE(ledger_rest::parse_posting_query({}, { "expenses" }, parsed));
+  ASSERT_FALSE(parsed.is_summarized());
+}
+
+TEST(posting_query, summarize_test) {
+  ledger_rest::posting_table postings(build_query_table());
+  const int64_t scale = ledger_rest::posting_table::amount_scale;
+  auto summarize = [&](const std::list<std::string>& args, const std::list<std::string>& query,
+      ledger_rest::posting_table& summary) {
+    ledger_rest::posting_query parsed;
+    EXPECT_TRUE(ledger_rest::parse_posting_query(args, query, parsed));
+    std::vector<uint32_t> rows;
+    EXPECT_TRUE(ledger_rest::find_postings(postings, parsed, rows));
+    return ledger_rest::summarize_postings(postings, parsed, rows, summary);
+  };
+  auto get_account = [](const ledger_rest::posting_table& summary, std::size_t row) {
+    return summary.account_names[summary.account_ids[row]];
+  };
+  auto get_payee = [](const ledger_rest::posting_table& summary, std::size_t row) {
+    return summary.payee_names[summary.payee_ids[row]];
+  };
+
+  // One posting per transaction passes through.
+  ledger_rest::posting_table summary;
+  ASSERT_TRUE(summarize({ "--collapse" }, { "expenses" }, summary));
+  ASSERT_EQ(2u, summary.dates.size());
+  ASSERT_EQ(std::string("Expenses:Fun"), get_account(summary, 0));
+  ASSERT_EQ(std::string("movie"), get_payee(summary, 0));
+  ASSERT_EQ(20 * scale, summary.amounts[1]);
+
+  // Transactions that balance collapse to zero, which ledger may hide.
+  ASSERT_FALSE(summarize({ "--collapse" }, {}, summary));
+
+  // Subtotals by account in name order, dated at the start of the month.
+  ASSERT_TRUE(summarize({ "--period", "monthly" }, { "expenses", "or", "income" }, summary));
+  ASSERT_EQ(3u, summary.dates.size());
+  ASSERT_EQ(ledger_rest::to_day_number(boost::gregorian::date(2015, 5, 1)), summary.dates[0]);
+  ASSERT_EQ(std::string("Expenses:Books"), get_account(summary, 0));
+  ASSERT_EQ(std::string("Expenses:Fun"), get_account(summary, 1));
+  ASSERT_EQ(std::string("- 15-May-31"), get_payee(summary, 1));
+  ASSERT_EQ(std::string("Income:Pay"), get_account(summary, 2));
+  ASSERT_EQ(std::string("- 15-Jun-30"), get_payee(summary, 2));
+  ASSERT_EQ(-100 * scale, summary.amounts[2]);
+
+  // A collapsed period is one line.
+  ASSERT_TRUE(summarize({ "-n", "-p", "monthly" }, { "expenses", "or", "income" }, summary));
+  ASSERT_EQ(2u, summary.dates.size());
+  ASSERT_EQ(std::string("<Total>"), get_account(summary, 0));
+  ASSERT_EQ(30 * scale, summary.amounts[0]);
+  ASSERT_EQ(std::string("Income:Pay"), get_account(summary, 1));
+
+  // Weeks start on Sunday, and an empty one is a line of nothing.
+  ASSERT_TRUE(summarize({ "-E", "-n", "-p", "weekly" }, { "expenses", "or", "income" },
+        summary));
+  ASSERT_EQ(4u, summary.dates.size());
+  ASSERT_EQ(std::string("Expenses:Fun"), get_account(summary, 0));
+  ASSERT_EQ(ledger_rest::to_day_number(boost::gregorian::date(2015, 5, 10)), summary.dates[0]);
+  ASSERT_EQ(std::string("- 15-May-16"), get_payee(summary, 0));
+  ASSERT_EQ(std::string("Expenses:Books"), get_account(summary, 1));
+  ASSERT_EQ(std::string("<None>"), get_account(summary, 2));
+  ASSERT_EQ(0, summary.amounts[2]);
+  ASSERT_EQ(ledger_rest::to_day_number(boost::gregorian::date(2015, 5, 24)), summary.dates[2]);
+  ASSERT_EQ(std::string("Income:Pay"), get_account(summary, 3));
+}
+
+TEST(posting_query, normalize_test) {
+  typedef std::list<std::string> strings;
+  ASSERT_EQ(strings({ "--collapse", "--real", "--begin", "2015/05/01", "--period", "monthly" }),
+      ledger_rest::normalize_register_args(
+        { "-n", "", "--real", "-b", "2015/05/01", "--collapse", "--period=monthly", "-R" }));
+  // What follows an option that may take a value is kept as it is.
+  ASSERT_EQ(strings({ "--empty", "--depth", "", "-n", "-n" }),
+      ledger_rest::normalize_register_args({ "-E", "--depth", "", "-n", "-n" }));
+  ASSERT_EQ(strings({ "-b" }), ledger_rest::normalize_register_args({ "-b" }));
+
+  ASSERT_EQ(strings({ "assets", "expenses" }),
+      ledger_rest::normalize_register_query({ "expenses", "", "assets", "expenses" }));
+  strings operators = { "not", "expenses", "and", "assets" };
+  ASSERT_EQ(operators, ledger_rest::normalize_register_query(operators));
+}
+
+TEST(posting_query, find_test) {
+  ledger_rest::posting_table postings(build_query_table());
+  std::vector<uint32_t> expected = { 1, 3 };
+  ASSERT_EQ(expected, find_query_rows(postings, {}, { "expenses" }));
+
+  // Patterns are case insensitive and any of them may match.
+  expected = { 1, 3, 5 };
+  ASSERT_EQ(expected, find_query_rows(postings, {}, { "EXPENSES", "^inc" }));
+
+  expected = { 2, 3 };
+  ASSERT_EQ(expected, find_query_rows(postings, { "-b", "2015/05/17", "-e", "2015/06/01" }, {}));
+
+  expected = { 0, 1, 2, 3, 4, 5 };
+  ASSERT_EQ(expected, find_query_rows(postings, {}, {}));
+
+  expected = {};
+  ASSERT_EQ(expected, find_query_rows(postings, {}, { "liabilities" }));
+}
+
+TEST(posting_query, find_operators_test) {
+  ledger_rest::posting_table postings(build_query_table());
+  std::vector<uint32_t> expected = { 1 };
+  ASSERT_EQ(expected, find_query_rows(postings, {}, { "expenses", "and", "payee", "movie" }));
+
+  expected = { 0, 1, 3 };
+  ASSERT_EQ(expected, find_query_rows(postings, {},
+        { "payee", "movie", "or", "books" }));
+
+  expected = { 1, 3, 5 };
+  ASSERT_EQ(expected, find_query_rows(postings, {}, { "not", "assets" }));
+
+  expected = { 3 };
+  ASSERT_EQ(expected, find_query_rows(postings, { "-b", "2015/05/17" },
+        { "expenses", "and", "not", "payee", "pay" }));
+
+  expected = { 0, 2, 3, 4 };
+  ASSERT_EQ(expected, find_query_rows(postings, {},
+        { "cash", "books", "and", "payee", "book" }));
+}
+
+TEST(posting_query, find_unsupported_test) {
+  ledger_rest::posting_table postings(build_query_table());
+  postings.commodity_ids[3] = 1;
+  postings.post_flags[5] = ledger_rest::posting_table::POST_DATE;
+
+  ledger_rest::posting_query parsed;
+  std::vector<uint32_t> rows;
+  ASSERT_TRUE(ledger_rest::parse_posting_query({}, { "expenses" }, parsed));
+  ASSERT_FALSE(ledger_rest::find_postings(postings, parsed, rows));
+  ASSERT_TRUE(rows.empty());
+
+  ASSERT_TRUE(ledger_rest::parse_posting_query({}, { "income" }, parsed));
+  ASSERT_FALSE(ledger_rest::find_postings(postings, parsed, rows));
+
+  // Postings outside the query do not matter.
+  ASSERT_TRUE(ledger_rest::parse_posting_query({}, { "fun" }, parsed));
+  ASSERT_TRUE(ledger_rest::find_postings(postings, parsed, rows));
+  ASSERT_EQ(1u, rows.size());
+
+  postings.post_flags[1] = ledger_rest::posting_table::INEXACT;
+  ASSERT_FALSE(ledger_rest::find_postings(postings, parsed, rows));
+}
+
+TEST(posting_query, find_many_test) {
+  ledger_rest::posting_table postings(build_query_table());
+  postings.commodity_ids[5] = 1;
+  ledger_rest::posting_indexes indexes(ledger_rest::get_posting_indexes(postings));
+
+  std::list<std::list<std::string>> queries = {
+    { "expenses" }, {}, { "income" }, { "expenses" }, { "not", "expenses" },
+    { "payee", "movie", "or", "books" }, { "liabilities" }, { "pay[" }
+  };
+  for (const std::list<std::string>& args : std::list<std::list<std::string>>{
+      {}, { "-b", "2015/05/17" }, { "-e", "2015/06/01" } }) {
+    std::vector<ledger_rest::posting_query> parsed(queries.size());
+    std::vector<const ledger_rest::posting_query*> query_ptrs;
+    auto query = queries.cbegin();
+    for (std::size_t i = 0; i < parsed.size(); i++, query++) {
+      ASSERT_TRUE(ledger_rest::parse_posting_query(args, *query, parsed[i]));
+      query_ptrs.push_back(&parsed[i]);
+    }
+
+    // Each query must find what it finds on its own.
+    for (const ledger_rest::posting_indexes* index :
+        std::vector<const ledger_rest::posting_indexes*>{ &indexes, NULL }) {
+      std::vector<std::vector<uint32_t>> rows;
+      std::vector<bool> found;
+      ledger_rest::find_postings(postings, query_ptrs, rows, found, index);
+      ASSERT_EQ(parsed.size(), rows.size());
+      ASSERT_EQ(parsed.size(), found.size());
+      for (std::size_t i = 0; i < parsed.size(); i++) {
+        std::vector<uint32_t> expected;
+        ASSERT_EQ(ledger_rest::find_postings(postings, parsed[i], expected, index), found[i]);
+        ASSERT_EQ(expected, rows[i]);
+      }
+      ASSERT_TRUE(found[0]);
+      ASSERT_FALSE(found[7]);
+    }
+  }
+}
+
+TEST(posting_query, date_order_test) {
+  ledger_rest::posting_table postings(build_query_table());
+  ASSERT_TRUE(ledger_rest::get_posting_indexes(postings).is_date_ordered);
+
+  // Out of date order, as an included file or a back-dated entry would be.
+  std::swap(postings.dates[0], postings.dates[4]);
+  std::swap(postings.dates[1], postings.dates[5]);
+
+  ledger_rest::posting_indexes indexes(ledger_rest::get_posting_indexes(postings));
+  ASSERT_FALSE(indexes.is_date_ordered);
+  std::vector<uint32_t> expected_order = { 4, 5, 2, 3, 0, 1 };
+  ASSERT_EQ(expected_order, indexes.date_order);
+
+  std::list<std::list<std::string>> args_list = {
+    { "-b", "2015/05/17", "-e", "2015/06/01" },
+    { "-b", "2015/05/17" },
+    { "-e", "2015/05/17" },
+    { "-b", "2016/01/01" },
+    { "-b", "2015/06/01", "-e", "2015/05/01" }
+  };
+  for (const std::list<std::string>& args : args_list) {
+    find_query_rows(postings, args, {});
+    find_query_rows(postings, args, { "expenses", "or", "payee", "pay" });
+  }
+
+  std::vector<uint32_t> expected = { 1 };
+  ASSERT_EQ(expected, find_query_rows(postings, { "-b", "2015/06/01" }, { "expenses" }));
+}
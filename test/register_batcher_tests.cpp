@@ -0,0 +1,142 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "register_batcher.h"
+
+typedef ledger_rest::register_batcher::body_ptr body_ptr;
+
+// Answers each query with its key and counts the batches.
+ledger_rest::register_batcher::batch_function count_batches(std::atomic<int>& batches) {
+  return [&batches](const std::vector<std::string>& keys,
+      const std::vector<const ledger_rest::posting_query*>& queries) {
+    batches++;
+    std::vector<body_ptr> bodies;
+    for (std::size_t i = 0; i < keys.size(); i++) {
+      bodies.push_back(std::make_shared<const std::string>(
+            keys[i] + ':' + std::to_string(queries.size())));
+    }
+    return bodies;
+  };
+}
+
+TEST(register_batcher, run_test) {
+  // Long enough for every thread to join the first batch.
+  ledger_rest::register_batcher batcher(200 * 1000);
+  std::atomic<int> batches(0);
+  ledger_rest::posting_query query;
+
+  std::vector<body_ptr> bodies(6);
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    threads.push_back(std::thread([&, i]() {
+      bodies[i] = batcher.run(1, std::to_string(i), query, count_batches(batches));
+    }));
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  ASSERT_EQ(1, batches.load());
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    ASSERT_EQ(std::to_string(i) + ":6", *bodies[i]);
+  }
+}
+
+TEST(register_batcher, groups_test) {
+  ledger_rest::register_batcher batcher(200 * 1000);
+  std::atomic<int> batches(0);
+  ledger_rest::posting_query query;
+  ledger_rest::posting_query begin_query;
+  begin_query.has_begin = true;
+  begin_query.begin = 100;
+
+  // Other date ranges and generations are batched apart.
+  std::vector<body_ptr> bodies(4);
+  std::vector<std::thread> threads;
+  threads.push_back(std::thread([&]() {
+    bodies[0] = batcher.run(1, "a", query, count_batches(batches));
+  }));
+  threads.push_back(std::thread([&]() {
+    bodies[1] = batcher.run(1, "b", begin_query, count_batches(batches));
+  }));
+  threads.push_back(std::thread([&]() {
+    bodies[2] = batcher.run(2, "c", query, count_batches(batches));
+  }));
+  threads.push_back(std::thread([&]() {
+    bodies[3] = batcher.run(1, "d", query, count_batches(batches));
+  }));
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  ASSERT_EQ(3, batches.load());
+  ASSERT_EQ(3u, batcher.get_batch_count());
+  ASSERT_EQ(std::string("a:2"), *bodies[0]);
+  ASSERT_EQ(std::string("b:1"), *bodies[1]);
+  ASSERT_EQ(std::string("c:1"), *bodies[2]);
+  ASSERT_EQ(std::string("d:2"), *bodies[3]);
+}
+
+TEST(register_batcher, no_window_test) {
+  ledger_rest::register_batcher batcher(0);
+  std::atomic<int> batches(0);
+  ledger_rest::posting_query query;
+  ASSERT_EQ(std::string("a:1"), *batcher.run(1, "a", query, count_batches(batches)));
+  ASSERT_EQ(std::string("b:1"), *batcher.run(1, "b", query, count_batches(batches)));
+  ASSERT_EQ(2, batches.load());
+}
+
+TEST(register_batcher, error_test) {
+  ledger_rest::register_batcher batcher(50 * 1000);
+  ledger_rest::posting_query query;
+  auto fail = [](const std::vector<std::string>&,
+      const std::vector<const ledger_rest::posting_query*>&) -> std::vector<body_ptr> {
+    throw std::runtime_error("failed");
+  };
+
+  std::atomic<int> errors(0);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 3; i++) {
+    threads.push_back(std::thread([&]() {
+      try {
+        batcher.run(1, "a", query, fail);
+      } catch (const std::runtime_error&) {
+        errors++;
+      }
+    }));
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(3, errors.load());
+}
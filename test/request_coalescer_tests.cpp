@@ -0,0 +1,113 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "request_coalescer.h"
+
+typedef ledger_rest::request_coalescer::body_ptr body_ptr;
+
+TEST(request_coalescer, run_test) {
+  ledger_rest::request_coalescer flights;
+  std::atomic<int> computed(0);
+  std::mutex release_mutex;
+  std::condition_variable release_cv;
+  bool is_released = false;
+
+  // The first caller blocks until every other caller is waiting on it.
+  auto compute = [&]() {
+    computed++;
+    std::unique_lock<std::mutex> lock(release_mutex);
+    release_cv.wait(lock, [&]() { return is_released; });
+    return std::make_shared<const std::string>("body");
+  };
+
+  std::vector<body_ptr> bodies(8);
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < bodies.size(); i++) {
+    threads.push_back(std::thread([&, i]() { bodies[i] = flights.run(1, "key", compute); }));
+  }
+  while (flights.get_coalesced_count() < bodies.size() - 1) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  {
+    std::lock_guard<std::mutex> lock(release_mutex);
+    is_released = true;
+  }
+  release_cv.notify_all();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  ASSERT_EQ(1, computed.load());
+  for (const body_ptr& body : bodies) {
+    // The body itself is shared, not a copy of it.
+    ASSERT_EQ(bodies.front().get(), body.get());
+  }
+  ASSERT_EQ(std::string("body"), *bodies.front());
+
+  // Nothing is kept once the call is done.
+  flights.run(1, "key", compute);
+  ASSERT_EQ(2, computed.load());
+}
+
+TEST(request_coalescer, keys_test) {
+  ledger_rest::request_coalescer flights;
+
+  // Calls inside compute are concurrent with it but for other keys.
+  body_ptr outer = flights.run(1, "a", [&]() {
+    body_ptr other_key = flights.run(1, "b", []() {
+      return std::make_shared<const std::string>("b");
+    });
+    body_ptr other_generation = flights.run(2, "a", []() {
+      return std::make_shared<const std::string>("a2");
+    });
+    return std::make_shared<const std::string>(*other_key + *other_generation);
+  });
+  ASSERT_EQ(std::string("ba2"), *outer);
+  ASSERT_EQ(0u, flights.get_coalesced_count());
+}
+
+TEST(request_coalescer, error_test) {
+  ledger_rest::request_coalescer flights;
+  ASSERT_THROW(flights.run(1, "key", []() -> body_ptr {
+        throw std::runtime_error("failed");
+      }), std::runtime_error);
+
+  // A failed call is not remembered either.
+  ASSERT_EQ(std::string("ok"), *flights.run(1, "key", []() {
+        return std::make_shared<const std::string>("ok");
+      }));
+  ASSERT_FALSE(static_cast<bool>(flights.run(1, "key", []() { return body_ptr(); })));
+}
@@ -0,0 +1,78 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include <gtest/gtest.h>
+
+#include "response_cache.h"
+
+std::shared_ptr<const std::string> make_body(std::size_t size) {
+  return std::make_shared<const std::string>(size, 'x');
+}
+
+TEST(response_cache, hit_test) {
+  ledger_rest::response_cache cache(1 << 20);
+  ASSERT_FALSE(cache.get(1, "a"));
+  cache.put(1, "a", make_body(10));
+
+  std::shared_ptr<const std::string> body(cache.get(1, "a"));
+  ASSERT_TRUE(body);
+  ASSERT_EQ(10u, body->size());
+
+  ledger_rest::response_cache::stats stats(cache.get_stats());
+  ASSERT_EQ(1u, stats.hits);
+  ASSERT_EQ(1u, stats.misses);
+  ASSERT_EQ(1u, stats.entries);
+}
+
+TEST(response_cache, generation_test) {
+  ledger_rest::response_cache cache(1 << 20);
+  cache.put(1, "a", make_body(10));
+  ASSERT_FALSE(cache.get(2, "a"));
+  ASSERT_EQ(0u, cache.get_stats().bytes);
+
+  // Results computed from an older journal are not kept.
+  cache.put(1, "a", make_body(10));
+  ASSERT_FALSE(cache.get(2, "a"));
+}
+
+TEST(response_cache, eviction_test) {
+  ledger_rest::response_cache cache(3000);
+  cache.put(1, "a", make_body(1000));
+  cache.put(1, "b", make_body(1000));
+  ASSERT_TRUE(cache.get(1, "a"));
+  cache.put(1, "c", make_body(1000));
+
+  ASSERT_TRUE(cache.get(1, "a"));
+  ASSERT_FALSE(cache.get(1, "b"));
+  ASSERT_TRUE(cache.get(1, "c"));
+
+  ledger_rest::response_cache::stats stats(cache.get_stats());
+  ASSERT_EQ(1u, stats.evictions);
+  ASSERT_LE(stats.bytes, 3000u);
+
+  cache.put(1, "d", make_body(4000));
+  ASSERT_FALSE(cache.get(1, "d"));
+}
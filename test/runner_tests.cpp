@@ -0,0 +1,55 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include <chrono>
+#include <list>
+#include <gtest/gtest.h>
+
+#include "runner.h"
+#include "runnable.h"
+
+#include "black_hole_logger.h"
+
+TEST(runner, timer_test) {
+  black_hole_logger logger;
+  std::list<ledger_rest::runnable*> runners;
+  ledger_rest::runner runner(logger, runners);
+
+  bool is_cancelled_run = false;
+  std::list<int> order;
+  unsigned long long cancelled = runner.add_timer(10, [&]() { is_cancelled_run = true; });
+  runner.add_timer(20, [&]() { order.push_back(2); runner.stop(); });
+  runner.add_timer(5, [&]() { order.push_back(1); });
+  runner.cancel_timer(cancelled);
+
+  auto start = std::chrono::steady_clock::now();
+  runner.run();
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  ASSERT_FALSE(is_cancelled_run);
+  ASSERT_EQ(std::list<int>({ 1, 2 }), order);
+  ASSERT_GE(elapsed, std::chrono::milliseconds(20));
+}
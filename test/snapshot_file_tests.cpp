@@ -0,0 +1,105 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+#include <gtest/gtest.h>
+
+#include "snapshot_file.h"
+
+ledger_rest::posting_table build_posting_table() {
+  ledger_rest::posting_table postings;
+  postings.account_names = { "assets:cash", "expenses:fun" };
+  postings.payee_names = { "movie" };
+  postings.commodity_names = { "$" };
+
+  int32_t day = ledger_rest::to_day_number(boost::gregorian::from_string("2015/05/16"));
+  postings.dates = { day, day };
+  postings.amounts = { -10 * ledger_rest::posting_table::amount_scale,
+    10 * ledger_rest::posting_table::amount_scale };
+  postings.account_ids = { 0, 1 };
+  postings.payee_ids = { 0, 0 };
+  postings.xact_ids = { 0, 0 };
+  postings.commodity_ids = { 0, 0 };
+  postings.post_flags = { 0, ledger_rest::posting_table::VIRTUAL };
+  return postings;
+}
+
+std::string get_temp_path() {
+  char path[] = "/tmp/ledger_rest_testXXXXXX";
+  int fd = mkstemp(path);
+  close(fd);
+  return std::string(path);
+}
+
+TEST(snapshot_file, round_trip_test) {
+  std::string path(get_temp_path());
+  std::list<std::string> accounts = { "assets:cash", "expenses:fun" };
+  ledger_rest::posting_table expected(build_posting_table());
+  ledger_rest::write_snapshot_file(path, 42, accounts, expected);
+
+  std::list<std::string> actual_accounts;
+  ledger_rest::posting_table actual;
+  ASSERT_TRUE(ledger_rest::read_snapshot_file(path, 42, actual_accounts, actual));
+  std::remove(path.c_str());
+
+  ASSERT_EQ(accounts, actual_accounts);
+  ASSERT_EQ(expected.dates, actual.dates);
+  ASSERT_EQ(expected.amounts, actual.amounts);
+  ASSERT_EQ(expected.account_ids, actual.account_ids);
+  ASSERT_EQ(expected.payee_ids, actual.payee_ids);
+  ASSERT_EQ(expected.xact_ids, actual.xact_ids);
+  ASSERT_EQ(expected.commodity_ids, actual.commodity_ids);
+  ASSERT_EQ(expected.post_flags, actual.post_flags);
+  ASSERT_EQ(expected.account_names, actual.account_names);
+  ASSERT_EQ(expected.payee_names, actual.payee_names);
+  ASSERT_EQ(expected.commodity_names, actual.commodity_names);
+  ASSERT_EQ(boost::gregorian::from_string("2015/05/16"),
+      ledger_rest::from_day_number(actual.dates[0]));
+}
+
+TEST(snapshot_file, stale_key_test) {
+  std::string path(get_temp_path());
+  ledger_rest::write_snapshot_file(path, 42, { "assets:cash" }, build_posting_table());
+
+  std::list<std::string> accounts;
+  ledger_rest::posting_table postings;
+  ASSERT_FALSE(ledger_rest::read_snapshot_file(path, 43, accounts, postings));
+  std::remove(path.c_str());
+  ASSERT_FALSE(ledger_rest::read_snapshot_file(path, 42, accounts, postings));
+}
+
+TEST(snapshot_file, corrupt_test) {
+  std::string path(get_temp_path());
+  ledger_rest::write_snapshot_file(path, 42, { "assets:cash" }, build_posting_table());
+  truncate(path.c_str(), 60);
+
+  std::list<std::string> accounts;
+  ledger_rest::posting_table postings;
+  ASSERT_THROW(ledger_rest::read_snapshot_file(path, 42, accounts, postings), std::runtime_error);
+  std::remove(path.c_str());
+}
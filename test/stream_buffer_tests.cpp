@@ -0,0 +1,90 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <gtest/gtest.h>
+
+#include "stream_buffer.h"
+
+TEST(stream_buffer, read_write_test) {
+  std::atomic<int> wakes(0);
+  ledger_rest::stream_buffer buffer(4, [&]() { wakes++; });
+  char out[16];
+  std::size_t size;
+  int pauses = 0;
+  auto pause = [&]() { pauses++; };
+
+  ASSERT_EQ(ledger_rest::stream_buffer::WAITING, buffer.read(out, sizeof(out), size, pause));
+  ASSERT_EQ(1, pauses);
+
+  buffer.write(std::string("abc"));
+  ASSERT_EQ(1, wakes);
+  ASSERT_EQ(ledger_rest::stream_buffer::DATA, buffer.read(out, sizeof(out), size, pause));
+  ASSERT_EQ(std::string("abc"), std::string(out, size));
+
+  buffer.close();
+  ASSERT_EQ(ledger_rest::stream_buffer::END, buffer.read(out, sizeof(out), size, pause));
+}
+
+TEST(stream_buffer, bounded_test) {
+  ledger_rest::stream_buffer buffer(8, []() { });
+  std::string expected;
+  for (int i = 0; i < 1000; i++) {
+    expected += std::to_string(i) + ",";
+  }
+
+  std::thread producer([&]() {
+    buffer.write(expected);
+    buffer.close();
+  });
+
+  std::string actual;
+  char out[5];
+  std::size_t size;
+  ledger_rest::stream_buffer::read_status status;
+  while ((status = buffer.read(out, sizeof(out), size, []() { })) != ledger_rest::stream_buffer::END) {
+    actual.append(out, size);
+  }
+  producer.join();
+
+  ASSERT_EQ(expected, actual);
+}
+
+TEST(stream_buffer, cancel_test) {
+  ledger_rest::stream_buffer buffer(2, []() { });
+  buffer.write(std::string("ab"));
+  std::thread reader([&]() { buffer.cancel(); });
+  ASSERT_THROW(buffer.write(std::string("c")), std::runtime_error);
+  reader.join();
+
+  buffer.close(true);
+  char out[4];
+  std::size_t size;
+  ASSERT_EQ(ledger_rest::stream_buffer::DATA, buffer.read(out, sizeof(out), size, []() { }));
+  ASSERT_EQ(ledger_rest::stream_buffer::FAILED, buffer.read(out, sizeof(out), size, []() { }));
+}
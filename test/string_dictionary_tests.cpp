@@ -0,0 +1,52 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include <gtest/gtest.h>
+
+#include "string_dictionary.h"
+
+TEST(string_dictionary, intern_test) {
+  ledger_rest::string_dictionary names;
+  ASSERT_EQ(0u, names.intern("expenses:food"));
+  ASSERT_EQ(1u, names.intern("Joe's \"Diner\""));
+  ASSERT_EQ(0u, names.intern("expenses:food"));
+  ASSERT_EQ(2u, names.size());
+
+  ASSERT_EQ(std::string("Joe's \"Diner\""), names.get_string(1));
+  ASSERT_EQ(std::string("\"Joe's \\\"Diner\\\"\""), names.get_json(1));
+  ASSERT_EQ(std::string("\"expenses:food\""), names.get_json(0));
+}
+
+TEST(string_dictionary, find_test) {
+  ledger_rest::string_dictionary names;
+  names.intern("a");
+  names.intern("b");
+
+  uint32_t id = 0;
+  ASSERT_TRUE(names.find("b", id));
+  ASSERT_EQ(1u, id);
+  ASSERT_FALSE(names.find("c", id));
+}
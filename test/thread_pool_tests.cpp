@@ -0,0 +1,121 @@
+//
+// Copyright (c) 2015-2020 Chad Voegele
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification,
+// are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation and/or
+// other materials provided with the distribution.
+//  * The name of Chad Voegele may not be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "black_hole_logger.h"
+#include "thread_pool.h"
+
+TEST(thread_pool, parallel_for_test) {
+  black_hole_logger logger;
+  ledger_rest::thread_pool pool(4, logger);
+
+  std::vector<int> results(1000, 0);
+  pool.parallel_for(results.size(), [&](std::size_t i) { results[i] = static_cast<int>(i) * 2; });
+  for (std::size_t i = 0; i < results.size(); i++) {
+    ASSERT_EQ(static_cast<int>(i) * 2, results[i]);
+  }
+
+  pool.parallel_for(0, [](std::size_t) { FAIL(); });
+}
+
+TEST(thread_pool, parallel_for_from_task_test) {
+  black_hole_logger logger;
+  ledger_rest::thread_pool pool(2, logger);
+
+  // Every worker calls parallel_for so none is free to help.
+  std::atomic<int> sum(0);
+  std::vector<std::promise<void>> finished(2);
+  for (std::size_t task = 0; task < finished.size(); task++) {
+    pool.submit([&pool, &sum, &finished, task]() {
+      pool.parallel_for(100, [&sum](std::size_t i) { sum += static_cast<int>(i); });
+      finished[task].set_value();
+    });
+  }
+  for (std::promise<void>& promise : finished) {
+    promise.get_future().wait();
+  }
+  ASSERT_EQ(2 * 4950, sum.load());
+}
+
+TEST(thread_pool, parallel_for_error_test) {
+  black_hole_logger logger;
+  ledger_rest::thread_pool pool(2, logger);
+
+  std::atomic<int> count(0);
+  ASSERT_THROW(pool.parallel_for(10, [&count](std::size_t i) {
+        count++;
+        if (i == 3) {
+          throw std::runtime_error("chunk failed");
+        }
+      }), std::runtime_error);
+  // Indexes after the failure may have been skipped.
+  ASSERT_GE(count.load(), 4);
+  ASSERT_LE(count.load(), 10);
+}
+
+TEST(thread_pool, parallel_for_ready_test) {
+  black_hole_logger logger;
+  ledger_rest::thread_pool pool(4, logger);
+
+  std::vector<int> results(200, 0);
+  std::vector<std::size_t> ready;
+  pool.parallel_for(results.size(), [&](std::size_t i) {
+        // Later indexes tend to finish first.
+        std::this_thread::sleep_for(std::chrono::microseconds((i % 7) * 50));
+        results[i] = 1;
+      }, [&](std::size_t i) {
+        // Everything up to i has run.
+        for (std::size_t j = 0; j <= i; j++) {
+          ASSERT_EQ(1, results[j]);
+        }
+        ready.push_back(i);
+      });
+  ASSERT_EQ(results.size(), ready.size());
+  for (std::size_t i = 0; i < ready.size(); i++) {
+    ASSERT_EQ(i, ready[i]);
+  }
+
+  // A writer that fails, as when a client goes away, stops the rest.
+  std::atomic<int> count(0);
+  ASSERT_THROW(pool.parallel_for(1000, [&count](std::size_t) {
+          count++;
+          std::this_thread::sleep_for(std::chrono::microseconds(200));
+        },
+        [](std::size_t i) {
+          if (i == 1) {
+            throw std::runtime_error("client went away");
+          }
+        }), std::runtime_error);
+  ASSERT_LT(count.load(), 1000);
+}